@@ -0,0 +1,60 @@
+/**
+ * @file hash.c
+ *
+ * @brief Fast non-cryptographic hashing.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 12:40:07 +0200
+ *
+ * MurmurHash64A, by Austin Appleby (public domain).
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat.h"
+
+#include <string.h>
+
+#include "hash.h"
+
+#define HASH_SEED   0x5bd1e9955bd1e995ULL
+
+uint64_t hash64(const void *data, size_t len)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const unsigned char *p = data;
+    const unsigned char *end = p + (len & ~(size_t)7);
+    uint64_t h = HASH_SEED ^ (len * m);
+
+    for (; p != end; p += 8) {
+        uint64_t k;
+
+        memcpy(&k, p, sizeof k); /* unaligned safe */
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+        case 7: h ^= (uint64_t)p[6] << 48; /* fall through */
+        case 6: h ^= (uint64_t)p[5] << 40; /* fall through */
+        case 5: h ^= (uint64_t)p[4] << 32; /* fall through */
+        case 4: h ^= (uint64_t)p[3] << 24; /* fall through */
+        case 3: h ^= (uint64_t)p[2] << 16; /* fall through */
+        case 2: h ^= (uint64_t)p[1] << 8;  /* fall through */
+        case 1: h ^= (uint64_t)p[0];
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
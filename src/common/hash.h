@@ -0,0 +1,35 @@
+/**
+ * @file hash.h
+ *
+ * @brief Fast non-cryptographic hashing.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 12:40:07 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Hashes a buffer (MurmurHash64A).
+ *
+ * Good enough to tell apart different media objects, but not collision
+ * resistant against crafted data.
+ *
+ * @param data the buffer
+ * @param len size of the buffer
+ * @return the 64 bits hash
+ */
+uint64_t hash64(const void *data, size_t len);
+
+#endif /* __HASH_H__ */
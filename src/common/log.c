@@ -22,6 +22,9 @@
 
 static loglevel_t loglevel = LOG_WARNING;
 
+/* Informational messages go to stdout, unless it carries a stream of data. */
+static FILE *info_stream = NULL;
+
 static char* get_levelstring(loglevel_t level);
 char* get_timestring(void);
 
@@ -35,6 +38,11 @@ void set_loglevel(loglevel_t level)
     loglevel = level;
 }
 
+void set_log_info_stdout(int enable)
+{
+    info_stream = enable ? NULL : stderr;
+}
+
 void log_msg(loglevel_t level, const char *fmt, ...)
 {
     int n;
@@ -73,7 +81,7 @@ void log_msg(loglevel_t level, const char *fmt, ...)
 		FILE *out_descriptor = stderr;
 		
 		if (level == LOG_INFO) {
-			out_descriptor = stdout;
+			out_descriptor = info_stream ? info_stream : stdout;
 		}
 		
 		levelstring = get_levelstring(level);
@@ -52,6 +52,14 @@ loglevel_t get_loglevel(void);
 
 void set_loglevel(loglevel_t level);
 
+/**
+ * @brief Sends the informational messages to standard output (the default) or
+ * to standard error, when standard output carries a stream of data.
+ *
+ * @param enable TRUE for standard output, FALSE for standard error
+ */
+void set_log_info_stdout(int enable);
+
 /**
  * @brief Logs a new message.
  *
@@ -0,0 +1,233 @@
+/**
+ * @file memstore.c
+ *
+ * @brief Bounded in-memory store of media objects.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 16:21:05 +0200
+ *
+ * The objects are kept, by name, in a LRU list bounded in bytes, for the
+ * http display to serve them: as a cache of the temporary directory, or
+ * instead of it when nothing should be written to disk.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util.h"
+#include "hash.h"
+#include "memstore.h"
+
+static struct {
+    pthread_mutex_t mutex;
+
+    size_t max_bytes;
+
+    /* least and most recently used */
+    memobj_t *lru, *mru;
+
+    memobj_t **buckets;
+    size_t nbuckets;
+
+    memstore_stats_t stats;
+} store = { PTHREAD_MUTEX_INITIALIZER };
+
+void memstore_init(size_t max_bytes)
+{
+    pthread_mutex_lock(&store.mutex);
+    store.max_bytes = max_bytes;
+    pthread_mutex_unlock(&store.mutex);
+}
+
+/* bucket NAME
+ * Hash bucket of NAME; must be called with the mutex held. */
+static memobj_t **bucket(const char *name)
+{
+    return &store.buckets[hash64(name, strlen(name)) & (store.nbuckets - 1)];
+}
+
+/* grow
+ * Doubles the number of buckets; must be called with the mutex held. */
+static void grow(void)
+{
+    memobj_t *o;
+
+    xfree(store.buckets);
+    store.nbuckets = store.nbuckets ? store.nbuckets * 2 : 256;
+    store.buckets = xcalloc(store.nbuckets, sizeof *store.buckets);
+
+    for (o = store.lru; o; o = o->next) {
+        memobj_t **b = bucket(o->name);
+
+        o->hnext = *b;
+        *b = o;
+    }
+}
+
+static void unref(memobj_t *o)
+{
+    if (--o->refs == 0) {
+        xfree(o->data - MEMSTORE_HEADROOM);
+        xfree(o);
+    }
+}
+
+/* unlink_lru OBJECT
+ * Takes OBJECT out of the LRU list; must be called with the mutex held. */
+static void unlink_lru(memobj_t *o)
+{
+    if (o->prev)
+        o->prev->next = o->next;
+    else
+        store.lru = o->next;
+
+    if (o->next)
+        o->next->prev = o->prev;
+    else
+        store.mru = o->prev;
+
+    o->prev = o->next = NULL;
+}
+
+static void push_mru(memobj_t *o)
+{
+    o->prev = store.mru;
+    if (store.mru)
+        store.mru->next = o;
+    else
+        store.lru = o;
+    store.mru = o;
+}
+
+/* remove_obj OBJECT
+ * Takes OBJECT out of the store; it is freed once nobody uses it. Must be
+ * called with the mutex held. */
+static void remove_obj(memobj_t *o)
+{
+    memobj_t **b;
+
+    for (b = bucket(o->name); *b != o; b = &(*b)->hnext)
+        ;
+    *b = o->hnext;
+
+    unlink_lru(o);
+
+    --store.stats.objects;
+    store.stats.bytes -= o->len;
+
+    unref(o);
+}
+
+static memobj_t *find(const char *name)
+{
+    memobj_t *o;
+
+    if (store.nbuckets == 0)
+        return NULL;
+
+    for (o = *bucket(name); o; o = o->hnext)
+        if (strcmp(o->name, name) == 0)
+            return o;
+
+    return NULL;
+}
+
+int memstore_put(const char *name, const unsigned char *data, size_t len)
+{
+    memobj_t *o;
+    memobj_t **b;
+
+    if (len > store.max_bytes)
+        return FALSE;
+
+    /* copy out of the lock */
+    alloc_struct(memobj, o);
+    snprintf(o->name, MEMSTORE_NAMELEN, "%s", name);
+    o->data = (unsigned char *)xmalloc(MEMSTORE_HEADROOM + len) + MEMSTORE_HEADROOM;
+    memcpy(o->data, data, len);
+    o->len = len;
+    o->hash = hash64(data, len);
+    o->refs = 1;
+
+    pthread_mutex_lock(&store.mutex);
+
+    if (store.nbuckets) {
+        memobj_t *old = find(o->name);
+
+        if (old)
+            remove_obj(old);
+    }
+
+    while (store.lru && store.stats.bytes + len > store.max_bytes) {
+        remove_obj(store.lru);
+        ++store.stats.evicted;
+    }
+
+    if (store.stats.objects >= store.nbuckets)
+        grow();
+
+    b = bucket(o->name);
+    o->hnext = *b;
+    *b = o;
+    push_mru(o);
+
+    ++store.stats.objects;
+    store.stats.bytes += len;
+    if (store.stats.bytes > store.stats.peak_bytes)
+        store.stats.peak_bytes = store.stats.bytes;
+
+    pthread_mutex_unlock(&store.mutex);
+
+    return TRUE;
+}
+
+memobj_t *memstore_get(const char *name)
+{
+    memobj_t *o;
+
+    pthread_mutex_lock(&store.mutex);
+
+    if ((o = find(name))) {
+        unlink_lru(o);
+        push_mru(o);
+        ++o->refs;
+    }
+
+    pthread_mutex_unlock(&store.mutex);
+
+    return o;
+}
+
+void memstore_release(memobj_t *obj)
+{
+    pthread_mutex_lock(&store.mutex);
+    unref(obj);
+    pthread_mutex_unlock(&store.mutex);
+}
+
+void memstore_close(void)
+{
+    pthread_mutex_lock(&store.mutex);
+
+    while (store.lru)
+        remove_obj(store.lru);
+
+    xfree(store.buckets);
+    store.buckets = NULL;
+    store.nbuckets = 0;
+
+    pthread_mutex_unlock(&store.mutex);
+}
+
+void memstore_get_stats(memstore_stats_t *stats)
+{
+    pthread_mutex_lock(&store.mutex);
+    *stats = store.stats;
+    pthread_mutex_unlock(&store.mutex);
+}
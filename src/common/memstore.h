@@ -0,0 +1,113 @@
+/**
+ * @file memstore.h
+ *
+ * @brief Bounded in-memory store of media objects.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 16:21:05 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __MEMSTORE_H__
+#define __MEMSTORE_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Default limit of the bytes held by the store.
+ */
+#define MEMSTORE_DEFAULT_MAX_BYTES  (64 * 1024 * 1024)
+
+/**
+ * @brief Max name length of an object.
+ */
+#define MEMSTORE_NAMELEN    64
+
+/**
+ * @brief Bytes free before the data of each object, so a server can prepend
+ * its framing without copying the object.
+ */
+#define MEMSTORE_HEADROOM   32
+
+/**
+ * @brief An object of the store.
+ *
+ * Objects got with memstore_get() stay valid, even if evicted from the store,
+ * until released with memstore_release().
+ */
+typedef struct memobj {
+    char name[MEMSTORE_NAMELEN];
+    unsigned char *data;
+    size_t len;
+
+    /** hash64() of the data */
+    uint64_t hash;
+
+    /** References: one from the store while in it, plus one per memstore_get() */
+    int refs;
+
+    /** Least to most recently used list, and hash bucket */
+    struct memobj *prev, *next, *hnext;
+} memobj_t;
+
+typedef struct {
+    /** Objects and bytes in the store, now and at most */
+    unsigned long objects;
+    size_t bytes, peak_bytes;
+
+    /** Objects evicted to keep within the limit */
+    unsigned long evicted;
+} memstore_stats_t;
+
+/**
+ * @brief Sets up the store.
+ *
+ * @param max_bytes maximum bytes held; the least recently used objects are evicted
+ */
+void memstore_init(size_t max_bytes);
+
+/**
+ * @brief Empties the store.
+ */
+void memstore_close(void);
+
+/**
+ * @brief Copies an object into the store. Can be called from several threads.
+ *
+ * @param name object name (replaces any object with the same name)
+ * @param data object data
+ * @param len size of data
+ * @return TRUE on success; FALSE if it is bigger than the whole store
+ */
+int memstore_put(const char *name, const unsigned char *data, size_t len);
+
+/**
+ * @brief Looks up an object, marking it as recently used.
+ *
+ * @param name object name
+ * @return the object (to be released with memstore_release), or NULL if not found
+ */
+memobj_t *memstore_get(const char *name);
+
+/**
+ * @brief Drops a reference got with memstore_get().
+ *
+ * @param obj the object
+ */
+void memstore_release(memobj_t *obj);
+
+/**
+ * @brief Get the store statistics.
+ *
+ * @param stats where to store them
+ */
+void memstore_get_stats(memstore_stats_t *stats);
+
+#endif /* __MEMSTORE_H__ */
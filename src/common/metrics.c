@@ -0,0 +1,188 @@
+/**
+ * @file metrics.c
+ *
+ * @brief Counters of what driftnet does, for the /metrics of the http display.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 22:03:18 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "metrics.h"
+
+/* Max collectors of the modules. */
+#define METRICS_MAX_COLLECTORS  8
+
+/*
+ * The counters of a thread. Only the thread writes them, so adding is a
+ * plain load and store; they are atomic just so the scrape reads whole
+ * values. Each block is cache line aligned, so the threads don't share lines.
+ */
+struct metrics_block {
+    _Atomic int64_t counters[METRIC_NCOUNTERS];
+    _Atomic int64_t drivers[METRICS_MAX_DRIVERS][METRIC_DRIVER_NCOUNTERS];
+    struct metrics_block *next;
+};
+
+/*
+ * The blocks of all the threads, pushed on their first count. They are
+ * never freed, so what a thread counted is kept once it is gone.
+ */
+static struct metrics_block *_Atomic blocks;
+static _Thread_local struct metrics_block *self;
+
+static const struct {
+    const char *name, *type, *help;
+} counters[METRIC_NCOUNTERS] = {
+    { "driftnet_packets_total", "counter", "Packets captured." },
+    { "driftnet_packet_bytes_total", "counter", "Bytes of the packets captured." },
+    { "driftnet_connections", "gauge", "TCP connections being reassembled." },
+    { "driftnet_reassembly_bytes", "gauge", "Bytes held to reassemble the connections." },
+    { "driftnet_files_written_total", "counter", "Files written to the temporary directory." },
+    { "driftnet_files_dropped_total", "counter", "Files not written, for errors or quotas." },
+    { "driftnet_pcap_received_total", "counter", "Packets received by the capture." },
+    { "driftnet_pcap_dropped_total", "counter", "Packets dropped by the kernel, for lack of buffer room." },
+    { "driftnet_pcap_if_dropped_total", "counter", "Packets dropped by the network interface." }
+};
+
+static const struct {
+    const char *name, *help;
+} driver_counters[METRIC_DRIVER_NCOUNTERS] = {
+    { "driftnet_driver_candidates_total", "Data scanned by the media drivers." },
+    { "driftnet_driver_hits_total", "Media carved by the media drivers." },
+    { "driftnet_driver_bytes_total", "Bytes of the media carved by the media drivers." }
+};
+
+static const char *_Atomic driver_names[METRICS_MAX_DRIVERS];
+
+static pthread_mutex_t collectors_mutex = PTHREAD_MUTEX_INITIALIZER;
+static metrics_collector_t collectors[METRICS_MAX_COLLECTORS];
+static int ncollectors;
+
+/* thread_block:
+ * The counters of this thread, made on its first count. */
+static struct metrics_block *thread_block(void)
+{
+    struct metrics_block *b;
+    void *p;
+
+    if (self)
+        return self;
+
+    if (posix_memalign(&p, 64, sizeof *b) != 0)
+        return NULL;
+
+    b = p;
+    memset(b, 0, sizeof *b);
+
+    b->next = atomic_load(&blocks);
+    while (!atomic_compare_exchange_weak(&blocks, &b->next, b))
+        ;
+
+    return self = b;
+}
+
+/* bump COUNTER N
+ * Adds N to COUNTER, which only this thread writes. */
+static inline void bump(_Atomic int64_t *counter, int64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+            memory_order_relaxed);
+}
+
+void metrics_add(metric_t m, int64_t n)
+{
+    struct metrics_block *b = thread_block();
+
+    if (b)
+        bump(&b->counters[m], n);
+}
+
+void metrics_driver_add(int driver, metric_driver_t m, int64_t n)
+{
+    struct metrics_block *b = thread_block();
+
+    if (b && driver >= 0 && driver < METRICS_MAX_DRIVERS)
+        bump(&b->drivers[driver][m], n);
+}
+
+void metrics_set_driver_name(int driver, const char *name)
+{
+    if (driver >= 0 && driver < METRICS_MAX_DRIVERS)
+        atomic_store(&driver_names[driver], name);
+}
+
+int64_t metrics_get(metric_t m)
+{
+    struct metrics_block *b;
+    int64_t sum = 0;
+
+    for (b = atomic_load(&blocks); b; b = b->next)
+        sum += atomic_load_explicit(&b->counters[m], memory_order_relaxed);
+
+    return sum;
+}
+
+int64_t metrics_driver_get(int driver, metric_driver_t m)
+{
+    struct metrics_block *b;
+    int64_t sum = 0;
+
+    for (b = atomic_load(&blocks); b; b = b->next)
+        sum += atomic_load_explicit(&b->drivers[driver][m], memory_order_relaxed);
+
+    return sum;
+}
+
+void metrics_add_collector(metrics_collector_t fn)
+{
+    pthread_mutex_lock(&collectors_mutex);
+
+    if (ncollectors < METRICS_MAX_COLLECTORS)
+        collectors[ncollectors++] = fn;
+    else
+        log_msg(LOG_WARNING, "metrics: too many collectors");
+
+    pthread_mutex_unlock(&collectors_mutex);
+}
+
+void metrics_write_value(FILE *fp, const char *name, const char *type, const char *help, int64_t value)
+{
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", name, help, name, type, name, (long long)value);
+}
+
+void metrics_write(FILE *fp)
+{
+    const char *name;
+    int i, d;
+
+    for (i = 0; i < METRIC_NCOUNTERS; ++i)
+        metrics_write_value(fp, counters[i].name, counters[i].type, counters[i].help, metrics_get(i));
+
+    for (i = 0; i < METRIC_DRIVER_NCOUNTERS; ++i) {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s counter\n", driver_counters[i].name, driver_counters[i].help,
+                driver_counters[i].name);
+
+        for (d = 0; d < METRICS_MAX_DRIVERS; ++d)
+            if ((name = atomic_load(&driver_names[d])))
+                fprintf(fp, "%s{driver=\"%s\"} %lld\n", driver_counters[i].name, name,
+                        (long long)metrics_driver_get(d, i));
+    }
+
+    pthread_mutex_lock(&collectors_mutex);
+
+    for (i = 0; i < ncollectors; ++i)
+        collectors[i](fp);
+
+    pthread_mutex_unlock(&collectors_mutex);
+}
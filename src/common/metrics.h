@@ -0,0 +1,132 @@
+/**
+ * @file metrics.h
+ *
+ * @brief Counters of what driftnet does, for the /metrics of the http display.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 22:03:18 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief Max media drivers with counters of their own.
+ */
+#define METRICS_MAX_DRIVERS     32
+
+/**
+ * @brief Counters; the gauges go up and down.
+ */
+typedef enum {
+    METRIC_PACKETS = 0,         /* packets captured */
+    METRIC_PACKET_BYTES,        /* and their bytes on the wire */
+    METRIC_CONNECTIONS,         /* gauge: connections being reassembled */
+    METRIC_REASSEMBLY_BYTES,    /* gauge: bytes held to reassemble them */
+    METRIC_FILES_WRITTEN,       /* files written to the temporary directory */
+    METRIC_FILES_DROPPED,       /* files not written, for errors or quotas */
+    METRIC_PCAP_RECEIVED,       /* packets received, by libpcap */
+    METRIC_PCAP_DROPPED,        /* dropped by the kernel */
+    METRIC_PCAP_IF_DROPPED,     /* dropped by the network interface */
+    METRIC_NCOUNTERS
+} metric_t;
+
+/**
+ * @brief Counters of each media driver.
+ */
+typedef enum {
+    METRIC_DRIVER_CANDIDATES = 0,   /* data scanned for media */
+    METRIC_DRIVER_HITS,             /* media carved */
+    METRIC_DRIVER_BYTES,            /* and their bytes */
+    METRIC_DRIVER_NCOUNTERS
+} metric_driver_t;
+
+/**
+ * @brief Writes metrics of a module when scraped, see metrics_add_collector().
+ */
+typedef void (*metrics_collector_t)(FILE *fp);
+
+/**
+ * @brief Adds to a counter.
+ *
+ * Each thread has counters of its own, so this takes neither a lock nor an
+ * atomic read-modify-write; the counters of all the threads are added up
+ * when read.
+ *
+ * @param m the counter
+ * @param n what to add (negative to take from a gauge)
+ */
+void metrics_add(metric_t m, int64_t n);
+
+/**
+ * @brief Adds to a counter of a media driver, as metrics_add().
+ *
+ * @param driver index of the driver
+ * @param m the counter
+ * @param n what to add
+ */
+void metrics_driver_add(int driver, metric_driver_t m, int64_t n);
+
+/**
+ * @brief Names a media driver, which has its counters written from then on.
+ *
+ * @param driver index of the driver
+ * @param name its name (not copied)
+ */
+void metrics_set_driver_name(int driver, const char *name);
+
+/**
+ * @brief Gets a counter, added up over all the threads.
+ *
+ * @param m the counter
+ * @return its value
+ */
+int64_t metrics_get(metric_t m);
+
+/**
+ * @brief Gets a counter of a media driver, added up over all the threads.
+ *
+ * @param driver index of the driver
+ * @param m the counter
+ * @return its value
+ */
+int64_t metrics_driver_get(int driver, metric_driver_t m);
+
+/**
+ * @brief Adds a function writing the metrics of a module, such as the depth
+ * of a queue, which are read when scraped rather than counted.
+ *
+ * @param fn the collector
+ */
+void metrics_add_collector(metrics_collector_t fn);
+
+/**
+ * @brief Writes a metric, in the Prometheus text format.
+ *
+ * @param fp where to write it
+ * @param name its name
+ * @param type counter or gauge
+ * @param help its description
+ * @param value its value
+ */
+void metrics_write_value(FILE *fp, const char *name, const char *type, const char *help, int64_t value);
+
+/**
+ * @brief Writes all the metrics, the counters and those of the collectors,
+ * in the Prometheus text format.
+ *
+ * @param fp where to write them
+ */
+void metrics_write(FILE *fp);
+
+#endif /* __METRICS_H__ */
@@ -0,0 +1,74 @@
+/**
+ * @file mpscq.c
+ *
+ * @brief Lock-free queue with many producers and a single consumer.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 19:20:44 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <stddef.h>
+
+#include "mpscq.h"
+
+void mpscq_init(mpscq_t *q)
+{
+    atomic_init(&q->stub.next, NULL);
+    atomic_init(&q->head, &q->stub);
+    q->tail = &q->stub;
+}
+
+void mpscq_push(mpscq_t *q, mpscq_node_t *node)
+{
+    mpscq_node_t *prev;
+
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+
+    /*
+     * Between the exchange and the store the queue is unlinked at prev: the
+     * consumer stops there until this producer is done.
+     */
+    prev = atomic_exchange_explicit(&q->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+mpscq_node_t *mpscq_pop(mpscq_t *q)
+{
+    mpscq_node_t *tail = q->tail;
+    mpscq_node_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    /* skip the stub */
+    if (tail == &q->stub) {
+        if (!next)
+            return NULL;
+
+        q->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+
+    /* tail is the last node, unless a push is half done */
+    if (tail != atomic_load_explicit(&q->head, memory_order_acquire))
+        return NULL;
+
+    /* put the stub behind it, so it can be taken */
+    mpscq_push(q, &q->stub);
+
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file mpscq.h
+ *
+ * @brief Lock-free queue with many producers and a single consumer.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 19:20:44 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __MPSCQ_H__
+#define __MPSCQ_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stdatomic.h>
+
+/**
+ * @brief Link of a queued element, to embed in it.
+ */
+typedef struct mpscq_node {
+    struct mpscq_node *_Atomic next;
+} mpscq_node_t;
+
+/**
+ * @brief The queue (intrusive, after D. Vyukov): pushing is a single atomic
+ * exchange, popping needs no atomic read-modify-write at all.
+ */
+typedef struct {
+    /** Last pushed node, where the producers append */
+    mpscq_node_t *_Atomic head;
+
+    /** Next node to pop, only touched by the consumer */
+    mpscq_node_t *tail;
+
+    /** Placeholder keeping the queue never empty */
+    mpscq_node_t stub;
+} mpscq_t;
+
+/**
+ * @brief Initializes an empty queue.
+ *
+ * @param q the queue
+ */
+void mpscq_init(mpscq_t *q);
+
+/**
+ * @brief Appends a node. Can be called from any thread.
+ *
+ * @param q the queue
+ * @param node the node, owned by the queue until popped
+ */
+void mpscq_push(mpscq_t *q, mpscq_node_t *node);
+
+/**
+ * @brief Takes the oldest node. Only one thread may pop from a queue.
+ *
+ * A node still being pushed is not seen yet: NULL is returned although the
+ * queue is not empty, so a producer must wake the consumer up after pushing.
+ *
+ * @param q the queue
+ * @return the node, or NULL
+ */
+mpscq_node_t *mpscq_pop(mpscq_t *q);
+
+#endif /* __MPSCQ_H__ */
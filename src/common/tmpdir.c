@@ -18,15 +18,21 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <ctype.h>
 #include <time.h>
 
 #include <sys/stat.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include <assert.h>
 
 #include "util.h"
 #include "log.h"
+#include "hash.h"
+#include "uring.h"
+#include "metrics.h"
 #include "tmpdir.h"
 
 /*
@@ -45,17 +51,94 @@ typedef struct {
     const char *path;
     tmpdir_type_t type;
     int max_files;
+    size_t max_bytes;
     int preserve_files;
 } tmpdir_t;
 
-static tmpdir_t tmpdir = {NULL, TMPDIR_USER_OWNED, 0, 1};
+static tmpdir_t tmpdir = {NULL, TMPDIR_USER_OWNED, 0, 0, 1};
+
+/*
+ * Registry of the files we have written (and nobody has deleted through us),
+ * oldest first, so the quotas can be kept without scanning the directory.
+ * It is kept with or without quotas, for the statistics. Files deleted behind
+ * our back (by the adjunct process) stay accounted until they are evicted, or
+ * until we exit when there is no quota; an entry is about a hundred bytes.
+ */
+typedef struct tracked_file {
+    char name[TMPNAMELEN];
+    size_t len;
+    int type;
+    struct tracked_file *prev, *next;   /* by age */
+    struct tracked_file *hnext;         /* in the hash bucket */
+} tracked_file_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    tracked_file_t *oldest, *newest;
+    tracked_file_t **buckets;
+    size_t nbuckets;
+    unsigned long files;
+    size_t bytes;
+    tmpfiles_stats_t stats;
+} registry_t;
+
+static registry_t registry = { PTHREAD_MUTEX_INITIALIZER };
+
+/* Extensions of the files we write; XXX: get them from the media drivers. */
+static const char *tmpfile_exts[TMPFILE_NTYPES] = {
+    "gif", "jpeg", "png", "webp", "avif", "mp3", "txt", "other"
+};
+
+/*
+ * Batched writes: each writer thread queues the files it has to write and
+ * pushes them to its own io_uring at once, as linked open -> write ->
+ * [fsync ->] close chains using direct descriptors, instead of doing three
+ * or four blocking syscalls per file.
+ */
+#define TMPFILE_BATCH_MAX   32
+
+/* Operations of a file write chain (in the user_data of each entry). */
+enum { BATCH_OPEN = 0, BATCH_WRITE, BATCH_FSYNC, BATCH_CLOSE };
+
+typedef struct {
+    char name[TMPNAMELEN];
+    const unsigned char *data;
+    size_t len;
+    tmpfile_written_cb cb;
+    void *arg;
+    int opened, ok;
+} batch_entry_t;
+
+typedef struct {
+    uring_t *ring;
+    int open;
+    int count;
+    batch_entry_t entries[TMPFILE_BATCH_MAX];
+} tmpfile_batch_t;
+
+static _Thread_local tmpfile_batch_t *batch;
+
+/* Naming of the new files: unique for this process, and apart from other
+ * runs by the time we started and our pid. */
+static atomic_ulong name_counter;
+static unsigned int name_stamp;
+
+/* Levels of subdirectories, and which ones we know exist. */
+static int fanout_levels = 0;
+static atomic_uchar fanout_dirs[(1 << (8 * TMPDIR_FANOUT_MAX)) / 8];
+
+static atomic_int writer_uring = TRUE;     /* cleared by any writer thread */
+static int writer_durable = FALSE;
+static int tmpdir_fd = -1;
 
 static int is_tempfile(const char* p);
-static int count_tmpfiles(void);
+static void registry_add(const char *filename, size_t len);
+static void registry_forget(const char *filename);
+static void registry_clear(void);
 char* get_filename_fullpath(const char* filename);
 
 
-void set_tmpdir(const char *dir, tmpdir_type_t type, int max_files, int preserve_files)
+void set_tmpdir(const char *dir, tmpdir_type_t type, int max_files, size_t max_bytes, int preserve_files)
 {
     assert (tmpdir.path == NULL);    /* we only be called once */
     assert (dir != NULL);
@@ -63,8 +146,14 @@ void set_tmpdir(const char *dir, tmpdir_type_t type, int max_files, int preserve
     tmpdir.path           = dir;
     tmpdir.type           = type;
     tmpdir.max_files      = max_files;
+    tmpdir.max_bytes      = max_bytes;
     tmpdir.preserve_files = preserve_files;
 
+    name_stamp = (unsigned int)time(NULL);
+
+    /* for the batched writes, relative to it */
+    tmpdir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+
     log_msg(LOG_INFO, "using temporary file directory %s", tmpdir.path);
 }
 
@@ -88,11 +177,63 @@ const char* get_sys_tmpdir(void)
 	return systmp;
 }
 
-const char* generate_new_tmp_filename(const char* extension)
+void tmpdir_set_fanout(int levels)
+{
+    assert (levels >= 0 && levels <= TMPDIR_FANOUT_MAX);
+
+    fanout_levels = levels;
+}
+
+/* make_fanout_dir SUBDIR
+ * Makes sure the subdirectory SUBDIR (its bits select one directory per
+ * level) exists. */
+static void make_fanout_dir(unsigned int subdir)
+{
+    char dir[3 * TMPDIR_FANOUT_MAX + 1];
+    unsigned char bit = 1 << (subdir % 8);
+    int level;
+
+    if (atomic_load(&fanout_dirs[subdir / 8]) & bit)
+        return;
+
+    for (level = 0; level < fanout_levels; ++level) {
+        char *path;
+
+        sprintf(dir + 3 * level, "%02x/", (subdir >> (8 * level)) & 0xff);
+
+        path = compose_path(tmpdir.path, dir);
+
+        if (mkdir(path, 0777) == -1 && errno != EEXIST) {
+            log_msg(LOG_ERROR, "mkdir(%s): %s", path, strerror(errno));
+            xfree(path);
+            return;
+        }
+
+        xfree(path);
+    }
+
+    atomic_fetch_or(&fanout_dirs[subdir / 8], bit);
+}
+
+const char* generate_new_tmp_filename(const char* extension, char *name)
 {
-    static char name[TMPNAMELEN] = {0};
+    unsigned long n = atomic_fetch_add(&name_counter, 1);
+    unsigned int subdir;
+    int level, off = 0;
+
+    /* in memory only mode there is no directory: the names only key the
+     * memory store */
+    if (fanout_levels > 0 && tmpdir.path) {
+        /* spread consecutive files evenly */
+        subdir = hash64(&n, sizeof n) & ((1U << (8 * fanout_levels)) - 1);
+        make_fanout_dir(subdir);
+
+        for (level = 0; level < fanout_levels; ++level)
+            off += sprintf(name + off, "%02x/", (subdir >> (8 * level)) & 0xff);
+    }
 
-    sprintf(name, TEMPFILE_PREFIX"%08x%08x.%s", (unsigned int)time(NULL), rand(), extension);
+    snprintf(name + off, TMPNAMELEN - off, TEMPFILE_PREFIX"%08x-%x-%08lx.%s",
+            name_stamp, (unsigned int)getpid(), n, extension);
 
     return name;
 }
@@ -143,13 +284,48 @@ const char* make_tmpdir(void)
     return NULL; /* make GCC happy */
 }
 
+/* is_fanout_dir NAME
+ * Does NAME look like one of our subdirectories ? */
+static int is_fanout_dir(const char *name)
+{
+    return strlen(name) == 2 && isxdigit((unsigned char)name[0]) && isxdigit((unsigned char)name[1]);
+}
+
+/* clean_dir PATH LEVEL
+ * Removes our files from the directory PATH and, down to the fan-out
+ * levels, from its subdirectories (removing them too, once empty). */
+static void clean_dir(const char *path, int level)
+{
+    DIR *d;
+    struct dirent *de;
+
+    if (!(d = opendir(path)))
+        return;
+
+    while ((de = readdir(d))) {
+        char *subpath;
+
+        if (is_tempfile(de->d_name)) {
+            subpath = compose_path(path, de->d_name);
+            unlink(subpath);
+            xfree(subpath);
+
+        } else if (level < fanout_levels && is_fanout_dir(de->d_name)) {
+            subpath = compose_path(path, de->d_name);
+            clean_dir(subpath, level + 1);
+            rmdir(subpath);    /* unless something else is there */
+            xfree(subpath);
+        }
+    }
+
+    closedir(d);
+}
+
 /*
  * Ensure that our temporary directory is clear of any files.
  */
 void clean_tmpdir(void)
 {
-    DIR *d;
-
     if (tmpdir.path == NULL)
     	return;
 
@@ -162,28 +338,7 @@ void clean_tmpdir(void)
 		 *
 		 * If not, remove it.
 		 */
-		d = opendir(tmpdir.path);
-
-		if (d) {
-			struct dirent *de;
-			char *buf;
-			size_t buflen;
-
-			buf = xmalloc(buflen = strlen(tmpdir.path) + 64);
-
-			while ((de = readdir(d))) {
-				if (is_tempfile(de->d_name)) {
-					if (buflen < strlen(tmpdir.path) + strlen(de->d_name) + 1)
-						buf = xrealloc(buf, buflen = strlen(tmpdir.path) + strlen(de->d_name) + 64);
-
-					sprintf(buf, "%s/%s", tmpdir.path, de->d_name);
-					unlink(buf);
-				}
-			}
-			closedir(d);
-
-			xfree(buf);
-		}
+		clean_dir(tmpdir.path, 0);
 
 		if (tmpdir.type == TMPDIR_APP_OWNED) {
 			if ( rmdir(tmpdir.path) == -1 && errno != ENOENT) /* lame attempt to avoid race */
@@ -191,6 +346,13 @@ void clean_tmpdir(void)
 		}
     }
 
+    if (tmpdir_fd != -1) {
+        close(tmpdir_fd);
+        tmpdir_fd = -1;
+    }
+
+    registry_clear();
+
     xfree((void*)tmpdir.path);    /* we don't need it anymore */
     tmpdir.path = NULL;
 }
@@ -222,10 +384,13 @@ char* get_filename_fullpath(const char* filename)
     return compose_path(tmpdir.path, filename);
 }
 
-void tmpfile_write_file(const char* filename, const unsigned char *file_data, const size_t data_len)
+/* write_file FILENAME DATA LEN
+ * Writes a file to the temporary directory, without accounting it. */
+static int write_file(const char* filename, const unsigned char *file_data, const size_t data_len)
 {
     int fd1;
     char* filepath;
+    int ok = TRUE;
 
     filepath = get_filename_fullpath(filename);
 
@@ -234,7 +399,7 @@ void tmpfile_write_file(const char* filename, const unsigned char *file_data, co
         log_msg(LOG_ERROR, "%s: %s", filepath, strerror(errno));
         close(fd1);
         xfree(filepath);
-        return;
+        return FALSE;
     }
 
     const unsigned char *buf_ptr = file_data;
@@ -245,6 +410,7 @@ void tmpfile_write_file(const char* filename, const unsigned char *file_data, co
 
         if (written <= 0) {
             log_msg(LOG_ERROR, "%s: %s", filepath, strerror(errno));
+            ok = FALSE;
             break;
         }
 
@@ -252,8 +418,302 @@ void tmpfile_write_file(const char* filename, const unsigned char *file_data, co
         buf_len -= written;
     }
 
+    if (ok && writer_durable && fsync(fd1) != 0) {
+        log_msg(LOG_ERROR, "%s: %s", filepath, strerror(errno));
+        ok = FALSE;
+    }
+
     xfree(filepath);
     close(fd1);
+
+    return ok;
+}
+
+/* tmpfile_fits FILENAME LEN
+ * Can a file of LEN bytes be kept within the bytes quota ? */
+static int tmpfile_fits(const char* filename, size_t len)
+{
+    if (tmpdir.max_bytes == 0 || len <= tmpdir.max_bytes)
+        return TRUE;
+
+    log_msg(LOG_DEBUG, "%s: %zu bytes exceed the quota of the temporary directory", filename, len);
+
+    pthread_mutex_lock(&registry.mutex);
+    ++registry.stats.refused;
+    pthread_mutex_unlock(&registry.mutex);
+
+    return FALSE;
+}
+
+int tmpfile_write_file(const char* filename, const unsigned char *file_data, const size_t data_len)
+{
+    if (!tmpfile_fits(filename, data_len) || !write_file(filename, file_data, data_len)) {
+        metrics_add(METRIC_FILES_DROPPED, 1);
+        return FALSE;
+    }
+
+    registry_add(filename, data_len);
+    metrics_add(METRIC_FILES_WRITTEN, 1);
+
+    return TRUE;
+}
+
+void tmpfile_set_writer(int use_uring, int durable)
+{
+    atomic_store(&writer_uring, use_uring);
+    writer_durable = durable;
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+/* queue_batch_entry ENTRY SLOT
+ * Queue the chain of operations writing ENTRY, using the direct descriptor
+ * SLOT (the ring has room for a whole batch). */
+static void queue_batch_entry(batch_entry_t *e, unsigned int slot)
+{
+    struct io_uring_sqe *sqe;
+    uint64_t ud = (uint64_t)slot << 8;
+
+    /* open, into the direct descriptor slot; if it fails the rest of the
+     * chain is cancelled */
+    sqe = uring_get_sqe(batch->ring);
+    sqe->opcode     = IORING_OP_OPENAT;
+    sqe->fd         = tmpdir_fd;
+    sqe->addr       = (uintptr_t)e->name;
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+    sqe->len        = 0666;
+    sqe->file_index = slot + 1;
+    sqe->flags      = IOSQE_IO_LINK;
+    sqe->user_data  = ud | BATCH_OPEN;
+
+    /* the close should happen whatever the write or fsync do */
+    sqe = uring_get_sqe(batch->ring);
+    sqe->opcode    = IORING_OP_WRITE;
+    sqe->fd        = slot;
+    sqe->addr      = (uintptr_t)e->data;
+    sqe->len       = e->len;
+    sqe->off       = 0;
+    sqe->flags     = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqe->user_data = ud | BATCH_WRITE;
+
+    if (writer_durable) {
+        sqe = uring_get_sqe(batch->ring);
+        sqe->opcode    = IORING_OP_FSYNC;
+        sqe->fd        = slot;
+        sqe->flags     = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe->user_data = ud | BATCH_FSYNC;
+    }
+
+    sqe = uring_get_sqe(batch->ring);
+    sqe->opcode     = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data  = ud | BATCH_CLOSE;
+}
+
+/* batch_entry_done USER_DATA RES ARG
+ * Completion of one operation of a chain. */
+static void batch_entry_done(uint64_t user_data, int res, void *arg)
+{
+    batch_entry_t *e = &batch->entries[user_data >> 8];
+
+    switch (user_data & 0xff) {
+        case BATCH_OPEN:
+            e->opened = res >= 0;
+            if (res < 0)
+                log_msg(LOG_ERROR, "%s/%s: %s", tmpdir.path, e->name, strerror(-res));
+            break;
+
+        case BATCH_WRITE:
+            if (e->opened && (res < 0 || (size_t)res != e->len)) {
+                log_msg(LOG_ERROR, "%s/%s: %s", tmpdir.path, e->name,
+                        res < 0 ? strerror(-res) : "short write");
+                e->ok = FALSE;
+            }
+            break;
+
+        case BATCH_FSYNC:
+            if (e->opened && res < 0) {
+                log_msg(LOG_ERROR, "%s/%s: %s", tmpdir.path, e->name, strerror(-res));
+                e->ok = FALSE;
+            }
+            break;
+
+        case BATCH_CLOSE:
+            break;
+    }
+}
+
+/* write_batch:
+ * Push the queued files to the ring and wait for them. Returns FALSE if the
+ * ring failed as a whole. */
+static int write_batch(void)
+{
+    int i;
+
+    for (i = 0; i < batch->count; ++i) {
+        batch->entries[i].opened = FALSE;
+        batch->entries[i].ok = TRUE;
+        queue_batch_entry(&batch->entries[i], i);
+    }
+
+    if (!uring_submit_and_wait(batch->ring, batch_entry_done, NULL))
+        return FALSE;
+
+    for (i = 0; i < batch->count; ++i) {
+        batch_entry_t *e = &batch->entries[i];
+
+        if (!e->opened) {
+            e->ok = FALSE;
+
+        } else if (!e->ok) {
+            unlinkat(tmpdir_fd, e->name, 0);
+        }
+    }
+
+    return TRUE;
+}
+
+/* disable_uring REASON
+ * Go back to synchronous writes for good. */
+static void disable_uring(const char *reason)
+{
+    /* told once, by the first writer thread giving up */
+    if (atomic_exchange(&writer_uring, FALSE))
+        log_msg(LOG_INFO, "%s: using synchronous writes", reason);
+
+    uring_delete(batch->ring);
+    batch->ring = NULL;
+}
+
+/* probe_uring:
+ * Check that the kernel can run our write chains (direct descriptors for
+ * openat/close need linux >= 5.15), writing a test file. */
+static int probe_uring(void)
+{
+    batch_entry_t *e = &batch->entries[0];
+    int ok;
+
+    snprintf(e->name, TMPNAMELEN, ".driftnet-probe-%d-%p", (int)getpid(), (void*)batch);
+    e->data = (const unsigned char*)"1";
+    e->len = 1;
+    batch->count = 1;
+
+    ok = write_batch() && e->ok;
+    unlinkat(tmpdir_fd, e->name, 0);
+
+    batch->count = 0;
+
+    return ok;
+}
+
+void tmpfile_batch_begin(void)
+{
+    if (!atomic_load(&writer_uring) || tmpdir_fd == -1)
+        return;
+
+    if (!batch) {
+        batch = xcalloc(1, sizeof *batch);
+
+        /* up to four operations per file */
+        batch->ring = uring_new(TMPFILE_BATCH_MAX * 4, TMPFILE_BATCH_MAX);
+
+        if (!batch->ring)
+            disable_uring("io_uring not available");
+        else if (!probe_uring())
+            disable_uring("io_uring can't write files");
+    }
+
+    batch->open = batch->ring != NULL;
+}
+
+void tmpfile_batch_flush(void)
+{
+    int i;
+
+    if (!batch || !batch->open)
+        return;
+
+    if (batch->count > 0 && !write_batch()) {
+        /* write what we have the old way */
+        for (i = 0; i < batch->count; ++i)
+            batch->entries[i].ok = write_file(batch->entries[i].name,
+                    batch->entries[i].data, batch->entries[i].len);
+
+        disable_uring("io_uring failed");
+    }
+
+    for (i = 0; i < batch->count; ++i) {
+        batch_entry_t *e = &batch->entries[i];
+
+        if (e->ok)
+            registry_add(e->name, e->len);
+        metrics_add(e->ok ? METRIC_FILES_WRITTEN : METRIC_FILES_DROPPED, 1);
+
+        if (e->cb)
+            e->cb(e->name, e->ok, e->arg);
+    }
+
+    batch->count = 0;
+    batch->open = FALSE;
+}
+
+void tmpfile_batch_release(void)
+{
+    if (!batch)
+        return;
+
+    uring_delete(batch->ring);
+    xfree(batch);
+    batch = NULL;
+}
+
+#else /* !HAVE_LINUX_IO_URING_H */
+
+void tmpfile_batch_begin(void)
+{
+}
+
+void tmpfile_batch_flush(void)
+{
+}
+
+void tmpfile_batch_release(void)
+{
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
+void tmpfile_write_file_cb(const char* filename, const unsigned char *file_data, const size_t data_len,
+        tmpfile_written_cb cb, void *arg)
+{
+    batch_entry_t *e;
+
+    if (!tmpfile_fits(filename, data_len)) {
+        metrics_add(METRIC_FILES_DROPPED, 1);
+        if (cb)
+            cb(filename, FALSE, arg);
+        return;
+    }
+
+    if (!batch || !batch->open) {
+        int ok = tmpfile_write_file(filename, file_data, data_len);
+
+        if (cb)
+            cb(filename, ok, arg);
+        return;
+    }
+
+    if (batch->count == TMPFILE_BATCH_MAX) {
+        tmpfile_batch_flush();
+        batch->open = TRUE;
+    }
+
+    e = &batch->entries[batch->count++];
+    snprintf(e->name, TMPNAMELEN, "%s", filename);
+    e->data = file_data;
+    e->len = data_len;
+    e->cb = cb;
+    e->arg = arg;
 }
 
 int tmpfile_link_file(const char* src_file_path)
@@ -298,27 +758,8 @@ void tmpfile_delete_file(const char* filename)
 
     unlink(filepath);
     xfree(filepath);
-}
 
-int count_tmpfiles(void)
-{
-    static int num;
-    static time_t last_counted;
-    if (last_counted < time(NULL) - 5) {
-        DIR *d;
-        struct dirent *de;
-        num = 0;
-        d = opendir(tmpdir.path);
-        if (d) {
-            while ((de = readdir(d))) {
-                if (is_tempfile(de->d_name))
-                    ++num;
-            }
-            closedir(d);
-            last_counted = time(NULL);
-        }
-    }
-    return num;
+    registry_forget(filename);
 }
 
 static int is_tempfile(const char* file)
@@ -326,25 +767,202 @@ static int is_tempfile(const char* file)
     assert (file != NULL);
 
     char *p = strrchr(file, '.');    /* get the file extension */
+    int i;
 
-    /* XXX: get media files extensions from their respect media driver */
-    if (p && (strncmp (file, TEMPFILE_PREFIX, 9) == 0) &&
-        (strcmp (p, ".jpeg")==0 ||
-         strcmp (p, ".gif")==0 ||
-         strcmp (p, ".mp3")==0 ||
-         strcmp (p, ".png")==0 )) {
+    /* in a fan-out subdirectory */
+    if (strrchr(file, '/'))
+        file = strrchr(file, '/') + 1;
 
-        return TRUE;
-    }
+    if (!p || strncmp(file, TEMPFILE_PREFIX, strlen(TEMPFILE_PREFIX)) != 0)
+        return FALSE;
+
+    /* the last one stands for any other extension */
+    for (i = 0; i < TMPFILE_NTYPES - 1; ++i)
+        if (strcmp(p + 1, tmpfile_exts[i]) == 0)
+            return TRUE;
 
     return FALSE;
 }
 
-int tmpfiles_limit_reached(void)
+/* file_type FILENAME
+ * Index in tmpfile_exts of the extension of FILENAME. */
+static int file_type(const char *filename)
 {
-    if (tmpdir.max_files == 0 || count_tmpfiles() < tmpdir.max_files) {
-        return FALSE;
+    const char *p = strrchr(filename, '.');
+    int i;
+
+    if (p)
+        for (i = 0; i < TMPFILE_NTYPES - 1; ++i)
+            if (strcmp(p + 1, tmpfile_exts[i]) == 0)
+                return i;
+
+    return TMPFILE_NTYPES - 1;
+}
+
+/* registry_bucket FILENAME
+ * Bucket of FILENAME in the registry. */
+static tracked_file_t **registry_bucket(const char *filename)
+{
+    return &registry.buckets[hash64(filename, strlen(filename)) & (registry.nbuckets - 1)];
+}
+
+/* registry_grow
+ * Doubles the number of buckets of the registry. */
+static void registry_grow(void)
+{
+    tracked_file_t *f;
+
+    xfree(registry.buckets);
+    registry.nbuckets = registry.nbuckets ? registry.nbuckets * 2 : 256;
+    registry.buckets = xcalloc(registry.nbuckets, sizeof *registry.buckets);
+
+    for (f = registry.oldest; f; f = f->next) {
+        tracked_file_t **b = registry_bucket(f->name);
+
+        f->hnext = *b;
+        *b = f;
     }
+}
 
-    return TRUE;
+/* registry_remove FILE
+ * Takes FILE out of the registry and frees it. */
+static void registry_remove(tracked_file_t *f)
+{
+    tracked_file_t **b;
+
+    for (b = registry_bucket(f->name); *b != f; b = &(*b)->hnext)
+        ;
+    *b = f->hnext;
+
+    if (f->prev)
+        f->prev->next = f->next;
+    else
+        registry.oldest = f->next;
+
+    if (f->next)
+        f->next->prev = f->prev;
+    else
+        registry.newest = f->prev;
+
+    --registry.files;
+    registry.bytes -= f->len;
+    --registry.stats.types[f->type].files;
+    registry.stats.types[f->type].bytes -= f->len;
+
+    xfree(f);
+}
+
+/* registry_find FILENAME
+ * The registry entry of FILENAME, or NULL. */
+static tracked_file_t *registry_find(const char *filename)
+{
+    tracked_file_t *f;
+
+    if (registry.nbuckets == 0)
+        return NULL;
+
+    for (f = *registry_bucket(filename); f; f = f->hnext)
+        if (strcmp(f->name, filename) == 0)
+            return f;
+
+    return NULL;
+}
+
+/* registry_add FILENAME LEN
+ * Accounts a new file, deleting the oldest ones if it doesn't fit in the
+ * quotas (if any). */
+static void registry_add(const char *filename, size_t len)
+{
+    tracked_file_t *f;
+    tracked_file_t **b;
+
+    pthread_mutex_lock(&registry.mutex);
+
+    /* rewritten */
+    if ((f = registry_find(filename)))
+        registry_remove(f);
+
+    if (registry.files >= registry.nbuckets)
+        registry_grow();
+
+    f = xcalloc(1, sizeof *f);
+    snprintf(f->name, TMPNAMELEN, "%s", filename);
+    f->len = len;
+    f->type = file_type(filename);
+
+    b = registry_bucket(f->name);
+    f->hnext = *b;
+    *b = f;
+
+    f->prev = registry.newest;
+    if (registry.newest)
+        registry.newest->next = f;
+    else
+        registry.oldest = f;
+    registry.newest = f;
+
+    ++registry.files;
+    registry.bytes += len;
+    ++registry.stats.types[f->type].files;
+    registry.stats.types[f->type].bytes += len;
+
+    while (registry.oldest != f
+            && ((tmpdir.max_files && registry.files > (unsigned long)tmpdir.max_files)
+                || (tmpdir.max_bytes && registry.bytes > tmpdir.max_bytes))) {
+        tracked_file_t *old = registry.oldest;
+        char *filepath = get_filename_fullpath(old->name);
+
+        /* if it is already gone, the adjunct process is done with it */
+        if (unlink(filepath) == 0)
+            ++registry.stats.evicted;
+
+        xfree(filepath);
+        registry_remove(old);
+    }
+
+    pthread_mutex_unlock(&registry.mutex);
+}
+
+/* registry_forget FILENAME
+ * Stops accounting a file, if it was. */
+static void registry_forget(const char *filename)
+{
+    tracked_file_t *f;
+
+    pthread_mutex_lock(&registry.mutex);
+
+    if ((f = registry_find(filename)))
+        registry_remove(f);
+
+    pthread_mutex_unlock(&registry.mutex);
+}
+
+/* registry_clear
+ * Frees the registry. */
+static void registry_clear(void)
+{
+    pthread_mutex_lock(&registry.mutex);
+
+    while (registry.oldest)
+        registry_remove(registry.oldest);
+
+    xfree(registry.buckets);
+    registry.buckets = NULL;
+    registry.nbuckets = 0;
+
+    pthread_mutex_unlock(&registry.mutex);
+}
+
+void tmpfiles_get_stats(tmpfiles_stats_t *stats)
+{
+    int i;
+
+    pthread_mutex_lock(&registry.mutex);
+
+    *stats = registry.stats;
+
+    pthread_mutex_unlock(&registry.mutex);
+
+    for (i = 0; i < TMPFILE_NTYPES; ++i)
+        stats->types[i].ext = tmpfile_exts[i];
 }
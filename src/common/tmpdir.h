@@ -24,6 +24,34 @@
  */
 #define TMPNAMELEN 64
 
+/**
+ * @brief Max levels of subdirectories to spread the files over.
+ */
+#define TMPDIR_FANOUT_MAX 2
+
+/**
+ * @brief Number of kinds of files accounted (by their extension).
+ */
+#define TMPFILE_NTYPES 8
+
+/**
+ * @brief Files currently accounted in the temporary directory.
+ */
+typedef struct {
+    /** Per kind of file (the last one for any other extension) */
+    struct {
+        const char *ext;
+        unsigned long files;
+        size_t bytes;
+    } types[TMPFILE_NTYPES];
+
+    /** Files deleted to keep within the quotas */
+    unsigned long evicted;
+
+    /** Files refused because they alone exceed the bytes quota */
+    unsigned long refused;
+} tmpfiles_stats_t;
+
 /**
  * @brief Type of temporary directory.
  */
@@ -43,22 +71,40 @@ typedef enum {
 const char* get_sys_tmpdir(void);
 
 /**
- * @brief Generates a random temporal filename.
+ * @brief Generates a new, unique, temporal filename.
+ *
+ * The name is relative to the tmp dir and, with a fan-out configured, goes
+ * into one of its subdirectories (created if needed). Can be called from
+ * several threads.
  *
  * @param extension the new filename extension
- * @return filename
+ * @param name where to store the filename (of TMPNAMELEN bytes)
+ * @return name
+ */
+const char* generate_new_tmp_filename(const char* extension, char *name);
+
+/**
+ * @brief Spreads the new files over levels of subdirectories.
+ *
+ * Each level has up to 256 subdirectories, named after two hex digits.
+ *
+ * @param levels number of levels, up to TMPDIR_FANOUT_MAX (0 = flat)
  */
-const char* generate_new_tmp_filename(const char* extension);
+void tmpdir_set_fanout(int levels);
 
 /**
  * @brief Configure the tmp dir options
  *
+ * When a maximum number of files or bytes is given, the oldest files we wrote
+ * are deleted to make room for the new ones.
+ *
  * @param dir tmp dir path
  * @param type who owns the tmpdir: the user or us
- * @param max_files maximum number of files
+ * @param max_files maximum number of files (0 = unlimited)
+ * @param max_bytes maximum size of all the files together (0 = unlimited)
  * @param preserve_files preserve files on exit
  */
-void set_tmpdir(const char *dir, tmpdir_type_t type, int max_files, int preserve_files);
+void set_tmpdir(const char *dir, tmpdir_type_t type, int max_files, size_t max_bytes, int preserve_files);
 
 /**
  * @brief Get the configured tmp dir path.
@@ -88,11 +134,18 @@ const char* make_tmpdir(void);
 int check_dir_is_rw(const char* tmpdir);
 
 /**
- * @brief Check if the configured maximum number of files is reached
+ * @brief Get the accounting of the files in the temporary directory.
+ *
+ * Files are only accounted when a maximum number of files or bytes is set.
  *
- * @return FALSE if not exceed, TRUE if yes
+ * @param stats where to store them
+ */
+void tmpfiles_get_stats(tmpfiles_stats_t *stats);
+
+/**
+ * @brief Called when a file has been written (or failed to).
  */
-int tmpfiles_limit_reached(void);
+typedef void (*tmpfile_written_cb)(const char* filename, int ok, void *arg);
 
 /**
  * @brief Writes a file to the temporary directory.
@@ -100,8 +153,50 @@ int tmpfiles_limit_reached(void);
  * @param filename filename of the file to create
  * @param file_data data to write
  * @param data_len size of data
+ * @return TRUE on success, FALSE on error
+ */
+int tmpfile_write_file(const char* filename, const unsigned char *file_data, const size_t data_len);
+
+/**
+ * @brief Configures how files are written.
+ *
+ * @param use_uring batch the writes with io_uring when available
+ * @param durable fsync each file before closing it
+ */
+void tmpfile_set_writer(int use_uring, int durable);
+
+/**
+ * @brief Starts a batch of writes on the calling thread.
+ *
+ * Until tmpfile_batch_flush() is called, tmpfile_write_file_cb() only queues
+ * the writes, so the data passed to it should stay valid.
+ */
+void tmpfile_batch_begin(void);
+
+/**
+ * @brief Writes out the batch of the calling thread, running the callbacks.
+ */
+void tmpfile_batch_flush(void);
+
+/**
+ * @brief Frees the batching resources of the calling thread.
+ */
+void tmpfile_batch_release(void);
+
+/**
+ * @brief Writes a file to the temporary directory, as part of the current batch if any.
+ *
+ * Without a batch (or io_uring), the file is written right away and the
+ * callback is called before returning.
+ *
+ * @param filename filename of the file to create
+ * @param file_data data to write
+ * @param data_len size of data
+ * @param cb called once the file is written, with the filename
+ * @param arg argument for the callback
  */
-void tmpfile_write_file(const char* filename, const unsigned char *file_data, const size_t data_len);
+void tmpfile_write_file_cb(const char* filename, const unsigned char *file_data, const size_t data_len,
+        tmpfile_written_cb cb, void *arg);
 
 /**
  * @brief Deletes a file from the temp dir.
@@ -0,0 +1,232 @@
+/**
+ * @file uring.c
+ *
+ * @brief Minimal io_uring ring handling, on top of the raw syscalls.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 15:21:44 +0200
+ *
+ * We only need to push a batch of entries and wait for all of them, so we
+ * don't depend on liburing for that.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "util.h"
+#include "uring.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+struct uring {
+    int fd;
+
+    /* submission queue */
+    void *sq_ptr;
+    size_t sq_size;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int sq_entries, sq_local_tail, to_submit;
+
+    /* completion queue */
+    void *cq_ptr;
+    size_t cq_size;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+uring_t *uring_new(unsigned int entries, unsigned int nfiles)
+{
+    struct io_uring_params p;
+    uring_t *ring;
+    int *files;
+    unsigned int i;
+
+    alloc_struct(uring, ring);
+    ring->sq_ptr = ring->cq_ptr = ring->sqes = MAP_FAILED;
+
+    memset(&p, 0, sizeof p);
+    ring->fd = sys_io_uring_setup(entries, &p);
+    if (ring->fd < 0) {
+        xfree(ring);
+        return NULL;
+    }
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size)
+            ring->sq_size = ring->cq_size;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+        goto error;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED)
+            goto error;
+    }
+
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto error;
+
+    ring->sq_head    = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail    = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask    = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array   = (unsigned int*)((char*)ring->sq_ptr + p.sq_off.array);
+    ring->sq_entries = p.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+
+    ring->cq_head = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = (unsigned int*)((char*)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes    = (struct io_uring_cqe*)((char*)ring->cq_ptr + p.cq_off.cqes);
+
+    /* an empty table of direct descriptors */
+    if (nfiles > 0) {
+        files = xmalloc(nfiles * sizeof(int));
+        for (i = 0; i < nfiles; ++i)
+            files[i] = -1;
+
+        i = sys_io_uring_register(ring->fd, IORING_REGISTER_FILES, files, nfiles);
+        xfree(files);
+
+        if (i != 0)
+            goto error;
+    }
+
+    return ring;
+
+error:
+    uring_delete(ring);
+    return NULL;
+}
+
+void uring_delete(uring_t *ring)
+{
+    if (ring == NULL)
+        return;
+
+    if (ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_size);
+    if (ring->sq_ptr != MAP_FAILED)
+        munmap(ring->sq_ptr, ring->sq_size);
+
+    close(ring->fd);
+    xfree(ring);
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *ring)
+{
+    unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+    unsigned int idx;
+
+    if (ring->sq_local_tail - head >= ring->sq_entries)
+        return NULL;
+
+    idx = ring->sq_local_tail & *ring->sq_mask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof *sqe);
+
+    ring->sq_array[idx] = idx;
+    ring->sq_local_tail++;
+    ring->to_submit++;
+
+    return sqe;
+}
+
+int uring_submit_and_wait(uring_t *ring, void (*done)(uint64_t user_data, int res, void *arg), void *arg)
+{
+    unsigned int pending = ring->to_submit;
+
+    /* publish the new entries */
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    while (pending > 0) {
+        unsigned int head, tail;
+        int ret;
+
+        ret = sys_io_uring_enter(ring->fd, ring->to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        ring->to_submit -= ret;
+
+        head = *ring->cq_head;
+        tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; ++head, --pending) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+            done(cqe->user_data, cqe->res, arg);
+        }
+
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    return TRUE;
+}
+
+#else /* !HAVE_LINUX_IO_URING_H */
+
+uring_t *uring_new(unsigned int entries, unsigned int nfiles)
+{
+    return NULL;
+}
+
+void uring_delete(uring_t *ring)
+{
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *ring)
+{
+    return NULL;
+}
+
+int uring_submit_and_wait(uring_t *ring, void (*done)(uint64_t user_data, int res, void *arg), void *arg)
+{
+    return FALSE;
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
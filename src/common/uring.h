@@ -0,0 +1,69 @@
+/**
+ * @file uring.h
+ *
+ * @brief Minimal io_uring ring handling, on top of the raw syscalls.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 15:21:44 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stdint.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+    #include <linux/io_uring.h>
+#else
+    struct io_uring_sqe;
+#endif
+
+/**
+ * @brief An io_uring instance.
+ */
+typedef struct uring uring_t;
+
+/**
+ * @brief Creates a ring with a table of direct (fixed) file descriptors.
+ *
+ * @param entries number of submission entries
+ * @param nfiles number of direct descriptor slots (initially empty)
+ * @return the ring, or NULL if io_uring is not available
+ */
+uring_t *uring_new(unsigned int entries, unsigned int nfiles);
+
+/**
+ * @brief Frees a ring.
+ *
+ * @param ring the ring
+ */
+void uring_delete(uring_t *ring);
+
+/**
+ * @brief Gets a cleared submission entry.
+ *
+ * @param ring the ring
+ * @return the entry, or NULL if the submission queue is full
+ */
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+
+/**
+ * @brief Submits the queued entries and waits for their completions.
+ *
+ * Each completion is passed to the callback.
+ *
+ * @param ring the ring
+ * @param done completion callback
+ * @param arg argument for the callback
+ * @return TRUE on success, FALSE on error
+ */
+int uring_submit_and_wait(uring_t *ring, void (*done)(uint64_t user_data, int res, void *arg), void *arg);
+
+#endif /* __URING_H__ */
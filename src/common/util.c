@@ -169,3 +169,38 @@ const char* xbasename(const char* pathname)
 
     return base + 1;
 }
+
+int parse_size(const char* str, size_t* size)
+{
+    unsigned long long value;
+    char *end;
+
+    if (str == NULL || !isdigit((unsigned char)*str))
+        return FALSE;
+
+    value = strtoull(str, &end, 10);
+
+    switch (*end) {
+        case 'k': case 'K':
+            value *= 1024ULL;
+            ++end;
+            break;
+
+        case 'm': case 'M':
+            value *= 1024ULL * 1024;
+            ++end;
+            break;
+
+        case 'g': case 'G':
+            value *= 1024ULL * 1024 * 1024;
+            ++end;
+            break;
+    }
+
+    if (*end != '\0')
+        return FALSE;
+
+    *size = value;
+
+    return TRUE;
+}
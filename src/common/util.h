@@ -107,6 +107,15 @@ char* compose_path(const char* base, const char* filename);
  */
 const char* xbasename(const char* pathname);
 
+/**
+ * @brief Parse a size in bytes, with an optional k, M or G (base 1024) suffix.
+ *
+ * @param str the string to parse
+ * @param size where to store the parsed size
+ * @return TRUE if parsed, FALSE if str is not a valid size
+ */
+int parse_size(const char* str, size_t* size);
+
 /**
  * @brief Make P point to a new struct S, initialised as if in static storage (like = {0}).
  */
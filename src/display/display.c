@@ -28,8 +28,8 @@
 
 #include "common/util.h"
 #include "common/log.h"
-#include "common/tmpdir.h"
 #include "img.h"
+#include "shmring.h"
 
 #include "display.h"
 
@@ -38,6 +38,12 @@
 #define DEFAULT_WIDTH   320
 #define DEFAULT_HEIGHT  240
 
+/* Images taken from the ring and not shown yet, at most. */
+#define DECODE_MAX_PENDING  64
+
+/* The images go through a ring in shared memory; the pipe only wakes the
+ * display child up. */
+static shmring_t *imgring;
 static int imgpipe_readfd;
 static int imgpipe_writefd;
 static int beep_on_image;
@@ -47,21 +53,64 @@ static GtkWidget *window, *darea;
 static GdkWindow *drawable;
 
 static int width, height, wrx, wry, rowheight;
+
+/*
+ * The back-buffer is a ring of rows: the top of the window shows row origin,
+ * and the rows wrap around after the last one. Scrolling up moves origin
+ * rather than the pixels.
+ */
 static img backing_image;
+static cairo_surface_t *backing_surface;
+static int origin;
+static long scrolled;       /* rows scrolled since the start */
 
+/* An image on the window, with a copy of its data in case it gets saved. Its
+ * y is counted from the top of all that was shown, so scrolling leaves the
+ * rectangles alone: the window y is y - scrolled. */
 struct imgrect {
-    char *filename;
-    int x, y, w, h;
+    unsigned char *data;
+    size_t len;
+    char type[8];
+    int x, w, h;
+    long y;
 };
 
 static int nimgrects;
 static struct imgrect *imgrects;
 
+/*
+ * An image being decoded. The images are decoded, and scaled to the room in
+ * the window, by a pool of threads; the main loop only blits them.
+ */
+struct decode_job {
+    unsigned char *data;
+    size_t len;
+    char type[8];
+    int maxw, maxh;         /* room in the window when taken */
+    img image;              /* decoded and scaled, NULL if bogus */
+};
+
+static GThreadPool *decode_pool;
+static GAsyncQueue *decoded;        /* jobs done, for the main loop */
+static gint decoded_idle;           /* is the main loop told already ? */
+static int pending;                 /* jobs not shown yet */
+
+static gboolean decoded_event(gpointer data);
+static void take_images(void);
+
 static void do_gtkdisplay(void);
 
-void display_send_img(const char *name, size_t len)
+int display_send_img(const char *type, const unsigned char *data, size_t len, const mediameta_t *meta)
 {
-    write(imgpipe_writefd, name, len);
+    static const char wakeup = 0;
+
+    if (!shmring_put(imgring, type, data, len, meta))
+        return FALSE;
+
+    /* if the pipe is full, the child has wake-ups pending anyway */
+    write(imgpipe_writefd, &wakeup, 1);
+
+    return TRUE;
 }
 
 void do_image_display(char *img_prefix, int beep)
@@ -70,6 +119,13 @@ void do_image_display(char *img_prefix, int beep)
     pid_t dpychld;
     int pfd[2];
 
+    /* mapped before forking, so it is shared with the child */
+    imgring = shmring_new(SHMRING_DEFAULT_SIZE);
+    if (!imgring) {
+        log_msg(LOG_ERROR, "can't map the display ring, reason: %s", strerror(errno));
+        exit(1);
+    }
+
     pipe(pfd);
 
     switch (dpychld = fork()) {
@@ -90,6 +146,7 @@ void do_image_display(char *img_prefix, int beep)
         default:
             close (pfd[0]);
             imgpipe_writefd  = pfd[1];
+            fcntl(imgpipe_writefd, F_SETFL, O_NONBLOCK);
             log_msg(LOG_INFO, "started display child, pid %d", (int)dpychld);
             return;
     }
@@ -102,6 +159,12 @@ gint delete_event(GtkWidget *widget, GdkEvent *event, gpointer data) {
     return FALSE;   /* do destroy window */
 }
 
+/* backing_row Y
+ * The row of the backing image shown at Y in the window. */
+static pel *backing_row(const int y) {
+    return backing_image->data[(origin + y) % backing_image->height];
+}
+
 /* make_backing_image:
  * Create the img structure which represents our back-buffer. */
 void make_backing_image() {
@@ -110,8 +173,7 @@ void make_backing_image() {
     img_alloc(I);
 
     if (backing_image) {
-        int w2, h2;
-        struct imgrect *ir;
+        int w2, h2, y;
 
         /* Copy old contents of backing image to ll corner of new one. */
         w2 = backing_image->width;
@@ -119,92 +181,87 @@ void make_backing_image() {
         h2 = backing_image->height;
         if (h2 > height) h2 = height;
 
-        img_simple_blt(I, 0, height - h2, backing_image, 0, backing_image->height - h2, w2, h2);
+        for (y = 0; y < h2; ++y)
+            memcpy(I->data[height - h2 + y], backing_row(backing_image->height - h2 + y), w2 * sizeof(pel));
 
-        /* Move all of the image rectangles. */
-        for (ir = imgrects; ir < imgrects + nimgrects; ++ir) {
-            if (ir->filename) {
-                ir->y += height - backing_image->height;
-
-                /* Possible it has scrolled off the window. */
-                if (ir->x > width || ir->y + ir->h < 0) {
-                    unlink(ir->filename);
-                    xfree(ir->filename);
-                    memset(ir, 0, sizeof *ir);
-                }
-            }
-        }
+        /* Move all of the image rectangles, which stay at the bottom; those
+         * gone off the window are reused by add_image_rectangle. */
+        scrolled -= height - backing_image->height;
 
         /* Adjust placement of new images. */
         if (wrx >= w2) wrx = w2;
 
+        cairo_surface_destroy(backing_surface);
         img_delete(backing_image);
     }
     backing_image = I;
+    backing_surface = cairo_image_surface_create_for_data((guchar*)I->flat, CAIRO_FORMAT_RGB24,
+            width, height, width * 4);
+    origin = 0;
     wrx = BORDER;
     wry = height - BORDER;
     rowheight = 2 * BORDER;
 }
 
-/* update_window:
- * Copy the backing image onto the window. */
-void update_window() {
-    if (backing_image) {
-        cairo_t *cr = gdk_cairo_create(drawable);
-
-        cairo_set_source_rgb(cr, 0.0, 0.0, 1.0);
-        cairo_rectangle(cr, 0.0, 0.0, width, height);
-        cairo_fill(cr);
-
-        cairo_surface_t *pSurface = cairo_image_surface_create_for_data(
-                (guchar*)backing_image->flat,
-                CAIRO_FORMAT_RGB24,
-                width,
-                height,
-                (width * 4));
-
-        cairo_set_source_surface(cr, pSurface, 0.0, 0.0);
+/* paint_backing_image CR
+ * Paint the backing image onto the window, in two blits as the ring wraps
+ * around: the rows from origin on at the top, and those before it below.
+ * Only the clip of CR, what is dirty, gets painted. */
+static void paint_backing_image(cairo_t *cr) {
+    int split = height - origin;
+
+    cairo_save(cr);
+    cairo_rectangle(cr, 0.0, 0.0, width, split);
+    cairo_clip(cr);
+    cairo_set_source_surface(cr, backing_surface, 0.0, -origin);
+    cairo_paint(cr);
+    cairo_restore(cr);
+
+    if (origin) {
+        cairo_save(cr);
+        cairo_rectangle(cr, 0.0, split, width, origin);
+        cairo_clip(cr);
+        cairo_set_source_surface(cr, backing_surface, 0.0, split);
         cairo_paint(cr);
-
-        cairo_destroy(cr);
+        cairo_restore(cr);
     }
 }
 
 /* scroll_backing_image:
- * Scroll the image up a bit, to make room for a new image. */
-void scroll_backing_image(const int dy) {
-    pel **row1, **row2;
-    struct imgrect *ir;
+ * Scroll the image up a bit, to make room for a new image; only the rows
+ * coming in are touched. */
+void scroll_backing_image(int dy) {
+    int y;
 
-    for (row1 = backing_image->data, row2 = backing_image->data + dy;
-         row2 < backing_image->data + height; ++row1, ++row2)
-        memcpy(*row1, *row2, width * sizeof(pel));
+    if (dy > height) dy = height;
 
-    for (row2 = row1; row2 < backing_image->data + height; ++row2)
-        memset(*row2, 0, width * sizeof(pel));
+    /* the rows scrolling off the top come in at the bottom, blank */
+    for (y = 0; y < dy; ++y)
+        memset(backing_row(y), 0, width * sizeof(pel));
 
-    for (ir = imgrects; ir < imgrects + nimgrects; ++ir) {
-        if (ir->filename) {
-            ir->y -= dy;
-
-            /* scrolled off bottom, no longer in use. */
-            if ((ir->y + ir->h) < 0) {
-                unlink(ir->filename);
-                xfree(ir->filename);
-                memset(ir, 0, sizeof *ir);
-            }
-        }
-    }
+    cairo_surface_mark_dirty(backing_surface);
+
+    origin = (origin + dy) % height;
+    scrolled += dy;
+
+    /* all of the window moves */
+    gtk_widget_queue_draw(darea);
 }
 
 /* add_image_rectangle:
  * Add a rectangle representing the location of an image to the list, so that
- * we can do hit-tests against it. */
-void add_image_rectangle(const char *filename, const int x, const int y, const int w, const int h) {
+ * we can do hit-tests against it. The rectangle takes the data of the job. */
+void add_image_rectangle(struct decode_job *job, const int x, const int y, const int w, const int h) {
     struct imgrect *ir;
     for (ir = imgrects; ir < imgrects + nimgrects; ++ir) {
-        if (!ir->filename)
+        if (!ir->data)
             break;
+
+        /* scrolled off the window, no longer in use. */
+        if (ir->y + ir->h < scrolled) {
+            xfree(ir->data);
+            break;
+        }
     }
     if (ir == imgrects + nimgrects) {
         imgrects = xrealloc(imgrects, 2 * nimgrects * sizeof *imgrects);
@@ -212,9 +269,12 @@ void add_image_rectangle(const char *filename, const int x, const int y, const i
         ir = imgrects + nimgrects;
         nimgrects *= 2;
     }
-    ir->filename = strdup(filename);
+    ir->data = job->data;
+    ir->len = job->len;
+    memcpy(ir->type, job->type, sizeof ir->type);
+    job->data = NULL;
     ir->x = x;
-    ir->y = y;
+    ir->y = y + scrolled;
     ir->w = w;
     ir->h = h;
 }
@@ -225,14 +285,15 @@ void add_image_rectangle(const char *filename, const int x, const int y, const i
 struct imgrect *find_image_rectangle(const int x, const int y) {
     struct imgrect *ir;
     for (ir = imgrects; ir < imgrects + nimgrects; ++ir)
-        if (ir->filename && x >= ir->x && x < ir->x + ir->w && y >= ir->y && y < ir->y + ir->h)
+        if (ir->data && x >= ir->x && x < ir->x + ir->w && y + scrolled >= ir->y && y + scrolled < ir->y + ir->h)
             return ir;
     return NULL;
 }
 
 /* expose_event:
- * React to an expose event, perhaps changing the backing image size. */
-void expose_event(GtkWidget *widget, GdkEvent *event, gpointer data) {
+ * React to an expose event, perhaps changing the backing image size, by
+ * painting the part of the window which is dirty. */
+gboolean expose_event(GtkWidget *widget, cairo_t *cr, gpointer data) {
 
     if (darea) drawable = gtk_widget_get_window (darea);
     width = gdk_window_get_width(drawable);
@@ -241,12 +302,18 @@ void expose_event(GtkWidget *widget, GdkEvent *event, gpointer data) {
     if (!backing_image || backing_image->width != width || backing_image->height != height)
         make_backing_image();
 
-    update_window();
+    paint_backing_image(cr);
+
+    /* the images which came before the window was up */
+    take_images();
+
+    return FALSE;
 }
 
 /* configure_event:
- * React to a configure event, perhaps changing the backing image size. */
-void configure_event(GtkWidget *widget, GdkEvent *event, gpointer data) {
+ * React to a configure event, perhaps changing the backing image size; the
+ * window is painted on the expose event which follows. */
+gboolean configure_event(GtkWidget *widget, GdkEvent *event, gpointer data) {
     if (darea) drawable = gtk_widget_get_window (darea);
     width = gdk_window_get_width(drawable);
     height = gdk_window_get_height(drawable);
@@ -254,7 +321,7 @@ void configure_event(GtkWidget *widget, GdkEvent *event, gpointer data) {
     if (!backing_image || backing_image->width != width || backing_image->height != height)
         make_backing_image();
 
-    update_window();
+    return FALSE;
 }
 
 /* save_image:
@@ -262,47 +329,38 @@ void configure_event(GtkWidget *widget, GdkEvent *event, gpointer data) {
 void save_image(struct imgrect *ir) {
     static char *name;
     static int num;
-    int fd1, fd2;
-    char buf[8192];
+    int fd;
+    const unsigned char *p;
     ssize_t l;
     struct stat st;
 
     if (!name)
-        name = xcalloc(strlen(savedimg_prefix) + 16, 1);
+        name = xcalloc(strlen(savedimg_prefix) + 24, 1);
 
     do
-        sprintf(name, "%s%d%s", savedimg_prefix, num++, strrchr(ir->filename, '.'));
+        sprintf(name, "%s%d.%s", savedimg_prefix, num++, ir->type);
     while (stat(name, &st) == 0);
-    log_msg(LOG_INFO, "saving `%s' as `%s'", ir->filename, name);
-
-    fd1 = open(ir->filename, O_RDONLY);
-    if (fd1 == -1) {
-        log_msg(LOG_ERROR, "%s: %s", ir->filename, strerror(errno));
-        return;
-    }
+    log_msg(LOG_INFO, "saving %s image as `%s'", ir->type, name);
 
-    fd2 = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (fd2 == -1) {
+    fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
         log_msg(LOG_ERROR, "%s: %s", name, strerror(errno));
-        close(fd1);
         return;
     }
 
-    /* XXX interrupts */
-    while ((l = read(fd1, buf, sizeof buf)) > 0) {
-        if (write(fd2, buf, l) == -1) {
+    for (p = ir->data; p < ir->data + ir->len; p += l) {
+        l = write(fd, p, ir->data + ir->len - p);
+        if (l == -1) {
+            if (errno == EINTR) {
+                l = 0;
+                continue;
+            }
             log_msg(LOG_ERROR, "%s: %s", name, strerror(errno));
-            close(fd1);
-            close(fd2);
-            return;
+            break;
         }
     }
 
-    if (l == -1)
-        log_msg(LOG_ERROR, "%s: %s", ir->filename, strerror(errno));
-
-    close(fd1);
-    close(fd2);
+    close(fd);
 }
 
 static struct {
@@ -321,10 +379,11 @@ void button_release_event(GtkWidget *widget, GdkEventButton *event) {
         /* We draw a little frame around the image while we're saving it, to
          * give some visual feedback. */
         cairo_t *cr = gdk_cairo_create(drawable);
+        int y = ir->y - scrolled;
 
         cairo_set_line_width (cr, 1.0);
         cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-        cairo_rectangle(cr, ir->x, ir->y, ir->w+3, ir->h + 3);
+        cairo_rectangle(cr, ir->x, y, ir->w+3, ir->h + 3);
         cairo_stroke(cr);
 
         gdk_flush();    /* force X to actually draw the damn thing. */
@@ -333,7 +392,7 @@ void button_release_event(GtkWidget *widget, GdkEventButton *event) {
 
         cairo_set_line_width (cr, 1.0);
         cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
-        cairo_rectangle(cr, ir->x, ir->y, ir->w+3, ir->h + 3);
+        cairo_rectangle(cr, ir->x, y, ir->w+3, ir->h + 3);
         cairo_stroke(cr);
 
         cairo_destroy(cr);
@@ -344,94 +403,159 @@ void destroy(GtkWidget *widget, gpointer data) {
     gtk_main_quit();
 }
 
-/* xread:
- * Like read(2) but read the whole supplied length. */
-static ssize_t xread(int fd, void *buf, size_t len) {
-    char *p;
-    for (p = (char*)buf; p < (char*)buf + len; ) {
-        ssize_t l;
-        l = read(fd, p, (char*)buf + len - p);
-        if (l == -1 && errno != EINTR)
-            return -1;
-        else if (l == 0)
-            return 0;
-        else
-            p += l;
+/* decode_image JOB
+ * Decode the image of JOB scaled down to the room in the window; run
+ * by the threads of the pool, which hand the job back to the main loop. */
+static void decode_image(gpointer data, gpointer user_data) {
+    struct decode_job *job = data;
+    char suffix[16];
+    img i;
+
+    snprintf(suffix, sizeof suffix, ".%s", job->type);
+
+    /* Check to see whether this looks like an image we're interested in. */
+    i = img_new();
+    if (!img_load_buffer(i, job->data, job->len, header, img_type_by_suffix(suffix)))
+        log_msg(LOG_WARNING, "%s image: bogus image (err = %d)", job->type, i->err);
+    else if (i->width <= 8 || i->height <= 8)
+        log_msg(LOG_WARNING, "%s image: dimensions (%d x %d) too small to bother with", job->type, i->width, i->height);
+    /* the loaders decode it straight to the room in the window */
+    else if (!img_load_fit(i, i->type, job->maxw, job->maxh))
+        log_msg(LOG_WARNING, "%s image: bogus image (err = %d)", job->type, i->err);
+    else {
+        job->image = i;
+        i = NULL;
     }
-    return len;
+
+    if (i)
+        img_delete(i);
+
+    g_async_queue_push(decoded, job);
+
+    /* one wake-up for as many jobs as done meanwhile */
+    if (g_atomic_int_compare_and_exchange(&decoded_idle, 0, 1))
+        g_idle_add(decoded_event, NULL);
 }
 
-gboolean pipe_event(GIOChannel chan, GIOCondition cond, gpointer data) {
-    static char *path;
-    char name[TMPNAMELEN];
-    ssize_t rr;
-    int nimgs = 0;
+/* free_job JOB
+ * Free JOB, and what is left in it. */
+static void free_job(struct decode_job *job) {
+    if (job->image)
+        img_delete(job->image);
+    xfree(job->data);
+    xfree(job);
+}
+
+/* show_image JOB
+ * Slot the decoded image of JOB in the backing image. */
+static void show_image(struct decode_job *job) {
+    img i = job->image;
+    int w, h, y;
 
-    if (!path)
-        path = xmalloc(strlen(get_tmpdir()) + TMPNAMELEN);
+    /* the window may have shrunk since the image was scaled */
+    if (i->width > width - 2 * BORDER) w = width - 2 * BORDER;
+    else w = i->width;
+    if (i->height > height - 2 * BORDER) h = height - 2 * BORDER;
+    else h = i->height;
+
+    if (w <= 0 || h <= 0)
+        return;
+
+    /* is there space on this row? */
+    if (width - wrx < w) {
+        /* no */
+        scroll_backing_image(h + BORDER);
+        wrx = BORDER;
+        rowheight = h + BORDER;
+    }
+    if (rowheight < h + BORDER) {
+        scroll_backing_image(h + BORDER - rowheight);
+        rowheight = h + BORDER;
+    }
+
+    /* the rows of the window may wrap around the ring */
+    for (y = 0; y < h; ++y)
+        memcpy(backing_row(wry - h + y) + wrx, i->data[y], w * sizeof(pel));
+    cairo_surface_mark_dirty(backing_surface);
+    gtk_widget_queue_draw_area(darea, wrx, wry - h, w, h);
+
+    add_image_rectangle(job, wrx, wry - h, w, h);
+
+    if (beep_on_image)
+        write(1, "\a", 1);
+
+    wrx += w + BORDER;
+}
 
-    /* We are sent messages of size TMPNAMELEN containing a null-terminated
-     * file name. */
-    while (nimgs < 4 && (rr = xread(imgpipe_readfd, name, sizeof name)) == sizeof name) {
-        int saveimg = 0;
-        struct stat st;
+/* take_images:
+ * Hand the images waiting in the ring to the decoding threads, as long as
+ * not too many are pending; the rest wait in the ring, so a burst is held
+ * back there rather than here. */
+static void take_images(void) {
+    struct decode_job *job;
+    shmrec_t rec;
 
-        ++nimgs;
+    /* no room to scale them to before the window is up */
+    if (!backing_image)
+        return;
 
-        sprintf(path, "%s/%s", get_tmpdir(), name);
+    while (pending < DECODE_MAX_PENDING && shmring_peek(imgring, &rec)) {
+        log_msg(LOG_INFO, "received %s image of size %d", rec.type, (int)rec.len);
 
-        if (stat(path, &st) == -1)
+        /* Small images are probably bollocks. */
+        if (rec.len <= 100) {
+            log_msg(LOG_WARNING, "image data too small (%d bytes) to bother with", (int)rec.len);
+            shmring_consume(imgring, &rec);
             continue;
+        }
 
-        log_msg(LOG_INFO, "received image %s of size %d", name, (int)st.st_size);
-        /* Check to see whether this looks like an image we're interested in. */
-        if (st.st_size > 100) {
-            /* Small images are probably bollocks. */
-            img i = img_new();
-            if (!img_load_file(i, path, header, unknown))
-                log_msg(LOG_WARNING, "%s: bogus image (err = %d)", name, i->err);
-            else {
-                if (i->width > 8 && i->height > 8) {
-                    if (img_load(i, full, i->type)) {
-                        /* slot in the new image at some plausible place. */
-                        int w, h;
-                        if (i->width > width - 2 * BORDER) w = width - 2 * BORDER;
-                        else w = i->width;
-                        if (i->height > height - 2 * BORDER) h = height - 2 * BORDER;
-                        else h = i->height;
-
-                        /* is there space on this row? */
-                        if (width - wrx < w) {
-                            /* no */
-                            scroll_backing_image(h + BORDER);
-                            wrx = BORDER;
-                            rowheight = h + BORDER;
-                        }
-                        if (rowheight < h + BORDER) {
-                            scroll_backing_image(h + BORDER - rowheight);
-                            rowheight = h + BORDER;
-                        }
-
-                        img_simple_blt(backing_image, wrx, wry - h, i, 0, 0, w, h);
-                        add_image_rectangle(path, wrx, wry - h, w, h);
-                        saveimg = 1;
-
-                        if (beep_on_image)
-                            write(1, "\a", 1);
-
-                        update_window();
-
-                        wrx += w + BORDER;
-                    } else log_msg(LOG_WARNING, "%s: bogus image (err = %d)", name, i->err);
-                } else log_msg(LOG_WARNING, "%s: image dimensions (%d x %d) too small to bother with", name, i->width, i->height);
-            }
+        /* copied out of the ring, to be kept for saving once shown */
+        alloc_struct(decode_job, job);
+        job->data = xmalloc(rec.len);
+        memcpy(job->data, rec.data, rec.len);
+        job->len = rec.len;
+        memcpy(job->type, rec.type, sizeof job->type);
+        job->maxw = width - 2 * BORDER > 1 ? width - 2 * BORDER : 1;
+        job->maxh = height - 2 * BORDER > 1 ? height - 2 * BORDER : 1;
 
-            img_delete(i);
-        } else log_msg(LOG_WARNING, "image data too small (%d bytes) to bother with", (int)st.st_size);
+        shmring_consume(imgring, &rec);
 
-        if (!saveimg)
-            unlink(name);
+        ++pending;
+        g_thread_pool_push(decode_pool, job, NULL);
     }
+}
+
+/* decoded_event:
+ * Show the images decoded so far, all in one update of the window, and take
+ * more from the ring. */
+static gboolean decoded_event(gpointer data) {
+    struct decode_job *job;
+
+    g_atomic_int_set(&decoded_idle, 0);
+
+    while ((job = g_async_queue_try_pop(decoded))) {
+        --pending;
+
+        /* only what they cover is painted, once the batch is done */
+        if (job->image && backing_image)
+            show_image(job);
+
+        free_job(job);
+    }
+
+    take_images();
+
+    return FALSE;
+}
+
+gboolean pipe_event(GIOChannel chan, GIOCondition cond, gpointer data) {
+    char buf[256];
+    ssize_t rr;
+
+    /* The pipe only carries wake-ups; the images are in the ring. */
+    while ((rr = read(imgpipe_readfd, buf, sizeof buf)) > 0)
+        ;
+
     if (rr == -1 && errno != EINTR && errno != EAGAIN) {
         log_msg(LOG_ERROR, "display pipe read() failed, reason: %s", strerror(errno));
         gtk_main_quit();
@@ -439,6 +563,9 @@ gboolean pipe_event(GIOChannel chan, GIOCondition cond, gpointer data) {
     } else if (rr == 0) {
         /* pipe closed, exit. */
         gtk_main_quit();
+
+    } else {
+        take_images();
     }
     return TRUE;
 }
@@ -447,6 +574,7 @@ static void do_gtkdisplay(void)
 {
     GIOChannel *chan;
     struct imgrect *ir;
+    struct decode_job *job;
 
     /* have our main loop poll the pipe file descriptor */
     chan = g_io_channel_unix_new(imgpipe_readfd);
@@ -456,6 +584,10 @@ static void do_gtkdisplay(void)
     /* set up list of image rectangles. */
     imgrects = xcalloc(nimgrects = 16, sizeof *imgrects);
 
+    /* a decoding thread per processor */
+    decoded = g_async_queue_new();
+    decode_pool = g_thread_pool_new(decode_image, NULL, g_get_num_processors(), FALSE, NULL);
+
     /* do some init thing */
     gtk_init(0, NULL);
 
@@ -472,7 +604,7 @@ static void do_gtkdisplay(void)
 
     g_signal_connect(G_OBJECT(darea), "draw", G_CALLBACK(expose_event), NULL);
 
-    g_signal_connect(G_OBJECT(darea), "configure_event", G_CALLBACK(expose_event), NULL);
+    g_signal_connect(G_OBJECT(darea), "configure_event", G_CALLBACK(configure_event), NULL);
 
     /* mouse button press/release for saving images */
     g_signal_connect(G_OBJECT(darea), "button_press_event", G_CALLBACK(button_press_event), NULL);
@@ -482,11 +614,18 @@ static void do_gtkdisplay(void)
 
     gtk_main();
 
-    /* Get rid of all remaining images. */
+    /* Get rid of all remaining images, once the threads are done with them. */
+    g_thread_pool_free(decode_pool, FALSE, TRUE);
+    while ((job = g_async_queue_try_pop(decoded)))
+        free_job(job);
+    g_async_queue_unref(decoded);
+
     for (ir = imgrects; ir < imgrects + nimgrects; ++ir)
-        if (ir->filename)
-            unlink(ir->filename);
+        if (ir->data)
+            xfree(ir->data);
 
+    if (backing_surface)
+        cairo_surface_destroy(backing_surface);
     img_delete(backing_image);
 
     return; /* NOTREACHED */
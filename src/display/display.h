@@ -17,8 +17,16 @@
     #include <config.h>
 #endif
 
+#include <stddef.h>
+
+#include "media/media.h" /* for mediameta_t */
+
 void do_image_display(char *img_prefix, int beep);
 
-void display_send_img(const char *name, size_t len);
+/*
+ * Copies an image into the ring shared with the display child; FALSE if there
+ * is no room for it.
+ */
+int display_send_img(const char *type, const unsigned char *data, size_t len, const mediameta_t *meta);
 
 #endif /* __DISPLAY_H__ */
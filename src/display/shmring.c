@@ -0,0 +1,178 @@
+/**
+ * @file shmring.c
+ *
+ * @brief Ring of images shared with the display child process.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 17:05:12 +0200
+ *
+ * The ring is an anonymous shared mapping made before forking the display
+ * child, so the images are copied once by the capture process and decoded in
+ * place by the child. There is a single consumer; the producer threads are
+ * serialized with a mutex private to the capture process.
+ *
+ * Records never wrap around the end of the ring, so their data is always
+ * contiguous: when there is no room left at the end, a wrap mark is written
+ * and the record goes at the start.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+#include "common/util.h"
+
+#include "shmring.h"
+
+#ifndef MAP_ANONYMOUS
+    #define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Header of a record, followed by its data. */
+struct rechdr {
+    uint32_t len;
+    uint32_t has_meta;
+    char type[8];
+    mediameta_t meta;
+};
+
+#define RECHDR_LEN  sizeof(struct rechdr)
+
+/* len of the mark telling the consumer to go on at the start of the ring */
+#define WRAP_MARK   UINT32_MAX
+
+/* records are kept aligned to 8 bytes */
+#define ALIGN(n)    (((n) + 7) & ~(size_t)7)
+
+/* The shared part. head and tail are byte counts that only grow: head is
+ * moved by the producer, tail by the consumer. */
+struct shmring_shared {
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    uint64_t size;
+    unsigned char data[];
+};
+
+struct shmring {
+    struct shmring_shared *shm;
+    pthread_mutex_t put_mutex;
+};
+
+shmring_t *shmring_new(size_t size)
+{
+    shmring_t *ring;
+    void *p;
+
+    size = ALIGN(size);
+
+    p = mmap(NULL, sizeof(struct shmring_shared) + size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    alloc_struct(shmring, ring);
+    ring->shm = p;
+    ring->shm->size = size;
+    atomic_init(&ring->shm->head, 0);
+    atomic_init(&ring->shm->tail, 0);
+    pthread_mutex_init(&ring->put_mutex, NULL);
+
+    return ring;
+}
+
+int shmring_put(shmring_t *ring, const char *type, const unsigned char *data, size_t len,
+        const mediameta_t *meta)
+{
+    struct shmring_shared *shm = ring->shm;
+    size_t need = ALIGN(RECHDR_LEN + len);
+    uint64_t head, tail, off, room;
+    struct rechdr *hdr;
+
+    if (need > shm->size)
+        return FALSE;
+
+    pthread_mutex_lock(&ring->put_mutex);
+
+    head = atomic_load_explicit(&shm->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&shm->tail, memory_order_acquire);
+
+    off = head % shm->size;
+    room = shm->size - off;
+
+    /* skip what is left at the end if the record doesn't fit there */
+    if (room < need) {
+        if (head + room + need - tail > shm->size) {
+            pthread_mutex_unlock(&ring->put_mutex);
+            return FALSE;
+        }
+
+        if (room >= RECHDR_LEN)
+            ((struct rechdr*)(shm->data + off))->len = WRAP_MARK;
+        head += room;
+        off = 0;
+
+    } else if (head + need - tail > shm->size) {
+        pthread_mutex_unlock(&ring->put_mutex);
+        return FALSE;
+    }
+
+    hdr = (struct rechdr*)(shm->data + off);
+    hdr->len = len;
+    snprintf(hdr->type, sizeof hdr->type, "%s", type);
+    if ((hdr->has_meta = meta != NULL))
+        hdr->meta = *meta;
+    memcpy(shm->data + off + RECHDR_LEN, data, len);
+
+    atomic_store_explicit(&shm->head, head + need, memory_order_release);
+
+    pthread_mutex_unlock(&ring->put_mutex);
+
+    return TRUE;
+}
+
+int shmring_peek(shmring_t *ring, shmrec_t *rec)
+{
+    struct shmring_shared *shm = ring->shm;
+    uint64_t tail = atomic_load_explicit(&shm->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&shm->head, memory_order_acquire);
+
+    while (tail != head) {
+        uint64_t off = tail % shm->size;
+        uint64_t room = shm->size - off;
+        struct rechdr *hdr = (struct rechdr*)(shm->data + off);
+
+        if (room < RECHDR_LEN || hdr->len == WRAP_MARK) {
+            tail += room;
+            atomic_store_explicit(&shm->tail, tail, memory_order_release);
+            continue;
+        }
+
+        memcpy(rec->type, hdr->type, sizeof rec->type);
+        rec->type[sizeof rec->type - 1] = '\0';
+        if ((rec->has_meta = hdr->has_meta))
+            rec->meta = hdr->meta;
+        rec->data = shm->data + off + RECHDR_LEN;
+        rec->len = hdr->len;
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+void shmring_consume(shmring_t *ring, const shmrec_t *rec)
+{
+    struct shmring_shared *shm = ring->shm;
+    uint64_t tail = atomic_load_explicit(&shm->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&shm->tail, tail + ALIGN(RECHDR_LEN + rec->len), memory_order_release);
+}
@@ -0,0 +1,89 @@
+/**
+ * @file shmring.h
+ *
+ * @brief Ring of images shared with the display child process.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 17:05:12 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __SHMRING_H__
+#define __SHMRING_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "media/media.h" /* for mediameta_t */
+
+/**
+ * @brief Default size of the data of the ring.
+ */
+#define SHMRING_DEFAULT_SIZE    (32 * 1024 * 1024)
+
+typedef struct shmring shmring_t;
+
+/**
+ * @brief An image of the ring, as seen by the consumer.
+ *
+ * The data points into the shared memory, and stays valid until the record is
+ * consumed with shmring_consume().
+ */
+typedef struct {
+    /** Media name: gif, jpeg ... (null terminated) */
+    char type[8];
+
+    /** Where and when it was captured, if has_meta */
+    int has_meta;
+    mediameta_t meta;
+
+    const unsigned char *data;
+    size_t len;
+} shmrec_t;
+
+/**
+ * @brief Maps a new ring, shared with the processes forked afterwards.
+ *
+ * @param size bytes for the records
+ * @return the ring, or NULL on error
+ */
+shmring_t *shmring_new(size_t size);
+
+/**
+ * @brief Copies an image into the ring. Can be called from several threads of
+ * the producer process.
+ *
+ * @param ring the ring
+ * @param type media name
+ * @param data image data
+ * @param len size of data
+ * @param meta where and when it was captured, or NULL
+ * @return TRUE on success, FALSE if there is no room for it
+ */
+int shmring_put(shmring_t *ring, const char *type, const unsigned char *data, size_t len,
+        const mediameta_t *meta);
+
+/**
+ * @brief Gets the oldest image of the ring, without taking it out.
+ *
+ * @param ring the ring
+ * @param rec where to store the image
+ * @return TRUE if there is one, FALSE if the ring is empty
+ */
+int shmring_peek(shmring_t *ring, shmrec_t *rec);
+
+/**
+ * @brief Takes the image got with shmring_peek() out of the ring, making its
+ * room available to the producer.
+ *
+ * @param ring the ring
+ * @param rec the image
+ */
+void shmring_consume(shmring_t *ring, const shmrec_t *rec);
+
+#endif /* __SHMRING_H__ */
@@ -23,11 +23,18 @@
 #include "common/log.h"
 #include "options.h"
 #include "common/tmpdir.h"
+#include "common/memstore.h"
 #include "pid.h"
 #include "network/network.h"
 #include "playaudio.h"
 #include "uid.h"
 #include "media_dispatcher.h"
+#include "media/http_decoder.h"
+#include "media/dedup.h"
+#include "media/outqueue.h"
+#include "media/segarchive.h"
+#include "media/adjout.h"
+#include "media/feedsrv.h"
 #ifndef NO_DISPLAY_WINDOW
     #include "display.h"
 #endif
@@ -162,14 +169,24 @@ int main(int argc, char *argv[])
     /*
      * If a directory name has not been specified, then we need to create one.
      * Otherwise, check that it's a directory into which we may write files.
+     * In memory only mode, nothing is written to disk: the images are kept in
+     * the memory store.
      */
-    if (options->tmpdir) {
+    if (options->enable_http_display && !options->adjunct) {
+        log_msg(LOG_INFO, "keeping up to %zu bytes of images in memory", options->mem_max);
+        memstore_init(options->mem_max);
+    }
+
+    if (options->memory_only) {
+        /* nothing written to disk */
+
+    } else if (options->tmpdir) {
         log_msg(LOG_INFO, "setting custom tmpdir in: %s", options->tmpdir);
         if (check_dir_is_rw(options->tmpdir) == FALSE) {
             log_msg(LOG_ERROR, "we can't write to the temporary directory");
             exit(1);
         }
-        set_tmpdir(options->tmpdir, TMPDIR_USER_OWNED, options->max_tmpfiles, options->adjunct);
+        set_tmpdir(options->tmpdir, TMPDIR_USER_OWNED, options->max_tmpfiles, options->max_tmpbytes, options->adjunct);
 
     } else {
         /* need to make a temporary directory. */
@@ -179,7 +196,7 @@ int main(int argc, char *argv[])
             log_msg(LOG_ERROR, "can't make a new temporary directory");
             exit(1);
         }
-        set_tmpdir(tmp_dir, TMPDIR_APP_OWNED, options->max_tmpfiles, options->adjunct);
+        set_tmpdir(tmp_dir, TMPDIR_APP_OWNED, options->max_tmpfiles, options->max_tmpbytes, options->adjunct);
     }
 
     setup_signals();
@@ -197,7 +214,8 @@ int main(int argc, char *argv[])
 
 #ifndef NO_HTTP_DISPLAY
     if (options->enable_http_display && !options->adjunct) {
-        init_http_display(get_tmpdir(), options->http_server_port);
+        init_http_display(options->memory_only ? NULL : get_tmpdir(), options->http_server_port,
+                options->memory_only);
     }
 #endif
     if (options->adjunct) {
@@ -213,13 +231,20 @@ int main(int argc, char *argv[])
 
         mediadrv_t* driver = drivers->list[i];
 
+        if (options->archive_dir) {
+            driver->dispatch_data = driver->type == MEDIATYPE_IMAGE
+                    ? dispatch_image_to_archive : dispatch_media_to_archive;
+            continue;
+        }
+
         switch (driver->type) {
             case MEDIATYPE_IMAGE:
                 /*
                  * XXX: options->enable_http_display, options->enable_gtk_display
                  */
                 if (options->adjunct) {
-                    driver->dispatch_data = dispatch_image_to_stdout;
+                    driver->dispatch_data = options->adjunct_format != ADJOUT_LINES
+                            ? dispatch_image_to_adjout : dispatch_image_to_stdout;
 
                 } else {
 #if !defined(NO_DISPLAY_WINDOW) && !defined(NO_HTTP_DISPLAY)
@@ -227,12 +252,14 @@ int main(int argc, char *argv[])
                         driver->dispatch_data = dispatch_image_to_display;
 
                     } else {
-                        driver->dispatch_data = dispatch_image_to_httpdisplay;
+                        driver->dispatch_data = options->memory_only
+                                ? dispatch_image_to_httpdisplay_memory : dispatch_image_to_httpdisplay;
                     }
 #elif !defined(NO_DISPLAY_WINDOW)
                     driver->dispatch_data = dispatch_image_to_display;
 #elif !defined(NO_HTTP_DISPLAY)
-                    driver->dispatch_data = dispatch_image_to_httpdisplay;
+                    driver->dispatch_data = options->memory_only
+                            ? dispatch_image_to_httpdisplay_memory : dispatch_image_to_httpdisplay;
 #else
                     log_msg(
                             LOG_ERROR,
@@ -248,7 +275,8 @@ int main(int argc, char *argv[])
 
             case MEDIATYPE_TEXT:
                 if (options->adjunct) {
-                    driver->dispatch_data = dispatch_text_to_stdout;
+                    driver->dispatch_data = options->adjunct_format != ADJOUT_LINES
+                            ? dispatch_text_to_adjout : dispatch_text_to_stdout;
 
                 } else {
 #if !defined(NO_DISPLAY_WINDOW) && !defined(NO_HTTP_DISPLAY)
@@ -270,11 +298,85 @@ int main(int argc, char *argv[])
         }
     }
 
+    /*
+     * The local feed goes in front of the other outputs
+     */
+    if (options->feed_socket) {
+        if (!feedsrv_start(options->feed_socket, options->feed_buffer, options->feed_policy))
+            return -1;
+
+        for (int i = 0; i < drivers->count; ++i)
+            dispatch_add_feed(drivers->list[i]);
+    }
+
+    /* A flow_max of 0 disables decoding of HTTP bodies */
+    http_decoder_set_limits(options->decode_http ? options->decode_flow_max : 0,
+            options->decode_mem_max, options->decode_cpu_max);
+
+    dispatch_set_image_filter(options->img_min_size, options->img_max_size,
+            options->img_min_dim, options->img_max_dim);
+    dispatch_set_ws_binary(options->ws_binary);
+    dispatch_set_thumbnails(options->thumb_size);
+
+    if (options->dedup) {
+        size_t window = dedup_init(options->dedup_window, options->dedup_mem_max);
+
+        if (window < options->dedup_window)
+            log_msg(LOG_WARNING, "deduplication window limited to %zu images by --dedup-mem-max", window);
+        dispatch_set_dedup_events(options->dedup_events);
+    }
+
+    if (options->archive_dir && !segarchive_open(options->archive_dir, options->segment_max))
+        return -1;
+
+    if (options->adjunct_format != ADJOUT_LINES) {
+        /* keep standard output for the frames */
+        if (!options->adjunct_socket)
+            set_log_info_stdout(FALSE);
+
+        if (!adjout_open(options->adjunct_format, options->adjunct_socket, options->adjunct_inline,
+                    options->flush_ms))
+            return -1;
+    }
+
+    tmpfile_set_writer(options->io_uring, options->durable);
+    tmpdir_set_fanout(options->fanout);
+
+    /* the archive records stand on their own, so all of them are written
+     * off the capture thread */
+    outqueue_queue_all(options->archive_dir != NULL);
+    if (!outqueue_start(options->out_threads, options->out_queue_max, options->out_policy))
+        return -1;
+
     network_start(drivers);
 
     while (!foad)
         sleep(1);
 
+    /* stop the capture first, so nothing more is queued; then write out
+     * what we still have queued */
+    /*    pcap_freecode(pc, &filter);*/ /* not on some systems... */
+    network_close();
+    outqueue_stop();
+
+    if (options->feed_socket) {
+        feedsrv_stats_t stats;
+
+        feedsrv_stop();
+        feedsrv_get_stats(&stats);
+        log_msg(LOG_INFO, "feed: %lu subscribers, %lu frames queued, %lu dropped",
+                stats.clients, stats.frames, stats.dropped);
+    }
+
+    if (options->adjunct_format != ADJOUT_LINES) {
+        adjout_stats_t stats;
+
+        adjout_close();
+        adjout_get_stats(&stats);
+        log_msg(LOG_INFO, "adjunct output: %lu frames, %llu bytes in %lu writes",
+                stats.frames, stats.bytes, stats.flushes);
+    }
+
     if (options->verbose || options->debug)
         print_exit_reason();
 
@@ -286,9 +388,47 @@ int main(int argc, char *argv[])
 
     stop_mpeg_player();
 
-    /* Clean up. */
-    /*    pcap_freecode(pc, &filter);*/ /* not on some systems... */
-    network_close();
+    if (options->out_threads > 0) {
+        outqueue_stats_t stats;
+
+        outqueue_get_stats(&stats);
+        log_msg(LOG_INFO, "output queue: %lu images queued, %lu dropped, %zu bytes at peak",
+                stats.queued, stats.dropped, stats.peak_bytes);
+    }
+
+    if (options->verbose || options->debug) {
+        tmpfiles_stats_t stats;
+        int i;
+
+        tmpfiles_get_stats(&stats);
+        for (i = 0; i < TMPFILE_NTYPES; ++i)
+            if (stats.types[i].files)
+                log_msg(LOG_INFO, "temporary directory: %lu %s files, %zu bytes",
+                        stats.types[i].files, stats.types[i].ext, stats.types[i].bytes);
+        if (options->max_tmpfiles || options->max_tmpbytes)
+            log_msg(LOG_INFO, "temporary directory: %lu files evicted, %lu too big",
+                    stats.evicted, stats.refused);
+    }
+
+    if (options->archive_dir)
+        segarchive_close();
+
+    if (options->enable_http_display && !options->adjunct) {
+        memstore_stats_t stats;
+
+        memstore_get_stats(&stats);
+        log_msg(LOG_INFO, "memory store: %lu images evicted, %zu bytes at peak",
+                stats.evicted, stats.peak_bytes);
+        memstore_close();
+    }
+
+    if (options->dedup) {
+        unsigned long unique, duplicates;
+
+        dedup_get_stats(&unique, &duplicates);
+        log_msg(LOG_INFO, "%lu unique images, %lu duplicates dropped", unique, duplicates);
+        dedup_close();
+    }
 
     close_media_drivers(drivers);
 
@@ -0,0 +1,272 @@
+/*
+ * extract.c
+ *
+ * driftnet-extract: lists and extracts the media of the segment archives
+ * written by driftnet --archive.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "compat/compat.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h> /* On many systems (Darwin...), stdio.h is a prerequisite. */
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/log.h"
+#include "common/util.h"
+#include "media/segarchive.h"
+
+/* What we are asked for. */
+static struct {
+    long long since, until;
+    const char *host;
+    const char *type;
+    const char *outdir;
+} want = { 0, 0, NULL, NULL, NULL };
+
+static void usage(void)
+{
+    fprintf(stderr,
+"driftnet-extract, version %s\n"
+"Lists, or extracts, the media archived by driftnet --archive.\n"
+"\n"
+"Synopsis: driftnet-extract [options] segment...\n"
+"\n"
+"Options:\n"
+"\n"
+"  -h               Display this help message.\n"
+"  -s time          Only media captured at or after time (seconds since the epoch).\n"
+"  -u time          Only media captured before time (seconds since the epoch).\n"
+"  -H host          Only media from or to this address.\n"
+"  -t type          Only media of this type (gif, jpeg, png ...).\n"
+"  -o directory     Write the media found to directory, named after their\n"
+"                   hash, instead of listing them.\n"
+"\n"
+"The index of each segment (the segment path plus " SEGARCHIVE_INDEX_EXT ") is used\n"
+"when present; otherwise the segment itself is walked.\n"
+"\n", DRIFTNET_VERSION);
+}
+
+/* host_matches REC
+ * Is the host we want at either end of the flow of REC ? */
+static int host_matches(const segrec_t *rec)
+{
+    char addr[64];
+    int end;
+
+    for (end = 0; end < 2; ++end) {
+        char *p;
+
+        segrec_addr(rec, end, addr, sizeof addr);
+
+        /* drop the port, and the brackets of IPv6 addresses */
+        if ((p = strrchr(addr, ':')))
+            *p = '\0';
+        p = addr;
+        if (*p == '[') {
+            ++p;
+            p[strlen(p) - 1] = '\0';
+        }
+
+        if (strcmp(p, want.host) == 0)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static int rec_wanted(const segrec_t *rec)
+{
+    if (want.since && rec->ts_sec < want.since)
+        return FALSE;
+
+    if (want.until && rec->ts_sec >= want.until)
+        return FALSE;
+
+    if (want.type && strcmp(rec->type, want.type) != 0)
+        return FALSE;
+
+    if (want.host && !host_matches(rec))
+        return FALSE;
+
+    return TRUE;
+}
+
+static void list_rec(const char *segment, const segrec_t *rec)
+{
+    char src[64], dst[64], when[32];
+    time_t t = rec->ts_sec;
+    struct tm tm;
+
+    strftime(when, sizeof when, "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+
+    printf("%s %llu %llu %s.%06u %s %s -> %s %016llx",
+            segment, (unsigned long long)rec->offset, (unsigned long long)rec->len,
+            when, (unsigned int)rec->ts_usec, rec->type,
+            segrec_addr(rec, FALSE, src, sizeof src), segrec_addr(rec, TRUE, dst, sizeof dst),
+            (unsigned long long)rec->hash);
+
+    if (rec->width)
+        printf(" %ux%u", (unsigned int)rec->width, (unsigned int)rec->height);
+
+    printf("\n");
+}
+
+/* extract_rec SEGMENT_FILE REC
+ * Copies the data of REC to the output directory. */
+static int extract_rec(FILE *seg, const segrec_t *rec)
+{
+    char name[64];
+    char *path;
+    unsigned char buf[65536];
+    uint64_t left = rec->len;
+    FILE *out;
+    int ok = TRUE;
+
+    if (fseeko(seg, rec->offset, SEEK_SET) != 0)
+        return FALSE;
+
+    snprintf(name, sizeof name, "%016llx.%s", (unsigned long long)rec->hash, rec->type);
+    path = compose_path(want.outdir, name);
+
+    if (!(out = fopen(path, "wb"))) {
+        log_msg(LOG_ERROR, "%s: %s", path, strerror(errno));
+        xfree(path);
+        return FALSE;
+    }
+
+    while (left > 0 && ok) {
+        size_t n = left < sizeof buf ? left : sizeof buf;
+
+        if (fread(buf, 1, n, seg) != n || fwrite(buf, 1, n, out) != n)
+            ok = FALSE;
+        left -= n;
+    }
+
+    if (fclose(out) != 0)
+        ok = FALSE;
+
+    if (!ok) {
+        log_msg(LOG_ERROR, "%s: short record", path);
+        unlink(path);
+    } else {
+        printf("%s\n", path);
+    }
+
+    xfree(path);
+
+    return ok;
+}
+
+static int handle_rec(const char *segment, FILE *seg, const segrec_t *rec)
+{
+    if (!rec_wanted(rec))
+        return TRUE;
+
+    if (want.outdir)
+        return extract_rec(seg, rec);
+
+    list_rec(segment, rec);
+
+    return TRUE;
+}
+
+/* process_segment SEGMENT
+ * Goes through the records of SEGMENT, by its index if there is one. */
+static int process_segment(const char *segment)
+{
+    char *index;
+    FILE *seg, *idx;
+    segrec_t rec;
+    int r = 0, ok = TRUE, indexed;
+
+    if (!(seg = segarchive_open_file(segment, FALSE))) {
+        log_msg(LOG_ERROR, "%s: can't read it", segment);
+        return FALSE;
+    }
+
+    index = xmalloc(strlen(segment) + strlen(SEGARCHIVE_INDEX_EXT) + 1);
+    sprintf(index, "%s"SEGARCHIVE_INDEX_EXT, segment);
+    idx = segarchive_open_file(index, TRUE);
+    indexed = idx != NULL;
+
+    if (indexed) {
+        while (ok && (r = segrec_read(idx, &rec)) > 0)
+            ok = handle_rec(segment, seg, &rec);
+
+        fclose(idx);
+
+    } else {
+        /* no index (maybe driftnet was killed): walk the segment */
+        while (ok && (r = segrec_read(seg, &rec)) > 0) {
+            long long next = rec.offset + rec.len;
+
+            ok = handle_rec(segment, seg, &rec);
+            if (fseeko(seg, next, SEEK_SET) != 0)
+                r = -1;
+        }
+    }
+
+    if (ok && r < 0)
+        log_msg(LOG_WARNING, "%s: truncated or corrupt, stopped there", indexed ? index : segment);
+
+    xfree(index);
+    fclose(seg);
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int c, i, ok = TRUE;
+
+    while ((c = getopt(argc, argv, "hs:u:H:t:o:")) != -1) {
+        switch (c) {
+            case 's':
+                want.since = atoll(optarg);
+                break;
+
+            case 'u':
+                want.until = atoll(optarg);
+                break;
+
+            case 'H':
+                want.host = optarg;
+                break;
+
+            case 't':
+                want.type = optarg;
+                break;
+
+            case 'o':
+                want.outdir = optarg;
+                break;
+
+            case 'h':
+            default:
+                usage();
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
+        return 1;
+    }
+
+    for (i = optind; i < argc; ++i)
+        if (!process_segment(argv[i]))
+            ok = FALSE;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file history.c
+ *
+ * @brief Index of the messages sent to the browsers, for the late comers.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 21:12:37 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/util.h"
+#include "history.h"
+
+struct history_entry {
+    msginfo_t info;
+    char *json;
+    size_t len;
+};
+
+/*
+ * A ring of the newest messages: as they are numbered in a row, message seq
+ * is at seq % size while held, so a cursor is found without searching.
+ */
+static struct history_entry *entries;
+static unsigned int size;
+static uint64_t first = 1, next = 1;
+
+void history_init(unsigned int max)
+{
+    size = max ? max : 1;
+    entries = xcalloc(size, sizeof *entries);
+    first = next = 1;
+}
+
+void history_free(void)
+{
+    for (; first < next; ++first)
+        xfree(entries[first % size].json);
+
+    xfree(entries);
+    entries = NULL;
+}
+
+uint64_t history_next(void)
+{
+    return next;
+}
+
+void history_add(uint64_t seq, const msginfo_t *info, const char *json, size_t len)
+{
+    struct history_entry *e;
+
+    if (!entries || seq != next)
+        return;
+
+    e = &entries[seq % size];
+
+    if (next - first == size) {
+        xfree(e->json);
+        ++first;
+    }
+
+    e->info = *info;
+    e->json = xmalloc(len);
+    memcpy(e->json, json, len);
+    e->len = len;
+
+    ++next;
+}
+
+unsigned char *history_page(uint64_t cursor, unsigned int limit, const subfilter_t *filter,
+        size_t headroom, size_t *len)
+{
+    char *buf = NULL;
+    size_t buflen = 0;
+    uint64_t seq, last = next - 1;
+    unsigned int n = 0;
+    FILE *fp;
+
+    if (!(fp = open_memstream(&buf, &buflen)))
+        return NULL;
+
+    fprintf(fp, "%*s{\"first\":%llu,\"last\":%llu,\"items\":[", (int)headroom, "",
+            (unsigned long long)first, (unsigned long long)last);
+
+    /* the messages dropped are skipped */
+    seq = cursor < first ? first : cursor + 1;
+
+    for (; seq < next && n < limit; ++seq) {
+        const struct history_entry *e = &entries[seq % size];
+
+        if (!subfilter_match(filter, e->info.mname, e->info.len, e->info.width, e->info.height,
+                    e->info.has_meta ? &e->info.meta : NULL))
+            continue;
+
+        if (n++)
+            fputc(',', fp);
+        fwrite(e->json, 1, e->len, fp);
+    }
+
+    /* where the next page starts, the newest message once all are seen */
+    fprintf(fp, "],\"next\":%llu}", (unsigned long long)(seq - 1 > cursor ? seq - 1 : cursor));
+
+    /* buf is only complete once closed */
+    if (fclose(fp) != 0) {
+        free(buf);
+        return NULL;
+    }
+
+    *len = buflen - headroom;
+
+    return (unsigned char *)buf;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file history.h
+ *
+ * @brief Index of the messages sent to the browsers, for the late comers.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 21:12:37 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <media/media.h>
+#include <media/subfilter.h>
+
+/**
+ * @brief What a message is about, for the filters of the browsers.
+ */
+typedef struct {
+    char mname[8];              /* media name: gif, jpeg ... HTTP */
+    size_t len;                 /* size of the object */
+    int width, height;          /* of an image, 0 if unknown */
+    int has_meta;
+    mediameta_t meta;           /* where it was captured, if has_meta */
+} msginfo_t;
+
+/**
+ * @brief Sets up the index.
+ *
+ * The messages are numbered from 1 in the order they are sent, and only the
+ * newest max are kept. The index is not thread safe: it is only used from the
+ * server thread.
+ *
+ * @param max messages kept
+ */
+void history_init(unsigned int max);
+
+/**
+ * @brief Releases the index.
+ */
+void history_free(void);
+
+/**
+ * @brief Numbers a message.
+ *
+ * @return the sequence number for the next message added
+ */
+uint64_t history_next(void);
+
+/**
+ * @brief Adds a message, the oldest one being dropped if full.
+ *
+ * @param seq its number, from history_next()
+ * @param info what it is about
+ * @param json the message (copied)
+ * @param len its length
+ */
+void history_add(uint64_t seq, const msginfo_t *info, const char *json, size_t len);
+
+/**
+ * @brief Makes a page of the history, in JSON:
+ * {"first": 1, "last": 9, "items": [ messages ], "next": 4}
+ *
+ * first and last are the numbers of the oldest and newest messages held
+ * (first is past last when there are none), items the messages after cursor
+ * matching the filter, oldest first, up to limit, and next the cursor of the
+ * page after, which is last once done.
+ *
+ * @param cursor number of the last message seen (0 for all)
+ * @param limit max messages in the page
+ * @param filter messages wanted (sampling is not applied)
+ * @param headroom bytes left before the page
+ * @param len where to put the length of the page, headroom apart
+ * @return the page, to free(), or NULL on errors
+ */
+unsigned char *history_page(uint64_t cursor, unsigned int limit, const subfilter_t *filter,
+        size_t headroom, size_t *len);
+
+#endif /* __HISTORY_H__ */
@@ -12,13 +12,20 @@
 #include <libwebsockets.h>
 #include <string.h>
 #include <signal.h>
+#include <time.h>
 #include <compat/compat.h>
 #include <media/media.h>
+#include <media/subfilter.h>
 
 #include "web_data.h"
+#include "httpd.h"
+#include "history.h"
 #include "common/log.h"
 #include "common/util.h"
 #include "common/tmpdir.h"
+#include "common/memstore.h"
+#include "common/mpscq.h"
+#include "common/metrics.h"
 
 /*
  * Tests if we have a modern libwebsockets library (>= 3.0.0). Prior versions didn't include
@@ -49,63 +56,107 @@ if (*___ppss == ___target) { \
  	                } lws_end_foreach_llp(___ppss, ___m_list); \
  	       }
 
-/*
- * This is a helper that combines the common pattern of needing to consume
- * some ringbuffer elements, move the consumer tail on, and check if that
- * has moved any ringbuffer elements out of scope, because it was the last
- * consumer that had not already consumed them.
- *
- * Elements that go out of scope because the oldest tail is now after them
- * get garbage-collected by calling the destroy_element callback on them
- * defined when the ringbuffer was created.
- */
-
-#define lws_ring_consume_and_update_oldest_tail(\
- 	               ___ring,    /* the lws_ring object */ \
- 	               ___type,    /* type of objects with tails */ \
- 	               ___ptail,   /* ptr to tail of obj with tail doing consuming
- 	*/ \
- 	               ___count,   /* count of payload objects being consumed */ \
- 	               ___list_head,   /* head of list of objects with tails */ \
- 	               ___mtail,   /* member name of tail in ___type */ \
- 	               ___mlist  /* member name of next list member ptr in ___type
- 	*/ \
- 	       ) { \
- 	               int ___n, ___m; \
- 	       \
- 	       ___n = lws_ring_get_oldest_tail(___ring) == *(___ptail); \
- 	       lws_ring_consume(___ring, ___ptail, NULL, ___count); \
- 	       if (___n) { \
- 	               uint32_t ___oldest; \
- 	               ___n = 0; \
- 	               ___oldest = *(___ptail); \
- 	               lws_start_foreach_llp(___type **, ___ppss, ___list_head) { \
- 	                       ___m = lws_ring_get_count_waiting_elements( \
- 	                                       ___ring, &(*___ppss)->tail); \
- 	                       if (___m >= ___n) { \
- 	                               ___n = ___m; \
- 	                               ___oldest = (*___ppss)->tail; \
- 	                       } \
- 	               } lws_end_foreach_llp(___ppss, ___mlist); \
- 	       \
- 	               lws_ring_update_oldest_tail(___ring, ___oldest); \
- 	       } \
- 	}
 #endif /* lws_ll_fwd_insert */
 
 int server_port;
 int interrupted = 0;
 pthread_t server_thread;
 
+/* Are the media only in the memory store, and not in the tmpdir ? */
+static int serve_from_memory = FALSE;
+
+/* Where the files not in the memory store are served from. */
+static const char *files_root;
+
+/* Chunk of an object written each time the connection is writable. */
+#define MEMSTORE_CHUNK  65536
+
+/* The media names are never reused, so the browsers can keep them. */
+#define MEDIA_CACHE_CONTROL "public, max-age=31536000, immutable"
+
+/* The objects are written from the memory store, with lws framing in the headroom */
+_Static_assert(LWS_PRE <= MEMSTORE_HEADROOM, "not enough headroom in the memory store");
+
+/* Bytes waiting to be sent to a browser before its oldest messages are dropped. */
+#define WS_CLIENT_MAX_BYTES     (4 * 1024 * 1024)
+
+/* Largest frame of coalesced text events. */
+#define WS_COALESCE_MAX         16384
+
+/* Largest subscription message of a browser. */
+#define WS_SUBSCRIPTION_MAX     1024
+
+/* Messages kept for /api/history, and messages in a page of it by default and at most. */
+#define HISTORY_MAX             4096
+#define HISTORY_PAGE            100
+#define HISTORY_PAGE_MAX        1000
+
+/*
+ * Room in a message for the sequence number and the time the server stamps
+ * it with, before the json, and for the length of the header of an image.
+ */
+#define MSG_STAMP_ROOM          64
+#define MSG_HEAD                (LWS_PRE + MSG_STAMP_ROOM + 2)
+
+/*
+ * A message for the browsers. It is shared by the queues of all the sessions
+ * and freed by the last one done with it.
+ */
 struct msg {
-    void *payload;
-    size_t len;
+    mpscq_node_t node;
+    int refs;
+    mediatype_t type;
+    int binary;                         /* an image, with its header */
+
+    /* what the sessions filter on */
+    msginfo_t info;
+
+    size_t start, len;                  /* where the frame is in the payload */
+    size_t jlen;                        /* length of the json */
+    unsigned char payload[];            /* MSG_HEAD bytes, then the json (and the image) */
+};
+
+/*
+ * ws_send_media is called from the capture and writer threads, but lws is
+ * only touched from the server thread: the messages go through a queue and
+ * the server is woken up (once for as many messages as queued meanwhile) to
+ * hand them to the sessions.
+ */
+static mpscq_t send_queue;
+static atomic_int wakeup_pending;
+static struct lws_context *_Atomic server_context;
+
+/* Sessions opened so far, to tell them apart in the metrics. */
+static unsigned long sessions;
+
+struct send_entry {
+    struct send_entry *next;
+    struct msg *msg;
 };
 
 struct per_session_data {
     struct per_session_data *pss_list;
     struct lws *wsi;
-    uint32_t tail;
+    unsigned long id;                   /* for the metrics */
+
+    /* messages not sent yet, oldest first */
+    struct send_entry *head, *last;
+    size_t queued;
+
+    unsigned long sent, dropped;
+
+    /* what the browser wants, and its subscription being received */
+    subfilter_t filter;
+    char rx[WS_SUBSCRIPTION_MAX];
+    size_t rxlen;
+};
+
+/* A response served from memory: an object of the memory store, or a page (of the history or the metrics). */
+struct per_http_session {
+    memobj_t *obj;
+    unsigned char *page;
+    const unsigned char *data;          /* with LWS_PRE bytes before it we can use */
+    size_t len, sent;
 };
 
 struct per_vhost_data {
@@ -113,12 +164,13 @@ struct per_vhost_data {
     struct lws_vhost *vhost;
     const struct lws_protocols *protocol;
     struct per_session_data *pss_list;      /* linked-list of live pss */
-    struct lws_ring *ring;                  /* ringbuffer holding unsent messages */
 };
 
 int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
                      void *user, void *in, size_t len);
-static void destroy_message(void *_msg);
+static int media_callback(struct lws *wsi, enum lws_callback_reasons reason,
+                     void *user, void *in, size_t len);
+static const char *media_mimetype(const char *name);
 
 static struct lws_protocols protocols[] = {
         { "http", lws_callback_http_dummy, 0, 0 },
@@ -128,11 +180,15 @@ static struct lws_protocols protocols[] = {
            sizeof(struct per_session_data),
               128,
         },
+        {
+          "media-http",
+          media_callback,
+          sizeof(struct per_http_session),
+          0,
+        },
         { NULL, NULL, 0, 0 }
 };
 
-struct per_vhost_data *vhost_data;          /* our vhost */
-
 void write_static_resources()
 {
     int idx = 0;
@@ -171,19 +227,18 @@ static void * http_server_dispatch(void *arg)
     struct lws_context_creation_info info;
     struct lws_context *context;
 
-    static const struct lws_protocol_vhost_options mime_types[] = {
-       { &mime_types[1], NULL, ".jpeg", "image/jpeg" },
-       { NULL, NULL, ".webp", "image/webp" }
-    };
-
-   const struct lws_http_mount mount = {
+    /*
+     * Everything is served by media_callback: the media from the memory
+     * store, and the rest (or the media evicted from memory) from server_root.
+     */
+    const struct lws_http_mount mount = {
         (struct lws_http_mount *)NULL,	/* linked-list pointer to next*/
         "/",		                    /* mountpoint in URL namespace on this vhost */
-        server_root,                    /* where to go on the filesystem for that */
-        "index.html",	                /* default filename if none given */
+        "media-http",                   /* protocol serving it */
+        NULL,
+        NULL,
         NULL,
         NULL,
-        mime_types,
         NULL,
         0,
         0,
@@ -191,7 +246,7 @@ static void * http_server_dispatch(void *arg)
         0,
         0,
         0,
-        LWSMPRO_FILE,	                /* mount type is a directory in a filesystem */
+        LWSMPRO_CALLBACK,	            /* mount type is served by a protocol callback */
         1,		                        /* strlen("/"), ie length of the mountpoint */
         NULL,
 #if LWS_LIBRARY_VERSION_MAJOR <= 4 && LWS_LIBRARY_VERSION_MINOR < 3
@@ -199,6 +254,10 @@ static void * http_server_dispatch(void *arg)
 #endif
     };
 
+    files_root = server_root;
+
+    history_init(HISTORY_MAX);
+
     memset(&info, 0, sizeof info);
 
     info.port = server_port;
@@ -215,74 +274,324 @@ static void * http_server_dispatch(void *arg)
         return NULL;
     }
 
+    atomic_store(&server_context, context);
+
+    /* in case something was queued before */
+    lws_cancel_service(context);
+
     log_msg(LOG_WARNING, "http server initializated. go to http://localhost:%d", server_port);
 
     while (n >= 0 && !interrupted) {
         n = lws_service(context, 1000);
     }
 
+    atomic_store(&server_context, NULL);
     lws_context_destroy(context);
 
+    history_free();
+
     return NULL;
 }
 
 /*
  * Json to sent:
  * {
+ *      "seq": 1,
+ *      "time": 1792436400,
  *      "type": [1,2,3],
  *      "content": "media content"
  * }
+ * All the messages start with the sequence number and the time they were
+ * sent at (see stamp_msg), which the server thread adds.
  */
 char* json_template = "{\"type\":%d,\"content\":\"%s\"}";
 
-void ws_send_media(const char* text, mediatype_t type)
+/* queue_msg MSG INFO
+ * Hands MSG, about the object of INFO, to the server thread. */
+static void queue_msg(struct msg *msg, const ws_mediainfo_t *info)
+{
+    struct lws_context *context;
+
+    msg->refs = 0;
+    msg->start = MSG_HEAD;
+
+    memset(&msg->info, 0, sizeof msg->info);
+
+    if (info) {
+        snprintf(msg->info.mname, sizeof msg->info.mname, "%s", info->mname);
+        msg->info.len = info->len;
+        msg->info.width = info->width;
+        msg->info.height = info->height;
+        if ((msg->info.has_meta = info->meta != NULL))
+            msg->info.meta = *info->meta;
+    }
+
+    mpscq_push(&send_queue, &msg->node);
+
+    /* the server drains the whole queue when woken up, one wakeup is enough */
+    if (!atomic_exchange(&wakeup_pending, 1) && (context = atomic_load(&server_context)))
+        lws_cancel_service(context);
+}
+
+void ws_send_media(const char* text, mediatype_t type, const ws_mediainfo_t *info)
+{
+    struct msg *msg;
+    size_t max_json_len = strlen(text) + 30;
+
+    msg = malloc(sizeof *msg + MSG_HEAD + max_json_len);
+    if (!msg) {
+        log_msg(LOG_WARNING, "httpd: dropping msg");
+        return;
+    }
+
+    snprintf((char *)msg->payload + MSG_HEAD, max_json_len, json_template, type, text);
+    msg->len = msg->jlen = strlen((char *)msg->payload + MSG_HEAD);
+    msg->type = type;
+    msg->binary = FALSE;
+
+    queue_msg(msg, info);
+}
+
+/*
+ * An image with a thumbnail:
+ * {
+ *      "type": 1,
+ *      "content": "name",
+ *      "thumb": "thumbnail name"
+ * }
+ */
+char* thumb_json_template = "{\"type\":%d,\"content\":\"%s\",\"thumb\":\"%s\"}";
+
+void ws_send_thumb(const char* name, const char *thumb, const ws_mediainfo_t *info)
 {
-    struct msg amsg;
-    size_t text_len = strlen(text);
-    size_t max_json_len = text_len + 30;
-    char* json_data = malloc(max_json_len);
+    struct msg *msg;
+    size_t max_json_len = strlen(name) + strlen(thumb) + 40;
 
-    if (!json_data) {
-        log_msg(LOG_WARNING, "httpd: unable to allocate memory for json");
+    msg = malloc(sizeof *msg + MSG_HEAD + max_json_len);
+    if (!msg) {
+        log_msg(LOG_WARNING, "httpd: dropping msg");
         return;
     }
 
-    snprintf(json_data, max_json_len, json_template, type, text);
+    snprintf((char *)msg->payload + MSG_HEAD, max_json_len, thumb_json_template, MEDIATYPE_IMAGE, name, thumb);
+    msg->len = msg->jlen = strlen((char *)msg->payload + MSG_HEAD);
+    msg->type = MEDIATYPE_IMAGE;
+    msg->binary = FALSE;
 
-    size_t json_len = strlen(json_data);
+    queue_msg(msg, info);
+}
 
-    amsg.len = json_len;
-    amsg.payload = malloc(LWS_PRE + json_len);
+/*
+ * Binary frame of an image: the length of the header (16 bits, little
+ * endian), the header, a json like the text messages plus the content type
+ * and whether a thumbnail (always a JPEG) is sent instead of the image:
+ * {
+ *      "type": 1,
+ *      "content": "name",
+ *      "mime": "image/jpeg",
+ *      "thumb": false
+ * }
+ * and the image.
+ */
+char* image_header_template = "{\"type\":%d,\"content\":\"%s\",\"mime\":\"%s\",\"thumb\":%s}";
 
-    if (!amsg.payload) {
-        free(json_data);
+void ws_send_image(const char* name, const unsigned char *data, size_t len, int thumb,
+        const ws_mediainfo_t *info)
+{
+    struct msg *msg;
+    const char *mime = thumb ? "image/jpeg" : media_mimetype(name);
+    size_t max_hdr_len = strlen(name) + strlen(mime) + 60;
+    unsigned char *p;
+    int n;
+
+    /* one copy, straight into the frame, after the room lws and the stamp need before it */
+    msg = malloc(sizeof *msg + MSG_HEAD + max_hdr_len + len);
+    if (!msg) {
         log_msg(LOG_WARNING, "httpd: dropping msg");
         return;
     }
 
-    memcpy((char *)amsg.payload + LWS_PRE, json_data, json_len);
+    p = msg->payload + MSG_HEAD;
+    n = snprintf((char *)p, max_hdr_len, image_header_template, MEDIATYPE_IMAGE, name, mime,
+            thumb ? "true" : "false");
+    memcpy(p + n, data, len);
+
+    /* the length of the header goes before it once stamped */
+    msg->jlen = n;
+    msg->len = n + len;
+    msg->type = MEDIATYPE_IMAGE;
+    msg->binary = TRUE;
+
+    queue_msg(msg, info);
+}
+
+/* stamp_msg MSG
+ * Numbers MSG and adds it to the history. Its json gets the number and the
+ * time in front, in the room left for them, and the frame starts earlier. */
+static void stamp_msg(struct msg *msg)
+{
+    char stamp[MSG_STAMP_ROOM];
+    unsigned char *json;
+    uint64_t seq = history_next();
+    int n;
+
+    n = snprintf(stamp, sizeof stamp, "{\"seq\":%llu,\"time\":%lld,",
+            (unsigned long long)seq, (long long)time(NULL));
+
+    /* the stamp opens the object, in place of its '{' */
+    json = msg->payload + MSG_HEAD + 1 - n;
+    memcpy(json, stamp, n);
+    msg->jlen += n - 1;
+    msg->len += n - 1;
+    msg->start = json - msg->payload;
+
+    history_add(seq, &msg->info, (const char *)json, msg->jlen);
+
+    if (msg->binary) {
+        msg->start -= 2;
+        msg->payload[msg->start] = msg->jlen & 0xff;
+        msg->payload[msg->start + 1] = msg->jlen >> 8;
+        msg->len += 2;
+    }
+}
+
+/* msg_unref MSG
+ * Drops a reference to MSG, freeing it with the last one. */
+static void msg_unref(struct msg *msg)
+{
+    if (--msg->refs <= 0)
+        free(msg);
+}
+
+/* session_pop PSS
+ * Takes the oldest message queued to PSS, which keeps its reference. */
+static struct msg *session_pop(struct per_session_data *pss)
+{
+    struct send_entry *e = pss->head;
+    struct msg *msg = e->msg;
+
+    if (!(pss->head = e->next))
+        pss->last = NULL;
+    pss->queued -= msg->len;
+    free(e);
+
+    return msg;
+}
+
+/* session_push PSS MSG
+ * Queues MSG to PSS, dropping its oldest messages if over the limit. */
+static void session_push(struct per_session_data *pss, struct msg *msg)
+{
+    struct send_entry *e;
+
+    /* a slow browser only loses its own messages */
+    while (pss->head && pss->queued + msg->len > WS_CLIENT_MAX_BYTES) {
+        msg_unref(session_pop(pss));
 
-    if (!lws_ring_insert(vhost_data->ring, &amsg, 1)) {
-        destroy_message(&amsg);
-        free(json_data);
-        log_msg(LOG_WARNING, "httpd: can't insert msg into ring buffer");
+        if (pss->dropped++ == 0)
+            log_msg(LOG_WARNING, "httpd: a browser is too slow, dropping its oldest messages");
+    }
+
+    if (!(e = malloc(sizeof *e))) {
+        ++pss->dropped;
         return;
     }
 
-    lws_start_foreach_llp(struct per_session_data **, ppss, vhost_data->pss_list) {
-        lws_callback_on_writable((*ppss)->wsi);
-    } lws_end_foreach_llp(ppss, pss_list);
+    e->next = NULL;
+    e->msg = msg;
+    ++msg->refs;
 
-    free(json_data);
+    if (pss->last)
+        pss->last->next = e;
+    else
+        pss->head = e;
+    pss->last = e;
+    pss->queued += msg->len;
 }
 
-static void destroy_message(void *_msg)
+/* drain_send_queue VHD
+ * Hands the queued messages to the sessions of VHD, or frees them if VHD is
+ * NULL. Only called from the server thread. */
+static void drain_send_queue(struct per_vhost_data *vhd)
 {
-    struct msg *msg = _msg;
+    mpscq_node_t *node;
+
+    /* messages queued from now on need another wakeup */
+    atomic_store(&wakeup_pending, 0);
+
+    while ((node = mpscq_pop(&send_queue))) {
+        struct msg *msg = (struct msg *)node;
+
+        /* held while being queued, so it isn't freed by a drop meanwhile */
+        msg->refs = 1;
+
+        if (vhd) {
+            /* numbered as handed to the sessions, so a browser sees them in order */
+            stamp_msg(msg);
+
+            lws_start_foreach_llp(struct per_session_data **, ppss, vhd->pss_list) {
+                struct per_session_data *pss = *ppss;
+
+                /* filtered before queueing, so a browser only pays for what it wants */
+                if (subfilter_match(&pss->filter, msg->info.mname, msg->info.len, msg->info.width,
+                            msg->info.height, msg->info.has_meta ? &msg->info.meta : NULL)
+                        && subfilter_sample(&pss->filter))
+                    session_push(pss, msg);
+            } lws_end_foreach_llp(ppss, pss_list);
+        }
+
+        msg_unref(msg);
+    }
+
+    if (!vhd)
+        return;
+
+    lws_start_foreach_llp(struct per_session_data **, ppss, vhd->pss_list) {
+        if ((*ppss)->head)
+            lws_callback_on_writable((*ppss)->wsi);
+    } lws_end_foreach_llp(ppss, pss_list);
+}
+
+/* session_write PSS
+ * Writes the oldest message of PSS; text events in a row are sent together,
+ * as a JSON array. Returns FALSE if the connection failed. */
+static int session_write(struct per_session_data *pss)
+{
+    static unsigned char frame[LWS_PRE + WS_COALESCE_MAX];
+    unsigned char *p = frame + LWS_PRE;
+    struct msg *msg = session_pop(pss);
+    size_t len;
+    int ok;
+
+    if (msg->type != MEDIATYPE_TEXT || !pss->head || pss->head->msg->type != MEDIATYPE_TEXT
+            || msg->len + pss->head->msg->len + 3 > WS_COALESCE_MAX) {
+        /* notice we allowed for LWS_PRE in the payload already */
+        ok = lws_write(pss->wsi, msg->payload + msg->start, msg->len,
+                msg->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT) >= (int)msg->len;
+        msg_unref(msg);
+        ++pss->sent;
+        return ok;
+    }
+
+    *p++ = '[';
+    for (;;) {
+        memcpy(p, msg->payload + msg->start, msg->len);
+        p += msg->len;
+        msg_unref(msg);
+        ++pss->sent;
+
+        if (!pss->head || pss->head->msg->type != MEDIATYPE_TEXT
+                || (size_t)(p - frame - LWS_PRE) + pss->head->msg->len + 2 > WS_COALESCE_MAX)
+            break;
+
+        *p++ = ',';
+        msg = session_pop(pss);
+    }
+    *p++ = ']';
+
+    len = p - frame - LWS_PRE;
 
-    free(msg->payload);
-    msg->payload = NULL;
-    msg->len = 0;
+    return lws_write(pss->wsi, frame + LWS_PRE, len, LWS_WRITE_TEXT) >= (int)len;
 }
 
 int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
@@ -294,8 +603,7 @@ int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
             (struct per_vhost_data *)
                     lws_protocol_vh_priv_get(lws_get_vhost(wsi),
                                              lws_get_protocol(wsi));
-    const struct msg *pmsg;
-    int m;
+    char peer[64];
 
     switch (reason) {
         case LWS_CALLBACK_PROTOCOL_INIT:
@@ -305,73 +613,405 @@ int ws_callback(struct lws *wsi, enum lws_callback_reasons reason,
             vhd->context = lws_get_context(wsi);
             vhd->protocol = lws_get_protocol(wsi);
             vhd->vhost = lws_get_vhost(wsi);
-
-            vhd->ring = lws_ring_create(sizeof(struct msg), 250,
-                                        destroy_message);
-            if (!vhd->ring) {
-                log_msg(LOG_ERROR, "httpd: can't create message buffer");
-                abort();
-                return 1;
-            }
-            vhost_data = vhd;
             break;
 
         case LWS_CALLBACK_PROTOCOL_DESTROY:
-            lws_ring_destroy(vhd->ring);
+            drain_send_queue(NULL);
+            break;
+
+        case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+            /* woken up by ws_send_media */
+            if (vhd)
+                drain_send_queue(vhd);
             break;
 
         case LWS_CALLBACK_ESTABLISHED:
+            memset(pss, 0, sizeof *pss);
             lws_ll_fwd_insert(pss, pss_list, vhd->pss_list);
-            pss->tail = lws_ring_get_oldest_tail(vhd->ring);
             pss->wsi = wsi;
+            pss->id = ++sessions;
+            break;
+
+        case LWS_CALLBACK_RECEIVE:
+            /* a subscription, in json (see subfilter_parse_json), maybe in fragments */
+            if (pss->rxlen + len > sizeof pss->rx) {
+                pss->rxlen = sizeof pss->rx + 1;
+            } else {
+                memcpy(pss->rx + pss->rxlen, in, len);
+                pss->rxlen += len;
+            }
+
+            if (!lws_is_final_fragment(wsi))
+                break;
+
+            if (pss->rxlen > sizeof pss->rx || !subfilter_parse_json(&pss->filter, pss->rx, pss->rxlen)) {
+                lws_get_peer_simple(wsi, peer, sizeof peer);
+                log_msg(LOG_WARNING, "httpd: browser at %s: bad subscription ignored", peer);
+            }
+            pss->rxlen = 0;
             break;
 
         case LWS_CALLBACK_CLOSED:
             lws_ll_fwd_remove(struct per_session_data, pss_list,
                 pss, vhd->pss_list);
+
+            while (pss->head)
+                msg_unref(session_pop(pss));
+
+            if (pss->dropped) {
+                lws_get_peer_simple(wsi, peer, sizeof peer);
+                log_msg(LOG_WARNING, "httpd: browser at %s: %lu messages sent, %lu dropped",
+                        peer, pss->sent, pss->dropped);
+            }
             break;
 
         case LWS_CALLBACK_SERVER_WRITEABLE:
-            pmsg = lws_ring_get_element(vhd->ring, &pss->tail);
-            if (!pmsg) {
+            if (!pss->head)
                 break;
+
+            if (!session_write(pss)) {
+                log_msg(LOG_WARNING, "httpd: can't write to ws socket");
+                return -1;
             }
 
-            /* notice we allowed for LWS_PRE in the payload already */
-            m = lws_write(wsi, pmsg->payload + LWS_PRE, pmsg->len, LWS_WRITE_TEXT);
+            if (pss->head)
+                lws_callback_on_writable(pss->wsi);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/* media_mimetype NAME
+ * Content type of a file served, from its extension. */
+static const char *media_mimetype(const char *name)
+{
+    static const char *types[][2] = {
+        { ".gif", "image/gif" }, { ".jpeg", "image/jpeg" }, { ".png", "image/png" },
+        { ".webp", "image/webp" }, { ".mp3", "audio/mpeg" },
+        { ".html", "text/html" }, { ".js", "application/javascript" }, { ".css", "text/css" },
+        { ".ico", "image/x-icon" }
+    };
+    const char *ext = strrchr(name, '.');
+    size_t i;
+
+    for (i = 0; ext && i < sizeof types / sizeof types[0]; ++i)
+        if (strcmp(ext, types[i][0]) == 0)
+            return types[i][1];
+
+    return "application/octet-stream";
+}
+
+/* is_media NAME
+ * Is NAME a carved object, rather than a page resource ? */
+static int is_media(const char *name)
+{
+    const char *type = media_mimetype(name);
+
+    return strncmp(type, "text/", 5) && strcmp(type, "application/javascript") && strcmp(type, "image/x-icon");
+}
+
+/* serve_file WSI NAME
+ * Serves NAME from the files root, once not found in the memory store. */
+static int serve_file(struct lws *wsi, const char *name)
+{
+    static const char media_headers[] = "cache-control: " MEDIA_CACHE_CONTROL "\x0d\x0a";
+    char *path;
+    int n;
+
+    if (!*name)
+        name = "index.html";
+
+    path = compose_path(files_root, name);
+
+    if (is_media(name))
+        n = lws_serve_http_file(wsi, path, media_mimetype(name), media_headers, sizeof media_headers - 1);
+    else
+        n = lws_serve_http_file(wsi, path, media_mimetype(name), NULL, 0);
+
+    xfree(path);
+
+    /* the file is sent from now on, see LWS_CALLBACK_HTTP_FILE_COMPLETION */
+    if (n < 0 || (n > 0 && lws_http_transaction_completed(wsi)))
+        return -1;
+
+    return 0;
+}
+
+/* serve_memobj WSI PHS
+ * Sends the headers of the object of PHS, or a 304 if the browser has it. */
+static int serve_memobj(struct lws *wsi, struct per_http_session *phs)
+{
+    unsigned char buf[LWS_PRE + 512];
+    unsigned char *start = &buf[LWS_PRE], *p = start, *end = &buf[sizeof buf - 1];
+    char etag[24], match[128];
+    int n;
+
+    n = snprintf(etag, sizeof etag, "\"%016llx\"", (unsigned long long)phs->obj->hash);
+
+    if (lws_hdr_copy(wsi, match, sizeof match, WSI_TOKEN_HTTP_IF_NONE_MATCH) > 0 && strstr(match, etag)) {
+        memstore_release(phs->obj);
+        phs->obj = NULL;
+
+        if (lws_add_http_header_status(wsi, HTTP_STATUS_NOT_MODIFIED, &p, end)
+                || lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_ETAG, (unsigned char *)etag, n, &p, end)
+                || lws_finalize_write_http_header(wsi, start, &p, end))
+            return 1;
+
+        return lws_http_transaction_completed(wsi) ? -1 : 0;
+    }
+
+    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, media_mimetype(phs->obj->name), phs->obj->len, &p, end)
+            || lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_ETAG, (unsigned char *)etag, n, &p, end)
+            || lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_CACHE_CONTROL,
+                    (unsigned char *)MEDIA_CACHE_CONTROL, strlen(MEDIA_CACHE_CONTROL), &p, end)
+            || lws_finalize_write_http_header(wsi, start, &p, end))
+        return 1;
+
+    phs->data = phs->obj->data;
+    phs->len = phs->obj->len;
+    phs->sent = 0;
+    lws_callback_on_writable(wsi);
+
+    return 0;
+}
+
+/* serve_page WSI PHS TYPE
+ * Sends the headers of the page of PHS, made for this request, of content TYPE. */
+static int serve_page(struct lws *wsi, struct per_http_session *phs, const char *type)
+{
+    unsigned char buf[LWS_PRE + 512];
+    unsigned char *start = &buf[LWS_PRE], *p = start, *end = &buf[sizeof buf - 1];
+
+    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, type, phs->len, &p, end)
+            || lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_CACHE_CONTROL,
+                    (unsigned char *)"no-store", 8, &p, end)
+            || lws_finalize_write_http_header(wsi, start, &p, end))
+        return 1;
+
+    phs->data = phs->page + LWS_PRE;
+    phs->sent = 0;
+    lws_callback_on_writable(wsi);
 
-            if (m < (int)pmsg->len) {
-                log_msg(LOG_WARNING, "httpd: can't write to ws socket\n", m);
+    return 0;
+}
+
+/* serve_history WSI PHS
+ * Sends the headers of a page of the history, for the arguments of the URL:
+ * cursor, limit and the fields of a subscription (see subfilter_set). */
+static int serve_history(struct lws *wsi, struct per_http_session *phs)
+{
+    static const char *keys[] = { "type", "min-size", "min-dim", "host" };
+    char arg[128], name[16];
+    const char *v;
+    unsigned long long cursor = 0;
+    unsigned long limit = HISTORY_PAGE;
+    subfilter_t filter;
+    size_t i;
+
+    memset(&filter, 0, sizeof filter);
+
+    if ((v = lws_get_urlarg_by_name(wsi, "cursor=", arg, sizeof arg)))
+        cursor = strtoull(v, NULL, 10);
+
+    if ((v = lws_get_urlarg_by_name(wsi, "limit=", arg, sizeof arg)))
+        limit = strtoul(v, NULL, 10);
+    if (limit == 0 || limit > HISTORY_PAGE_MAX)
+        limit = HISTORY_PAGE_MAX;
+
+    for (i = 0; i < sizeof keys / sizeof keys[0]; ++i) {
+        snprintf(name, sizeof name, "%s=", keys[i]);
+
+        if ((v = lws_get_urlarg_by_name(wsi, name, arg, sizeof arg)) && !subfilter_set(&filter, keys[i], v)) {
+            if (lws_return_http_status(wsi, HTTP_STATUS_BAD_REQUEST, NULL))
                 return -1;
+            return lws_http_transaction_completed(wsi) ? -1 : 0;
+        }
+    }
+
+    if (!(phs->page = history_page(cursor, limit, &filter, LWS_PRE, &phs->len)))
+        return 1;
+
+    return serve_page(wsi, phs, "application/json");
+}
+
+/* write_ws_metrics FP VHD
+ * Writes the metrics of the browsers connected to VHD. */
+static void write_ws_metrics(FILE *fp, struct per_vhost_data *vhd)
+{
+    static const char *series[][3] = {
+        { "driftnet_ws_client_queue_bytes", "gauge", "Bytes waiting to be sent to each browser." },
+        { "driftnet_ws_client_sent_total", "counter", "Messages sent to each browser." },
+        { "driftnet_ws_client_dropped_total", "counter", "Messages dropped for each browser, too slow." }
+    };
+    char peer[64];
+    int clients = 0, i;
+
+    if (vhd) {
+        lws_start_foreach_llp(struct per_session_data **, ppss, vhd->pss_list) {
+            ++clients;
+        } lws_end_foreach_llp(ppss, pss_list);
+    }
+
+    metrics_write_value(fp, "driftnet_ws_clients", "gauge", "Browsers connected to the websocket.", clients);
+
+    for (i = 0; i < 3; ++i) {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", series[i][0], series[i][2], series[i][0], series[i][1]);
+
+        if (!vhd)
+            continue;
+
+        lws_start_foreach_llp(struct per_session_data **, ppss, vhd->pss_list) {
+            struct per_session_data *pss = *ppss;
+
+            lws_get_peer_simple(pss->wsi, peer, sizeof peer);
+            fprintf(fp, "%s{client=\"%lu\",peer=\"%s\"} %lu\n", series[i][0], pss->id, peer,
+                    i == 0 ? (unsigned long)pss->queued : i == 1 ? pss->sent : pss->dropped);
+        } lws_end_foreach_llp(ppss, pss_list);
+    }
+}
+
+/* serve_metrics WSI PHS
+ * Sends the headers of the metrics, in the Prometheus text format. */
+static int serve_metrics(struct lws *wsi, struct per_http_session *phs)
+{
+    struct lws_vhost *vhost = lws_get_vhost(wsi);
+    const struct lws_protocols *protocol = lws_vhost_name_to_protocol(vhost, "images-pipe-protocol");
+    char *buf = NULL;
+    size_t buflen = 0;
+    FILE *fp;
+
+    if (!(fp = open_memstream(&buf, &buflen)))
+        return 1;
+
+    /* room for lws before the page */
+    fprintf(fp, "%*s", LWS_PRE, "");
+
+    metrics_write(fp);
+    write_ws_metrics(fp, protocol ? lws_protocol_vh_priv_get(vhost, protocol) : NULL);
+
+    /* buf is only complete once closed */
+    if (fclose(fp) != 0) {
+        free(buf);
+        return 1;
+    }
+
+    phs->page = (unsigned char *)buf;
+    phs->len = buflen - LWS_PRE;
+
+    return serve_page(wsi, phs, "text/plain; version=0.0.4");
+}
+
+/* http_session_done PHS
+ * Releases what PHS was sending. */
+static void http_session_done(struct per_http_session *phs)
+{
+    if (phs->obj)
+        memstore_release(phs->obj);
+    free(phs->page);
+
+    phs->obj = NULL;
+    phs->page = NULL;
+    phs->data = NULL;
+}
+
+/* media_callback:
+ * Serves the media objects, from the memory store if there, or else from
+ * disk, and the history of the messages. */
+static int media_callback(struct lws *wsi, enum lws_callback_reasons reason,
+                 void *user, void *in, size_t len)
+{
+    struct per_http_session *phs = (struct per_http_session *) user;
+    unsigned char saved[LWS_PRE], *chunk;
+    const char *name = in;
+    size_t n;
+    int final, m;
+
+    switch (reason) {
+        case LWS_CALLBACK_HTTP:
+            /* in is the URL past the mountpoint */
+            while (name && *name == '/')
+                ++name;
+
+            if (!name || strstr(name, "..")) {
+                if (lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL))
+                    return -1;
+                return lws_http_transaction_completed(wsi) ? -1 : 0;
             }
 
-            lws_ring_consume_and_update_oldest_tail(
-                vhd->ring,	             /* lws_ring object */
-                struct per_session_data, /* type of objects with tails */
-                &pss->tail,	             /* tail of guy doing the consuming */
-                1,		                 /* number of payload objects being consumed */
-                vhd->pss_list,	         /* head of list of objects with tails */
-                tail,		             /* member name of tail in objects with tails */
-                pss_list	             /* member name of next object in objects with tails */
-            );
-
-            if (lws_ring_get_element(vhd->ring, &pss->tail)) {
-                lws_callback_on_writable(pss->wsi);
+            memset(phs, 0, sizeof *phs);
+
+            if (strcmp(name, "api/history") == 0)
+                return serve_history(wsi, phs);
+
+            if (strcmp(name, "metrics") == 0)
+                return serve_metrics(wsi, phs);
+
+            if ((phs->obj = memstore_get(name)))
+                return serve_memobj(wsi, phs);
+
+            return serve_file(wsi, name);
+
+        case LWS_CALLBACK_HTTP_WRITEABLE:
+            if (!phs || !phs->data)
+                break;
+
+            n = phs->len - phs->sent;
+            if (n > MEMSTORE_CHUNK)
+                n = MEMSTORE_CHUNK;
+            final = phs->sent + n == phs->len;
+
+            /*
+             * Written in place: lws may put its framing in the LWS_PRE bytes
+             * before the chunk, which are the headroom of the object (or of
+             * the page) or the end of the chunk before, kept aside meanwhile.
+             */
+            chunk = (unsigned char *)phs->data + phs->sent;
+            memcpy(saved, chunk - LWS_PRE, LWS_PRE);
+            m = lws_write(wsi, chunk, n, final ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP);
+            memcpy(chunk - LWS_PRE, saved, LWS_PRE);
+
+            if (m != (int)n)
+                return 1;
+
+            phs->sent += n;
+
+            if (!final) {
+                lws_callback_on_writable(wsi);
+                return 0;
             }
+
+            http_session_done(phs);
+
+            return lws_http_transaction_completed(wsi) ? -1 : 0;
+
+        case LWS_CALLBACK_CLOSED_HTTP:
+            if (phs)
+                http_session_done(phs);
             break;
 
         default:
             break;
     }
 
-    return 0;
+    return lws_callback_http_dummy(wsi, reason, user, in, len);
 }
 
-void init_http_display(const char* server_root, int port)
+void init_http_display(const char* server_root, int port, int from_memory)
 {
     server_port = port;
+    serve_from_memory = from_memory;
+
+    mpscq_init(&send_queue);
 
-    write_static_resources();
+    /* in memory the static resources are served from where they are */
+    if (from_memory)
+        server_root = STATIC_WEB_DIRECTORY;
+    else
+        write_static_resources();
 
     pthread_create(&server_thread, NULL, http_server_dispatch, (void*)server_root);
 }
@@ -387,5 +1027,6 @@ void stop_http_display()
     pthread_cancel(server_thread);
     pthread_join(server_thread, NULL);
 
-    delete_static_resources();
+    if (!serve_from_memory)
+        delete_static_resources();
 }
@@ -10,9 +10,37 @@
 #ifndef __HTTPD_H_
 #define __HTTPD_H_
 
-void init_http_display(const char* server_root, int port);
+/*
+ * The images are served from the memory store, or else from server_root.
+ * With from_memory, they are only in the memory store and nothing is written
+ * to server_root, which is not used.
+ */
+void init_http_display(const char* server_root, int port, int from_memory);
 void stop_http_display();
 
-void ws_send_media(const char* text, mediatype_t type);
+/*
+ * What a message is about, for the browsers to filter the messages they get
+ * (see subfilter.h).
+ */
+typedef struct {
+    const char *mname;          /* media name: gif, jpeg ... HTTP */
+    size_t len;                 /* size of the object */
+    int width, height;          /* of an image, 0 if unknown */
+    const mediameta_t *meta;    /* where it was captured, or NULL */
+} ws_mediainfo_t;
+
+void ws_send_media(const char* text, mediatype_t type, const ws_mediainfo_t *info);
+
+/*
+ * Sends the name of an image and of its thumbnail, which is shown first.
+ */
+void ws_send_thumb(const char* name, const char *thumb, const ws_mediainfo_t *info);
+
+/*
+ * Sends an image, or with thumb its JPEG thumbnail, in a binary websocket
+ * frame, so the browsers don't fetch it.
+ */
+void ws_send_image(const char* name, const unsigned char *data, size_t len, int thumb,
+        const ws_mediainfo_t *info);
 
 #endif /* __HTTPD_H_ */
@@ -0,0 +1,151 @@
+/*
+ * gif.c:
+ * GIF file support.
+ *
+ * Copyright (c) 2001 Chris Lightfoot.
+ * Email: chris@ex-parrot.com; WWW: http://www.ex-parrot.com/~chris/
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "compat/compat.h"
+
+#include <stdio.h>                      /* for fread */
+
+#include <gif_lib.h>
+
+#include "common/util.h"
+#include "img.h"
+
+/* gif_read:
+ * Read callback of giflib; reads from the stream of the image, so it works
+ * for streams without a file descriptor (images loaded from memory). */
+static int gif_read(GifFileType *g, GifByteType *buf, int len) {
+    img I = g->UserData;
+    return (int)fread(buf, 1, len, I->fp);
+}
+
+/* gif_load_hdr:
+ * Find width/height of GIF file.
+ */
+int gif_load_hdr(img I) {
+    GifFileType *g;
+
+/* GIFLIB_MAJOR is not defined until version 5 of libgif */
+#if defined GIFLIB_MAJOR && GIFLIB_MAJOR >= 5
+    g = I->us = DGifOpen(I, gif_read, NULL);
+#else
+    g = I->us = DGifOpen(I, gif_read);
+#endif
+
+    if (!I->us) {
+        I->err = IE_HDRFORMAT;
+        return 0;
+    }
+
+    I->width = g->SWidth;
+    I->height = g->SHeight;
+
+    return 1;
+}
+
+/* gif_abort_load:
+ * Abort loading a GIF file after the header is done.
+ */
+int gif_abort_load(img I) {
+#if defined GIFLIB_MAJOR && GIFLIB_MAJOR >= 5
+    DGifCloseFile((GifFileType*)I->us, NULL);
+#else
+    DGifCloseFile((GifFileType*)I->us);
+#endif
+    return 1;
+}
+
+/* gif_load_img:
+ * Load GIF image.
+ */
+int gif_load_img(img I) {
+    GifFileType *g = I->us;
+    struct SavedImage *si;
+    int ret = 0;
+    unsigned char *p, **rows = NULL;
+    GifColorType *pal;
+    pel *q, *line = NULL;
+    imgbox box = NULL;
+    unsigned int w, h;
+    int i, r;
+
+    if (DGifSlurp(g) == GIF_ERROR) {
+        I->err = IE_IMGFORMAT;
+        return 0;
+    }
+
+    /* Retrieve only the first image. */
+    if (g->ImageCount < 1) {
+        I->err = IE_IMGFORMAT;
+        goto fail;
+    }
+
+    si = g->SavedImages;
+    if (si->ImageDesc.Width != I->width || si->ImageDesc.Height != I->height) {
+        I->err = IE_IMGFORMAT;
+        goto fail;
+    }
+
+    if (si->ImageDesc.ColorMap)
+        pal = si->ImageDesc.ColorMap->Colors;
+    else
+        pal = g->SColorMap->Colors;
+
+    /* Where each row is in the raster. */
+    rows = xmalloc(I->height * sizeof *rows);
+    p = si->RasterBits;
+    if (si->ImageDesc.Interlace) {
+        /* Deal with deranged interlaced GIF file: every 8th row from row 0,
+         * every 8th from row 4, every 4th from row 2, every 2nd from row 1. */
+        static const int start[4] = { 0, 4, 2, 1 }, step[4] = { 8, 8, 4, 2 };
+        int pass;
+        for (pass = 0; pass < 4; ++pass)
+            for (i = start[pass]; i < I->height; i += step[pass], p += I->width)
+                rows[i] = p;
+    } else
+        for (i = 0; i < I->height; ++i, p += I->width)
+            rows[i] = p;
+
+    /* Now allocate memory and copy the image into it, shrinking the rows
+     * as they are copied if wanted. */
+    img_load_size(I, &w, &h);
+    if (w != I->width || h != I->height) {
+        line = xmalloc(I->width * sizeof *line);
+        I->width = w;
+        I->height = h;
+        img_alloc(I);
+        box = img_box_new(I, si->ImageDesc.Width, si->ImageDesc.Height);
+    } else
+        img_alloc(I);
+
+    for (r = 0; r < si->ImageDesc.Height; ++r) {
+        pel *row = box ? line : I->data[r];
+        for (p = rows[r], q = row; p < rows[r] + si->ImageDesc.Width; ++p, ++q)
+            *q = PELA(pal[*p].Red, pal[*p].Green, pal[*p].Blue, *p == g->SBackGroundColor ? 255 : 0);
+        if (box)
+            img_box_row(box, line);
+    }
+
+    ret = 1;
+fail:
+    xfree(rows);
+    xfree(line);
+    img_box_delete(box);
+
+#if defined GIFLIB_MAJOR && GIFLIB_MAJOR >= 5
+    DGifCloseFile(g, NULL);
+#else
+    DGifCloseFile(g);
+#endif
+
+    return ret;
+}
@@ -83,6 +83,19 @@ struct filedrv {
 
 #define NUMFILEDRVS (sizeof(filedrvs) / sizeof(struct filedrv))
 
+/* struct _imgbox:
+ * Sums of the source rows falling in the output row being made. */
+struct _imgbox {
+    img I;
+    unsigned int width, height;     /* of the source */
+    unsigned int *xmap;             /* output column of each source column */
+    unsigned int *ncols;            /* source columns in each output column */
+    unsigned long *sums;            /* r, g, b and a of each output column */
+    unsigned int y, oy, nrows;      /* next source row, its output row, rows summed */
+};
+
+static img img_resample(const img I, const unsigned int w, const unsigned int h);
+
 /* img_new:
  * Create a new empty image object. */
 img img_new(void) {
@@ -148,6 +161,21 @@ int img_load(img I, const imgstate howmuch, const imgtype type) {
                 I->load = header;
                 r = filedrvs[i].loadimg(I);
                 if (r) I->load = full;
+
+                /* what the loader couldn't shrink all the way */
+                if (r && I->max_width && (I->width > I->max_width || I->height > I->max_height)) {
+                    unsigned int w, h;
+                    img S;
+                    img_load_size(I, &w, &h);
+                    S = img_resample(I, w, h);
+                    xfree(I->data);
+                    I->data = S->data;
+                    I->flat = S->flat;
+                    I->width = w;
+                    I->height = h;
+                    S->data = NULL;
+                    img_delete(S);
+                }
                 return r;
             }
         }
@@ -163,6 +191,20 @@ int img_load_stream(img I, FILE *fp, const imgstate howmuch, const imgtype type)
     return img_load(I, howmuch, type);
 }
 
+/* img_type_by_suffix:
+ * Image type of a file suffix, such as ".jpg", or unknown. */
+imgtype img_type_by_suffix(const char *suffix) {
+    int i;
+    if (!suffix) return unknown;
+    for (i = 0; i < NUMFILEDRVS; ++i) {
+        char *q;
+        for (q = filedrvs[i].suffices; *q; q += strlen(q) + 1)
+            if (strcasecmp(suffix, q) == 0)
+                return filedrvs[i].type;
+    }
+    return unknown;
+}
+
 /* img_load_file:
  * Load an image, or part of it, from a file. */
 int img_load_file(img I, const char *name, const imgstate howmuch, const imgtype type) {
@@ -175,23 +217,130 @@ int img_load_file(img I, const char *name, const imgstate howmuch, const imgtype
 
     if (type == unknown) {
         /* Try to figure out type. */
-        char *p;
-        int i;
-        p = strrchr(name, '.');
-        for (i = 0; i < NUMFILEDRVS; ++i) {
-            char *q;
-            for (q = filedrvs[i].suffices; *q; q += strlen(q) + 1)
-                if (strcasecmp(p, q) == 0) {
-                    I->type = filedrvs[i].type;
-                    return img_load(I, howmuch, I->type);
-                }
-        }
+        I->type = img_type_by_suffix(strrchr(name, '.'));
+        if (I->type != unknown)
+            return img_load(I, howmuch, I->type);
     } else return img_load(I, howmuch, type);
 
     I->err = IE_UNKNOWNTYPE;
     return 0;
 }
 
+/* img_load_buffer:
+ * Load an image, or part of it, from memory. The buffer must stay untouched
+ * until the image is deleted. */
+int img_load_buffer(img I, const unsigned char *buf, const size_t len, const imgstate howmuch, const imgtype type) {
+    if (howmuch == none) return 1;
+    I->buf = buf;
+    I->buflen = len;
+    I->fp = fmemopen((void*)buf, len, "rb");
+    if (!I->fp) {
+        I->err = IE_SYSERROR;
+        return 0;
+    }
+    I->type = type;
+    return img_load(I, howmuch, type);
+}
+
+/* img_load_fit:
+ * Load an image, whose header is loaded already, shrunk to fit in
+ * max_width x max_height pixels. */
+int img_load_fit(img I, const imgtype type, const unsigned int max_width, const unsigned int max_height) {
+    I->max_width = max_width ? max_width : 1;
+    I->max_height = max_height ? max_height : 1;
+    return img_load(I, full, type);
+}
+
+/* img_fit_size:
+ * Shrink width x height, keeping its aspect, to fit in max_width x
+ * max_height (if bigger). */
+void img_fit_size(unsigned int *width, unsigned int *height, const unsigned int max_width, const unsigned int max_height) {
+    unsigned long w = *width, h = *height;
+    if (w <= max_width && h <= max_height) return;
+    if (w * max_height > h * max_width) {
+        h = h * max_width / w;
+        w = max_width;
+    } else {
+        w = w * max_height / h;
+        h = max_height;
+    }
+    *width = w ? w : 1;
+    *height = h ? h : 1;
+}
+
+/* img_load_size:
+ * Size a loader should decode an image of the header loaded to. */
+void img_load_size(const img I, unsigned int *width, unsigned int *height) {
+    *width = I->width;
+    *height = I->height;
+    if (I->max_width)
+        img_fit_size(width, height, I->max_width, I->max_height);
+}
+
+/* img_box_new:
+ * Start shrinking an image of width x height to I, which is allocated
+ * already with its final size; the rows are fed with img_box_row. */
+imgbox img_box_new(img I, const unsigned int width, const unsigned int height) {
+    imgbox B;
+    unsigned int x;
+    B = xcalloc(1, sizeof *B);
+    B->I = I;
+    B->width = width;
+    B->height = height;
+    B->xmap = xmalloc(width * sizeof *B->xmap);
+    B->ncols = xcalloc(I->width, sizeof *B->ncols);
+    B->sums = xcalloc(I->width * 4, sizeof *B->sums);
+    for (x = 0; x < width; ++x) {
+        B->xmap[x] = (unsigned long)x * I->width / width;
+        ++B->ncols[B->xmap[x]];
+    }
+    return B;
+}
+
+/* img_box_flush:
+ * Write out the output row summed so far. */
+static void img_box_flush(imgbox B) {
+    unsigned int x;
+    unsigned long *s, n;
+    if (!B->nrows || B->oy >= B->I->height) return;
+    for (x = 0, s = B->sums; x < B->I->width; ++x, s += 4) {
+        n = (unsigned long)B->ncols[x] * B->nrows;
+        if (n) B->I->data[B->oy][x] = PELA(s[0] / n, s[1] / n, s[2] / n, s[3] / n);
+    }
+    memset(B->sums, 0, B->I->width * 4 * sizeof *B->sums);
+    B->nrows = 0;
+}
+
+/* img_box_row:
+ * Add the next row of the source, width pixels. */
+void img_box_row(imgbox B, const pel *row) {
+    unsigned int x, oy;
+    unsigned long *s;
+    if (B->y >= B->height) return;
+    oy = (unsigned long)B->y * B->I->height / B->height;
+    if (oy != B->oy) {
+        img_box_flush(B);
+        B->oy = oy;
+    }
+    for (x = 0; x < B->width; ++x) {
+        s = B->sums + 4 * B->xmap[x];
+        s[0] += GETR(row[x]); s[1] += GETG(row[x]); s[2] += GETB(row[x]); s[3] += GETA(row[x]);
+    }
+    ++B->nrows;
+    if (++B->y == B->height) img_box_flush(B);
+}
+
+/* img_box_delete:
+ * Done shrinking. */
+void img_box_delete(imgbox B) {
+    if (!B) return;
+    img_box_flush(B);
+    xfree(B->xmap);
+    xfree(B->ncols);
+    xfree(B->sums);
+    xfree(B);
+}
+
 /* img_save_file:
  * Save an image in a file of the specified type. */
 int img_save(const img I, FILE *fp, const imgtype type) {
@@ -207,6 +356,41 @@ int img_save(const img I, FILE *fp, const imgtype type) {
     return 0;
 }
 
+/* img_resample:
+ * Make a copy of a loaded image of w x h pixels, each the average of the box
+ * of pixels it covers. */
+static img img_resample(const img I, const unsigned int w, const unsigned int h) {
+    unsigned int x, y;
+    img S;
+
+    S = img_new_blank(w, h);
+    img_alloc(S);
+    S->type = I->type;
+    S->load = full;
+
+    for (y = 0; y < h; ++y) {
+        unsigned int y0 = (unsigned long)y * I->height / h, y1 = (unsigned long)(y + 1) * I->height / h;
+        if (y1 == y0) y1 = y0 + 1;
+
+        for (x = 0; x < w; ++x) {
+            unsigned int x0 = (unsigned long)x * I->width / w, x1 = (unsigned long)(x + 1) * I->width / w;
+            unsigned long r = 0, g = 0, b = 0, a = 0, n = (x1 > x0 ? x1 - x0 : 1) * (y1 - y0);
+            unsigned int i, j;
+            if (x1 == x0) x1 = x0 + 1;
+
+            for (j = y0; j < y1; ++j)
+                for (i = x0; i < x1; ++i) {
+                    pel p = I->data[j][i];
+                    r += GETR(p); g += GETG(p); b += GETB(p); a += GETA(p);
+                }
+
+            S->data[y][x] = PELA(r / n, g / n, b / n, a / n);
+        }
+    }
+
+    return S;
+}
+
 /* img_clip_adj_x:
  * img_clip_adj_y:
  * Return an adjustment to the passed coordinate which will put it in the
@@ -70,10 +70,19 @@ typedef struct _img {
     unsigned int width, height;
     pel **data, *flat;
     FILE *fp;
+    /* set when loading from memory (the stream reads from it) */
+    const unsigned char *buf;
+    size_t buflen;
     void *us;
     imgerr err;
+    /* when set, a full load shrinks the image to fit in them, keeping its
+     * aspect; the loaders decode it straight to that size when they can */
+    unsigned int max_width, max_height;
 } *img;
 
+/* A box filter shrinking an image a row at a time, for the loaders. */
+typedef struct _imgbox *imgbox;
+
 
 img img_new(void);
 img img_new_blank(const unsigned int width, const unsigned int height);
@@ -82,6 +91,17 @@ void img_alloc(img I);
 int img_load(img I, const imgstate howmuch, const imgtype type);
 int img_load_stream(img I, FILE *fp, const imgstate howmuch, const imgtype type);
 int img_load_file(img I, const char *name, const imgstate howmuch, const imgtype type);
+int img_load_buffer(img I, const unsigned char *buf, const size_t len, const imgstate howmuch, const imgtype type);
+int img_load_fit(img I, const imgtype type, const unsigned int max_width, const unsigned int max_height);
+
+void img_fit_size(unsigned int *width, unsigned int *height, const unsigned int max_width, const unsigned int max_height);
+void img_load_size(const img I, unsigned int *width, unsigned int *height);
+
+imgbox img_box_new(img I, const unsigned int width, const unsigned int height);
+void img_box_row(imgbox B, const pel *row);
+void img_box_delete(imgbox B);
+
+imgtype img_type_by_suffix(const char *suffix);
 
 int img_save(const img I, FILE *fp, const imgtype type);
 
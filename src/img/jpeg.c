@@ -58,13 +58,12 @@ int jpeg_load_hdr(img I) {
     jpeg_create_decompress(cinfo);
     jpeg_stdio_src(cinfo, I->fp);
 
-    /* Read the header of the image. */
+    /* Read the header of the image; decompression starts once we know the
+     * size wanted. */
     jpeg_read_header(cinfo, TRUE);
 
-    jpeg_start_decompress(cinfo);
-
-    I->width = cinfo->output_width;
-    I->height = cinfo->output_height;
+    I->width = cinfo->image_width;
+    I->height = cinfo->image_height;
 
     return 1;
 }
@@ -72,7 +71,6 @@ int jpeg_load_hdr(img I) {
 /* jpeg_abort_load:
  * Abort loading a JPEG after the header is done. */
 int jpeg_abort_load(img I) {
-    jpeg_finish_decompress((struct jpeg_decompress_struct*)I->us);
     jpeg_destroy_decompress((struct jpeg_decompress_struct*)I->us);
     return 1;
 }
@@ -83,7 +81,7 @@ int jpeg_load_img(img I) {
     struct jpeg_decompress_struct *cinfo = I->us;
     struct my_error_mgr *jerr;
     JSAMPARRAY buffer;
-    img_alloc(I);
+    unsigned int w, h;
     jerr = (struct my_error_mgr*)cinfo->err;
     if (setjmp(jerr->jb)) {
         /* Oops, something went wrong. */
@@ -95,6 +93,22 @@ int jpeg_load_img(img I) {
     cinfo->out_color_space = JCS_RGB;
     cinfo->out_color_components = cinfo->output_components = 3;
 
+    /* Let the IDCT shrink the image, by 1/2, 1/4 or 1/8 (which every libjpeg
+     * knows), as long as it still covers the size wanted; img_load does the
+     * rest. */
+    img_load_size(I, &w, &h);
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = 1;
+    while (cinfo->scale_denom < 8
+            && I->width / (cinfo->scale_denom * 2) >= w && I->height / (cinfo->scale_denom * 2) >= h)
+        cinfo->scale_denom *= 2;
+
+    jpeg_start_decompress(cinfo);
+
+    I->width = cinfo->output_width;
+    I->height = cinfo->output_height;
+    img_alloc(I);
+
     /* Start decompression. */
     buffer = cinfo->mem->alloc_sarray((j_common_ptr)cinfo, JPOOL_IMAGE, cinfo->output_width * cinfo->output_components, 1);
 
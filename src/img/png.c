@@ -22,6 +22,7 @@
 #include <png.h>
 
 #include "common/log.h"
+#include "common/util.h"
 #include "img.h"
 #include "pngformat.h"
 
@@ -91,16 +92,31 @@ int png_abort_load(img I) {
     return 1;
 }
 
+/* png_free_rows:
+ * Free the rows read, and what shrinks them. */
+static void png_free_rows(png_structp png_ptr, png_bytepp rows, png_uint_32 nrows, pel *line, imgbox box) {
+    png_uint_32 i;
+
+    if (rows) {
+        for (i = 0; i < nrows; i++)
+            png_free(png_ptr, rows[i]);
+        png_free(png_ptr, rows);
+    }
+    xfree(line);
+    img_box_delete(box);
+}
+
 int png_load_img(img I) {
-    pel **p;
-    unsigned char **q;
     png_structp png_ptr;
     png_infop info_ptr;
-    png_uint_32 width, height;
-    int i, j, bit_depth, color_type, interlace_type;
-    png_bytepp row_pointers;
-
-    img_alloc(I);
+    png_uint_32 width, height, i, j;
+    unsigned int w, h;
+    int bit_depth, color_type, interlace_type;
+    /* kept across a longjmp, to be freed */
+    png_bytepp volatile row_pointers = NULL;
+    png_uint_32 volatile nrows = 0;
+    pel *volatile line = NULL;
+    imgbox volatile box = NULL;
 
     png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
         NULL, png_catch_error, NULL);
@@ -111,6 +127,7 @@ int png_load_img(img I) {
     }
     
     if (setjmp(png_jmpbuf(png_ptr))) {
+       png_free_rows(png_ptr, row_pointers, nrows, line, box);
        png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
        I->err = IE_HDRFORMAT;
        return 0;
@@ -156,32 +173,58 @@ int png_load_img(img I) {
      * filler byte. */
     png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
 
+    if (interlace_type != PNG_INTERLACE_NONE)
+        png_set_interlace_handling(png_ptr);
+
     /* Update the info structure after the transforms */
     png_read_update_info(png_ptr, info_ptr);
 /*    png_set_rows(png_ptr, info_ptr, row_pointers)*/
 
-    /* Allocate space before reading the image */
-    row_pointers = png_malloc(png_ptr, height * sizeof(png_bytep));
-    for (i = 0; i < height; i++) {
-        row_pointers[i] = png_malloc(png_ptr, png_get_rowbytes(png_ptr, info_ptr));
+    /* The rows are shrunk as they are converted, if wanted */
+    img_load_size(I, &w, &h);
+    I->width = w;
+    I->height = h;
+    img_alloc(I);
+
+    if (w != width || h != height) {
+        box = img_box_new(I, width, height);
+        line = xmalloc(width * sizeof(pel));
     }
 
-    /* Read in the image and copy it to the gdk img structure */
-    png_read_image(png_ptr, row_pointers);
+    /* An interlaced image is only complete once all read; otherwise it is
+     * read a row at a time */
+    nrows = interlace_type != PNG_INTERLACE_NONE ? height : 1;
+    row_pointers = png_malloc(png_ptr, nrows * sizeof(png_bytep));
+    for (i = 0; i < nrows; i++) {
+        row_pointers[i] = png_malloc(png_ptr, png_get_rowbytes(png_ptr, info_ptr));
+    }
 
-    p = I->data;
-    q = (unsigned char **)row_pointers;
+    if (nrows > 1)
+        png_read_image(png_ptr, row_pointers);
 
     for (i = 0; i < height; i++) {
-        for (j = 0; j < png_get_rowbytes(png_ptr, info_ptr); j = j+4) {
-            p[i][j/4] = PEL(q[i][j], q[i][j+1], q[i][j+2]);
+        pel *p = box ? line : I->data[i];
+        unsigned char *q;
+
+        if (nrows > 1) {
+            q = row_pointers[i];
+        } else {
+            png_read_row(png_ptr, row_pointers[0], NULL);
+            q = row_pointers[0];
         }
+
+        /* Copy it to the img structure */
+        for (j = 0; j < width; j++, q += 4)
+            p[j] = PEL(q[0], q[1], q[2]);
+
+        if (box)
+            img_box_row(box, line);
     }
 
     png_read_end(png_ptr, info_ptr);
 
     /* Clean up */
-    png_free(png_ptr, row_pointers);
+    png_free_rows(png_ptr, row_pointers, nrows, line, box);
     png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
 
     return 1;
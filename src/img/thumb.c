@@ -0,0 +1,62 @@
+/**
+ * @file thumb.c
+ *
+ * @brief Thumbnails of the carved images.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 20:41:13 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "img.h"
+#include "thumb.h"
+
+int thumb_make(const char *mname, const unsigned char *data, size_t len, unsigned int max_dim,
+        unsigned char **out, size_t *outlen)
+{
+    char suffix[16];
+    imgtype type;
+    img I;
+    FILE *fp;
+    char *buf = NULL;
+    size_t buflen = 0;
+    int ok;
+
+    snprintf(suffix, sizeof suffix, ".%s", mname);
+    if ((type = img_type_by_suffix(suffix)) == unknown)
+        return FALSE;
+
+    /* the header tells if it is worth decoding */
+    I = img_new();
+    if (!img_load_buffer(I, data, len, header, type) || (I->width <= max_dim && I->height <= max_dim)
+            || !img_load_fit(I, type, max_dim, max_dim)) {
+        img_delete(I);
+        return FALSE;
+    }
+
+    if (!(fp = open_memstream(&buf, &buflen))) {
+        img_delete(I);
+        return FALSE;
+    }
+
+    ok = img_save(I, fp, jpeg);
+    img_delete(I);
+
+    /* buf is only complete once closed */
+    if (fclose(fp) != 0 || !ok || buflen >= len) {
+        free(buf);
+        return FALSE;
+    }
+
+    *out = (unsigned char *)buf;
+    *outlen = buflen;
+
+    return TRUE;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file thumb.h
+ *
+ * @brief Thumbnails of the carved images.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 20:41:13 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __THUMB_H__
+#define __THUMB_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+
+/**
+ * @brief Default size of the longest side of a thumbnail, in pixels.
+ */
+#define THUMB_DEFAULT_SIZE  256
+
+/**
+ * @brief Makes a JPEG thumbnail of an image.
+ *
+ * Nothing is made when the image can't be decoded, already fits in the
+ * thumbnail or the thumbnail wouldn't be smaller than the image.
+ *
+ * @param mname media name of the image (gif, jpeg, png or webp)
+ * @param data the image
+ * @param len size of the image
+ * @param max_dim size of the longest side of the thumbnail
+ * @param out where to store the thumbnail, to be freed with free()
+ * @param outlen where to store its size
+ * @return TRUE if a thumbnail was made, FALSE otherwise
+ */
+int thumb_make(const char *mname, const unsigned char *data, size_t len, unsigned int max_dim,
+        unsigned char **out, size_t *outlen);
+
+#endif /* __THUMB_H__ */
@@ -21,6 +21,8 @@
 typedef struct {
     size_t size;
     unsigned char *data;
+    /* FALSE when data is the buffer of an image loaded from memory */
+    int owned;
 } webp_internal;
 
 int webp_load_hdr(img I) {
@@ -32,11 +34,20 @@ int webp_load_hdr(img I) {
     internal = (webp_internal*)malloc(sizeof(webp_internal));
     I->us = internal;
 
+    if (I->buf) {
+        /* already in memory, decode it from there */
+        internal->data = (unsigned char*)I->buf;
+        internal->size = I->buflen;
+        internal->owned = 0;
+        goto info;
+    }
+
     // blah, need to read in entire file because for some reason driftnet stores things to disk
     fseek(I->fp, 0L, SEEK_END);
     internal->size = ftell(I->fp);
     rewind(I->fp);
     internal->data = malloc(internal->size);
+    internal->owned = 1;
     if (!internal->data) {
         return 0;
     }
@@ -47,6 +58,7 @@ int webp_load_hdr(img I) {
         return 0;
     }
 
+info:
     // Validate header etc.
     ret = WebPGetInfo(internal->data, internal->size, &width, &height);
     if (!ret) {
@@ -59,20 +71,34 @@ int webp_load_hdr(img I) {
 }
 
 int webp_load_img(img I) {
-    unsigned char *decoded;
     webp_internal *internal = (webp_internal*)I->us;
-    size_t allocated_size;
+    WebPDecoderConfig config;
+    unsigned int w, h;
+
+    if (!WebPInitDecoderConfig(&config)) {
+        return 0;
+    }
 
+    // the decoder scales the image to the size wanted, straight into ours
+    img_load_size(I, &w, &h);
+    if (w != I->width || h != I->height) {
+        config.options.use_scaling = 1;
+        config.options.scaled_width = w;
+        config.options.scaled_height = h;
+    }
+
+    I->width = w;
+    I->height = h;
     img_alloc(I);
-    allocated_size = I->height * sizeof(pel*) + I->width * I->height * sizeof(pel); // copied from img.c, because why the fuck not
-    decoded = WebPDecodeBGRAInto(
-            internal->data,
-            internal->size,
-            (unsigned char*)*I->data,
-            allocated_size,
-            I->width*4);
-
-    if (!decoded) {
+
+    config.output.colorspace = MODE_BGRA;
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = (uint8_t*)I->flat;
+    config.output.u.RGBA.stride = I->width * sizeof(pel);
+    config.output.u.RGBA.size = (size_t)I->width * I->height * sizeof(pel);
+
+    if (WebPDecode(internal->data, internal->size, &config) != VP8_STATUS_OK) {
+        I->err = IE_IMGFORMAT;
         return 0;
     }
 
@@ -89,7 +115,8 @@ int webp_abort_load(img I) {
     internal = (webp_internal*)I->us;
 
 
-    free(internal->data);
+    if (internal->owned)
+        free(internal->data);
     free(internal);
     I->us = NULL;
 
@@ -0,0 +1,409 @@
+/**
+ * @file adjout.c
+ *
+ * @brief Framed output of adjunct mode.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 17:48:36 +0200
+ *
+ * Instead of a line with the path of each file, each object is announced with
+ * a frame carrying its flow, time, type, hash and dimensions, plus the path of
+ * its file or the object itself. The frames are batched, and written to
+ * standard output or to a Unix socket every few miliseconds.
+ *
+ * A JSON frame is an object in a line. A binary stream starts with a header
+ * (the "DRIFTOUT" magic, the version and the flags, 32 bits little endian each)
+ * and each frame is its length (32 bits, little endian) followed by the
+ * header of a segment archive record (see segarchive.h) and the object, or the
+ * path of its file. Text objects (HTTP requests) are always carried inline.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common/util.h"
+#include "common/log.h"
+
+#include "adjout.h"
+
+#define STREAM_MAGIC    "DRIFTOUT"
+#define FORMAT_VERSION  1
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    int fd;
+    adjout_format_t format;
+    int inline_data;
+    unsigned int flush_ms;
+
+    /* frames waiting to be written */
+    adjbuf_t batch;
+
+    pthread_t flusher;
+    int running, stop;
+
+    adjout_stats_t stats;
+} out = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, -1 };
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/* reserve BUFFER LEN
+ * Makes room for LEN more bytes in BUFFER; returns where they go. */
+static unsigned char *reserve(adjbuf_t *b, size_t len)
+{
+    if (b->len + len > b->size) {
+        b->size = b->size ? b->size : 4096;
+        while (b->len + len > b->size)
+            b->size *= 2;
+        b->buf = xrealloc(b->buf, b->size);
+    }
+
+    b->len += len;
+
+    return b->buf + b->len - len;
+}
+
+static void append(adjbuf_t *b, const void *data, size_t len)
+{
+    memcpy(reserve(b, len), data, len);
+}
+
+static void append_str(adjbuf_t *b, const char *s)
+{
+    append(b, s, strlen(s));
+}
+
+/* append_json_str STRING
+ * Appends STRING as a JSON string. */
+static void append_json_str(adjbuf_t *b, const char *s)
+{
+    append_str(b, "\"");
+
+    for (; *s; ++s) {
+        unsigned char c = *s;
+
+        if (c == '"' || c == '\\') {
+            char esc[2] = { '\\', c };
+
+            append(b, esc, 2);
+
+        } else if (c < 0x20) {
+            char esc[8];
+
+            snprintf(esc, sizeof esc, "\\u%04x", c);
+            append_str(b, esc);
+
+        } else {
+            append(b, &c, 1);
+        }
+    }
+
+    append_str(b, "\"");
+}
+
+/* append_base64 DATA LEN
+ * Appends DATA encoded in base64. */
+static void append_base64(adjbuf_t *b, const unsigned char *data, size_t len)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned char *p = reserve(b, (len + 2) / 3 * 4);
+    size_t i;
+
+    for (i = 0; i + 2 < len; i += 3) {
+        uint32_t v = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+
+        *p++ = digits[v >> 18];
+        *p++ = digits[(v >> 12) & 63];
+        *p++ = digits[(v >> 6) & 63];
+        *p++ = digits[v & 63];
+    }
+
+    if (i < len) {
+        uint32_t v = data[i] << 16 | (i + 1 < len ? data[i + 1] << 8 : 0);
+
+        *p++ = digits[v >> 18];
+        *p++ = digits[(v >> 12) & 63];
+        *p++ = i + 1 < len ? digits[(v >> 6) & 63] : '=';
+        *p++ = '=';
+    }
+}
+
+static void append_json_frame(adjbuf_t *b, const segrec_t *rec, const unsigned char *data, const char *path)
+{
+    char field[128], addr[64];
+
+    snprintf(field, sizeof field, "{\"type\":");
+    append_str(b, field);
+    append_json_str(b, rec->type);
+
+    snprintf(field, sizeof field, ",\"len\":%llu,\"ts\":%lld.%06u,\"src\":\"%s\"",
+            (unsigned long long)rec->len, (long long)rec->ts_sec, (unsigned int)rec->ts_usec,
+            segrec_addr(rec, FALSE, addr, sizeof addr));
+    append_str(b, field);
+
+    snprintf(field, sizeof field, ",\"dst\":\"%s\",\"hash\":\"%016llx\"",
+            segrec_addr(rec, TRUE, addr, sizeof addr), (unsigned long long)rec->hash);
+    append_str(b, field);
+
+    if (rec->width) {
+        snprintf(field, sizeof field, ",\"width\":%u,\"height\":%u",
+                (unsigned int)rec->width, (unsigned int)rec->height);
+        append_str(b, field);
+    }
+
+    if (path) {
+        append_str(b, ",\"path\":");
+        append_json_str(b, path);
+        append_str(b, "}\n");
+
+    } else {
+        append_str(b, ",\"data\":\"");
+        append_base64(b, data, rec->len);
+        append_str(b, "\"}\n");
+    }
+}
+
+static void append_binary_frame(adjbuf_t *b, const segrec_t *rec, const unsigned char *data, const char *path)
+{
+    const unsigned char *body = path ? (const unsigned char*)path : data;
+    size_t body_len = path ? strlen(path) : rec->len;
+    unsigned char *p = reserve(b, 4 + SEGREC_LEN);
+
+    put_u32(p, SEGREC_LEN + body_len);
+    segrec_encode(rec, p + 4);
+    append(b, body, body_len);
+}
+
+void adjout_encode(adjbuf_t *b, adjout_format_t format, const segrec_t *rec, const unsigned char *data,
+        const char *path)
+{
+    if (format == ADJOUT_BINARY)
+        append_binary_frame(b, rec, data, path);
+    else
+        append_json_frame(b, rec, data, path);
+}
+
+void adjout_encode_stream_header(adjbuf_t *b, int inline_data)
+{
+    unsigned char *hdr = reserve(b, ADJOUT_STREAM_HDR_LEN);
+
+    memset(hdr, 0, ADJOUT_STREAM_HDR_LEN);
+    memcpy(hdr, STREAM_MAGIC, 8);
+    put_u32(hdr + 8, FORMAT_VERSION);
+    put_u32(hdr + 12, inline_data ? ADJOUT_FLAG_INLINE : 0);
+}
+
+/* flush
+ * Writes the batched frames; must be called with the mutex held. */
+static void flush(void)
+{
+    unsigned char *p = out.batch.buf;
+
+    if (out.batch.len == 0)
+        return;
+
+    while (out.fd != -1 && p < out.batch.buf + out.batch.len) {
+        ssize_t n = write(out.fd, p, out.batch.buf + out.batch.len - p);
+
+        if (n == -1 && errno == EINTR)
+            continue;
+
+        if (n == -1) {
+            /* the consumer is gone: drop the frames from now on */
+            log_msg(LOG_ERROR, "adjunct output: %s", strerror(errno));
+            if (out.fd != STDOUT_FILENO)
+                close(out.fd);
+            out.fd = -1;
+            break;
+        }
+
+        p += n;
+    }
+
+    if (out.fd != -1) {
+        out.stats.bytes += out.batch.len;
+        ++out.stats.flushes;
+    }
+
+    out.batch.len = 0;
+}
+
+/* flusher_thread:
+ * Writes out the batched frames every flush_ms miliseconds. */
+static void *flusher_thread(void *arg)
+{
+    pthread_mutex_lock(&out.mutex);
+
+    while (!out.stop) {
+        struct timespec until;
+
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += out.flush_ms / 1000;
+        until.tv_nsec += (long)(out.flush_ms % 1000) * 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            ++until.tv_sec;
+            until.tv_nsec -= 1000000000;
+        }
+
+        pthread_cond_timedwait(&out.cond, &out.mutex, &until);
+        flush();
+    }
+
+    pthread_mutex_unlock(&out.mutex);
+
+    return NULL;
+}
+
+/* connect_socket PATH
+ * Connects to the Unix socket at PATH; returns the descriptor or -1. */
+static int connect_socket(const char *path)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    if (strlen(path) >= sizeof sa.sun_path) {
+        log_msg(LOG_ERROR, "%s: socket path too long", path);
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+            || connect(fd, (struct sockaddr*)&sa, sizeof sa) == -1) {
+        log_msg(LOG_ERROR, "%s: %s", path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int adjout_open(adjout_format_t format, const char *socket_path, int inline_data, unsigned int flush_ms)
+{
+    int fd = socket_path ? connect_socket(socket_path) : STDOUT_FILENO;
+
+    if (fd == -1)
+        return FALSE;
+
+    pthread_mutex_lock(&out.mutex);
+
+    out.fd = fd;
+    out.format = format;
+    out.inline_data = inline_data;
+    out.flush_ms = flush_ms;
+    out.stop = FALSE;
+
+    if (format == ADJOUT_BINARY) {
+        adjout_encode_stream_header(&out.batch, inline_data);
+        flush();
+    }
+
+    out.running = flush_ms > 0 && pthread_create(&out.flusher, NULL, flusher_thread, NULL) == 0;
+
+    pthread_mutex_unlock(&out.mutex);
+
+    if (flush_ms > 0 && !out.running)
+        log_msg(LOG_WARNING, "adjunct output: can't start the flusher thread, writing each frame");
+
+    return TRUE;
+}
+
+void adjout_close(void)
+{
+    pthread_mutex_lock(&out.mutex);
+    out.stop = TRUE;
+    pthread_cond_signal(&out.cond);
+    pthread_mutex_unlock(&out.mutex);
+
+    if (out.running) {
+        pthread_join(out.flusher, NULL);
+        out.running = FALSE;
+    }
+
+    pthread_mutex_lock(&out.mutex);
+
+    flush();
+
+    if (out.fd != -1 && out.fd != STDOUT_FILENO)
+        close(out.fd);
+    out.fd = -1;
+
+    adjbuf_free(&out.batch);
+
+    pthread_mutex_unlock(&out.mutex);
+}
+
+int adjout_inline(void)
+{
+    return out.inline_data;
+}
+
+void adjout_emit(const segrec_t *rec, const unsigned char *data, const char *path)
+{
+    pthread_mutex_lock(&out.mutex);
+
+    if (out.fd == -1) {
+        pthread_mutex_unlock(&out.mutex);
+        return;
+    }
+
+    adjout_encode(&out.batch, out.format, rec, data, path);
+
+    ++out.stats.frames;
+
+    if (!out.running || out.batch.len >= ADJOUT_BATCH_BYTES)
+        flush();
+
+    pthread_mutex_unlock(&out.mutex);
+}
+
+void adjout_get_stats(adjout_stats_t *stats)
+{
+    pthread_mutex_lock(&out.mutex);
+    *stats = out.stats;
+    pthread_mutex_unlock(&out.mutex);
+}
+
+void adjbuf_free(adjbuf_t *b)
+{
+    xfree(b->buf);
+    b->buf = NULL;
+    b->len = b->size = 0;
+}
+
+int adjout_parse_format(const char *name, adjout_format_t *format)
+{
+    if (!strcmp(name, "lines"))
+        *format = ADJOUT_LINES;
+    else if (!strcmp(name, "jsonl"))
+        *format = ADJOUT_JSONL;
+    else if (!strcmp(name, "binary"))
+        *format = ADJOUT_BINARY;
+    else
+        return FALSE;
+
+    return TRUE;
+}
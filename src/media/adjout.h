@@ -0,0 +1,151 @@
+/**
+ * @file adjout.h
+ *
+ * @brief Framed output of adjunct mode.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 17:48:36 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __ADJOUT_H__
+#define __ADJOUT_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "segarchive.h" /* for segrec_t */
+
+/**
+ * @brief Default time between flushes of the batched frames, in miliseconds.
+ */
+#define ADJOUT_DEFAULT_FLUSH_MS     100
+
+/**
+ * @brief Frames are flushed right away once this many bytes are batched.
+ */
+#define ADJOUT_BATCH_BYTES          (256 * 1024)
+
+/**
+ * @brief Size of the header at the start of a binary stream.
+ */
+#define ADJOUT_STREAM_HDR_LEN       16
+
+/**
+ * @brief Flag of the binary stream header: the frames carry the data.
+ */
+#define ADJOUT_FLAG_INLINE          1
+
+/**
+ * @brief How the objects are announced.
+ */
+typedef enum {
+    /** A line with the path of the file (the classic output) */
+    ADJOUT_LINES = 0,
+    /** A JSON object per line */
+    ADJOUT_JSONL,
+    /** Length-prefixed binary frames, after a stream header */
+    ADJOUT_BINARY
+} adjout_format_t;
+
+/**
+ * @brief A growing buffer of encoded frames.
+ */
+typedef struct {
+    unsigned char *buf;
+    size_t len, size;
+} adjbuf_t;
+
+/**
+ * @brief Output counters.
+ */
+typedef struct {
+    /** Frames and bytes written */
+    unsigned long frames;
+    unsigned long long bytes;
+
+    /** Writes done, each with one or more frames */
+    unsigned long flushes;
+} adjout_stats_t;
+
+/**
+ * @brief Starts the framed output.
+ *
+ * @param format JSONL or BINARY
+ * @param socket_path Unix socket to connect to, or NULL for standard output
+ * @param inline_data TRUE to carry the data in the frames instead of the path of a file
+ * @param flush_ms time between flushes of the batched frames (0 writes each frame right away)
+ * @return TRUE on success, FALSE on error
+ */
+int adjout_open(adjout_format_t format, const char *socket_path, int inline_data, unsigned int flush_ms);
+
+/**
+ * @brief Flushes what is batched and stops the output.
+ */
+void adjout_close(void);
+
+/**
+ * @brief Are the frames carrying the data ?
+ *
+ * @return TRUE if so, FALSE if they carry the path of a file
+ */
+int adjout_inline(void);
+
+/**
+ * @brief Announces an object. Can be called from several threads.
+ *
+ * @param rec its flow, time, type, hash and dimensions
+ * @param data the object, carried in the frame when path is NULL
+ * @param path the file it was written to, or NULL
+ */
+void adjout_emit(const segrec_t *rec, const unsigned char *data, const char *path);
+
+/**
+ * @brief Appends the frame of an object to a buffer.
+ *
+ * @param b the buffer
+ * @param format JSONL or BINARY
+ * @param rec its flow, time, type, hash and dimensions
+ * @param data the object, carried in the frame when path is NULL
+ * @param path the file it was written to, or NULL
+ */
+void adjout_encode(adjbuf_t *b, adjout_format_t format, const segrec_t *rec, const unsigned char *data,
+        const char *path);
+
+/**
+ * @brief Appends the header of a binary stream to a buffer.
+ *
+ * @param b the buffer
+ * @param inline_data TRUE if the frames carry the objects
+ */
+void adjout_encode_stream_header(adjbuf_t *b, int inline_data);
+
+/**
+ * @brief Frees the memory of a buffer, leaving it empty.
+ *
+ * @param b the buffer
+ */
+void adjbuf_free(adjbuf_t *b);
+
+/**
+ * @brief Gets the output counters.
+ *
+ * @param stats where to store them
+ */
+void adjout_get_stats(adjout_stats_t *stats);
+
+/**
+ * @brief Parses a format name: lines, jsonl or binary.
+ *
+ * @param name the format name
+ * @param format where to store the format
+ * @return TRUE if valid, FALSE otherwise
+ */
+int adjout_parse_format(const char *name, adjout_format_t *format);
+
+#endif /* __ADJOUT_H__ */
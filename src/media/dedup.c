@@ -0,0 +1,211 @@
+/**
+ * @file dedup.c
+ *
+ * @brief Suppression of recently seen media objects.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 12:40:07 +0200
+ *
+ * We remember the hashes of the last objects in a LRU: an array of entries
+ * linked in use order, indexed by an open addressing (linear probing) table
+ * of twice the size. Both are allocated up front, so the memory used is
+ * fixed.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "common/util.h"
+#include "common/hash.h"
+
+#include "dedup.h"
+
+#define NIL ((uint32_t)-1)
+
+typedef struct {
+    uint64_t hash;
+    unsigned int times;
+    uint32_t prev, next;
+} dedup_entry_t;
+
+static dedup_entry_t *entries;
+static uint32_t *index_slots;       /* entry + 1, 0 if free */
+static size_t nentries, used, nslots;
+static uint32_t head = NIL, tail = NIL; /* most and least recently used */
+
+static unsigned long unique_count, duplicate_count;
+
+static pthread_mutex_t dedup_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+size_t dedup_init(size_t window, size_t mem_max)
+{
+    size_t max_window;
+
+    dedup_close();
+
+    /* an entry and (at least) two index slots each */
+    max_window = mem_max / (sizeof(dedup_entry_t) + 2 * sizeof(uint32_t));
+    if (window > max_window)
+        window = max_window;
+
+    if (window == 0)
+        return 0;
+
+    for (nslots = 1; nslots < window * 2; nslots <<= 1);
+
+    /* the power of two rounding may not fit */
+    while (window > 1 && window * sizeof(dedup_entry_t) + nslots * sizeof(uint32_t) > mem_max) {
+        nslots >>= 1;
+        window = nslots / 2;
+    }
+
+    entries = xcalloc(window, sizeof(dedup_entry_t));
+    index_slots = xcalloc(nslots, sizeof(uint32_t));
+    nentries = window;
+
+    return window;
+}
+
+void dedup_close(void)
+{
+    xfree(entries);
+    xfree(index_slots);
+    entries = NULL;
+    index_slots = NULL;
+    nentries = used = nslots = 0;
+    head = tail = NIL;
+}
+
+/* find_slot HASH
+ * Slot of HASH in the index, or the free slot where it should go. */
+static size_t find_slot(uint64_t hash)
+{
+    size_t i = hash & (nslots - 1);
+
+    while (index_slots[i] && entries[index_slots[i] - 1].hash != hash)
+        i = (i + 1) & (nslots - 1);
+
+    return i;
+}
+
+/* remove_slot SLOT
+ * Free a slot of the index, moving back the entries after it so lookups
+ * don't stop early. */
+static void remove_slot(size_t i)
+{
+    size_t j = i;
+
+    index_slots[i] = 0;
+
+    for (;;) {
+        size_t k;
+
+        j = (j + 1) & (nslots - 1);
+        if (!index_slots[j])
+            break;
+
+        /* can the entry at j live in i ? */
+        k = entries[index_slots[j] - 1].hash & (nslots - 1);
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+
+        index_slots[i] = index_slots[j];
+        index_slots[j] = 0;
+        i = j;
+    }
+}
+
+static void unlink_entry(uint32_t e)
+{
+    if (entries[e].prev != NIL)
+        entries[entries[e].prev].next = entries[e].next;
+    else
+        head = entries[e].next;
+
+    if (entries[e].next != NIL)
+        entries[entries[e].next].prev = entries[e].prev;
+    else
+        tail = entries[e].prev;
+}
+
+static void push_entry(uint32_t e)
+{
+    entries[e].prev = NIL;
+    entries[e].next = head;
+
+    if (head != NIL)
+        entries[head].prev = e;
+    head = e;
+
+    if (tail == NIL)
+        tail = e;
+}
+
+int dedup_check(const unsigned char *data, const size_t len, uint64_t *hash, unsigned int *times)
+{
+    uint64_t h = hash64(data, len);
+    unsigned int t = 1;
+    int duplicate = FALSE;
+    size_t slot;
+    uint32_t e;
+
+    if (hash)
+        *hash = h;
+
+    pthread_mutex_lock(&dedup_mutex);
+
+    if (nentries == 0) {
+        ++unique_count;
+        goto out;
+    }
+
+    slot = find_slot(h);
+
+    if (index_slots[slot]) {
+        e = index_slots[slot] - 1;
+        t = ++entries[e].times;
+        unlink_entry(e);
+        push_entry(e);
+        duplicate = TRUE;
+        ++duplicate_count;
+        goto out;
+    }
+
+    if (used < nentries) {
+        e = used++;
+
+    } else {
+        /* forget the least recently seen */
+        e = tail;
+        unlink_entry(e);
+        remove_slot(find_slot(entries[e].hash));
+        slot = find_slot(h);
+    }
+
+    entries[e].hash = h;
+    entries[e].times = 1;
+    index_slots[slot] = e + 1;
+    push_entry(e);
+    ++unique_count;
+
+out:
+    pthread_mutex_unlock(&dedup_mutex);
+
+    if (times)
+        *times = t;
+
+    return duplicate;
+}
+
+void dedup_get_stats(unsigned long *unique, unsigned long *duplicates)
+{
+    pthread_mutex_lock(&dedup_mutex);
+    *unique = unique_count;
+    *duplicates = duplicate_count;
+    pthread_mutex_unlock(&dedup_mutex);
+}
@@ -0,0 +1,68 @@
+/**
+ * @file dedup.h
+ *
+ * @brief Suppression of recently seen media objects.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 12:40:07 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __DEDUP_H__
+#define __DEDUP_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Default number of recent objects remembered.
+ */
+#define DEDUP_DEFAULT_WINDOW    16384
+
+/**
+ * @brief Default memory bound of the window.
+ */
+#define DEDUP_DEFAULT_MEM_MAX   (1024 * 1024)
+
+/**
+ * @brief Sets up the window of recently seen objects.
+ *
+ * The window is shrunk to fit in mem_max if needed.
+ *
+ * @param window number of objects to remember (0 disables deduplication)
+ * @param mem_max maximum memory used by the window
+ * @return the number of objects the window can really hold
+ */
+size_t dedup_init(size_t window, size_t mem_max);
+
+/**
+ * @brief Frees the window.
+ */
+void dedup_close(void);
+
+/**
+ * @brief Checks if an object was recently seen, remembering it if not.
+ *
+ * @param data the object
+ * @param len size of the object
+ * @param hash if not NULL, where to store the hash of the object
+ * @param times if not NULL, where to store how many times it was seen (1 the first time)
+ * @return TRUE if it's a duplicate, FALSE otherwise (or if disabled)
+ */
+int dedup_check(const unsigned char *data, const size_t len, uint64_t *hash, unsigned int *times);
+
+/**
+ * @brief Gets the number of unique and duplicate objects checked.
+ *
+ * @param unique where to store the count of unique objects
+ * @param duplicates where to store the count of duplicates
+ */
+void dedup_get_stats(unsigned long *unique, unsigned long *duplicates);
+
+#endif /* __DEDUP_H__ */
@@ -0,0 +1,527 @@
+/**
+ * @file feedsrv.c
+ *
+ * @brief Local feed of the carved media, on a Unix socket.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 18:52:07 +0200
+ *
+ * Several local programs can subscribe to the media of a single capture.
+ * Each subscriber has its own filter and its own bounded queue of frames;
+ * publishing only queues (dropping frames when the queue is full), and a
+ * server thread writes the queues out as the subscribers read them, so a
+ * slow subscriber never holds the capture back.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "common/util.h"
+#include "common/log.h"
+#include "common/hash.h"
+#include "adjout.h"
+#include "image.h"
+#include "subfilter.h"
+
+#include "feedsrv.h"
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+#endif
+
+/* Longest subscription line. */
+#define SUBSCRIPTION_MAX    512
+
+typedef struct feedframe {
+    struct feedframe *next;
+    size_t len;
+    unsigned char data[];
+} feedframe_t;
+
+typedef struct {
+    int fd;
+
+    /* the subscription line, until complete */
+    int subscribed;
+    char line[SUBSCRIPTION_MAX];
+    size_t linelen;
+
+    adjout_format_t format;
+    subfilter_t filter;
+
+    /* frames waiting; sent bytes of the first one */
+    feedframe_t *head, *tail;
+    size_t queued, sent;
+
+    unsigned long frames, dropped;
+} feedclient_t;
+
+static struct {
+    pthread_mutex_t mutex;
+
+    char *path;
+    int listen_fd;
+
+    /* wakes the server thread up */
+    int wake[2];
+
+    size_t client_max;
+    outqueue_policy_t policy;
+
+    feedclient_t clients[FEEDSRV_MAX_CLIENTS];
+    int nsubscribed;
+
+    pthread_t thread;
+    int running, stop;
+
+    feedsrv_stats_t stats;
+} srv = { PTHREAD_MUTEX_INITIALIZER, NULL, -1, { -1, -1 } };
+
+static void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void wake_server(void)
+{
+    /* if the pipe is full, the server is already due to wake up */
+    if (write(srv.wake[1], "", 1) == -1 && errno != EAGAIN)
+        log_msg(LOG_DEBUG, "feed: can't wake the server up: %s", strerror(errno));
+}
+
+/* drop_client CLIENT
+ * Closes the connection of CLIENT; must be called with the mutex held. */
+static void drop_client(feedclient_t *c)
+{
+    feedframe_t *f, *next;
+
+    if (c->subscribed) {
+        --srv.nsubscribed;
+        log_msg(LOG_INFO, "feed: subscriber gone, %lu frames sent, %lu dropped", c->frames, c->dropped);
+    }
+
+    for (f = c->head; f; f = next) {
+        next = f->next;
+        xfree(f);
+    }
+
+    close(c->fd);
+    memset(c, 0, sizeof *c);
+    c->fd = -1;
+}
+
+/* queue_frame CLIENT DATA LEN
+ * Queues a frame to CLIENT, dropping frames if its queue is full; must be
+ * called with the mutex held. */
+static void queue_frame(feedclient_t *c, const unsigned char *data, size_t len)
+{
+    feedframe_t *f;
+
+    if (c->queued + len > srv.client_max) {
+        /* a frame partly sent has to go out whole */
+        feedframe_t **pp = c->sent ? &c->head->next : &c->head;
+
+        if (srv.policy == OUTQUEUE_DROP_OLDEST) {
+            while (*pp && c->queued + len > srv.client_max) {
+                f = *pp;
+                *pp = f->next;
+                c->queued -= f->len;
+                xfree(f);
+                ++c->dropped;
+                ++srv.stats.dropped;
+            }
+
+            if (!*pp)
+                c->tail = c->head;
+        }
+
+        if (c->queued + len > srv.client_max) {
+            ++c->dropped;
+            ++srv.stats.dropped;
+            return;
+        }
+    }
+
+    f = xmalloc(sizeof *f + len);
+    f->next = NULL;
+    f->len = len;
+    memcpy(f->data, data, len);
+
+    if (c->tail)
+        c->tail->next = f;
+    else
+        c->head = f;
+    c->tail = f;
+
+    c->queued += len;
+    ++c->frames;
+    ++srv.stats.frames;
+}
+
+/* send_frames CLIENT
+ * Writes as much of the queue of CLIENT as it takes; returns FALSE if the
+ * connection is broken. Must be called with the mutex held. */
+static int send_frames(feedclient_t *c)
+{
+    while (c->head) {
+        feedframe_t *f = c->head;
+        ssize_t n = send(c->fd, f->data + c->sent, f->len - c->sent, MSG_NOSIGNAL);
+
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        c->sent += n;
+
+        if (c->sent == f->len) {
+            c->head = f->next;
+            if (!c->head)
+                c->tail = NULL;
+            c->queued -= f->len;
+            c->sent = 0;
+            xfree(f);
+        }
+    }
+
+    return TRUE;
+}
+
+/* subscribe CLIENT
+ * Parses the subscription line of CLIENT; returns FALSE if it is not valid.
+ * Must be called with the mutex held. */
+static int subscribe(feedclient_t *c)
+{
+    char *field, *saveptr;
+
+    c->format = ADJOUT_JSONL;
+    memset(&c->filter, 0, sizeof c->filter);
+
+    for (field = strtok_r(c->line, " \t;\r", &saveptr); field; field = strtok_r(NULL, " \t;\r", &saveptr)) {
+        char *value = strchr(field, '=');
+        int ok;
+
+        if (!value)
+            return FALSE;
+        *value++ = '\0';
+
+        if (!strcmp(field, "format"))
+            ok = adjout_parse_format(value, &c->format) && c->format != ADJOUT_LINES;
+        else
+            ok = subfilter_set(&c->filter, field, value);
+
+        if (!ok) {
+            log_msg(LOG_WARNING, "feed: bad subscription field `%s=%s'", field, value);
+            return FALSE;
+        }
+    }
+
+    c->subscribed = TRUE;
+    ++srv.nsubscribed;
+    ++srv.stats.clients;
+
+    if (c->format == ADJOUT_BINARY) {
+        adjbuf_t hdr = { NULL, 0, 0 };
+
+        adjout_encode_stream_header(&hdr, TRUE);
+        queue_frame(c, hdr.buf, hdr.len);
+        adjbuf_free(&hdr);
+    }
+
+    log_msg(LOG_INFO, "feed: new subscriber");
+
+    return TRUE;
+}
+
+/* read_client CLIENT
+ * Reads the subscription line of CLIENT, or notices it hung up; returns
+ * FALSE if the connection has to be closed. Must be called with the mutex
+ * held. */
+static int read_client(feedclient_t *c)
+{
+    char buf[SUBSCRIPTION_MAX];
+    ssize_t n = read(c->fd, buf, sizeof buf);
+
+    if (n == 0)
+        return FALSE;
+
+    if (n == -1)
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+
+    /* after the subscription, anything sent is ignored */
+    if (c->subscribed)
+        return TRUE;
+
+    if (c->linelen + n > sizeof c->line)
+        return FALSE;
+
+    memcpy(c->line + c->linelen, buf, n);
+    c->linelen += n;
+
+    if (memchr(c->line, '\n', c->linelen)) {
+        *(char*)memchr(c->line, '\n', c->linelen) = '\0';
+        return subscribe(c);
+    }
+
+    /* room for the terminating null */
+    return c->linelen < sizeof c->line;
+}
+
+static void accept_client(void)
+{
+    int fd = accept(srv.listen_fd, NULL, NULL);
+    int i;
+
+    if (fd == -1)
+        return;
+
+    for (i = 0; i < FEEDSRV_MAX_CLIENTS; ++i)
+        if (srv.clients[i].fd == -1)
+            break;
+
+    if (i == FEEDSRV_MAX_CLIENTS) {
+        log_msg(LOG_WARNING, "feed: too many subscribers");
+        close(fd);
+        return;
+    }
+
+    set_nonblocking(fd);
+    srv.clients[i].fd = fd;
+}
+
+/* server_thread:
+ * Accepts the subscribers and writes their queues out. */
+static void *server_thread(void *arg)
+{
+    struct pollfd fds[FEEDSRV_MAX_CLIENTS + 2];
+    int slot[FEEDSRV_MAX_CLIENTS + 2];
+
+    pthread_mutex_lock(&srv.mutex);
+
+    while (!srv.stop) {
+        int i, n = 0;
+
+        fds[n].fd = srv.wake[0];
+        fds[n++].events = POLLIN;
+        fds[n].fd = srv.listen_fd;
+        fds[n++].events = POLLIN;
+
+        for (i = 0; i < FEEDSRV_MAX_CLIENTS; ++i) {
+            feedclient_t *c = &srv.clients[i];
+
+            if (c->fd == -1)
+                continue;
+
+            slot[n] = i;
+            fds[n].fd = c->fd;
+            fds[n++].events = POLLIN | (c->head ? POLLOUT : 0);
+        }
+
+        pthread_mutex_unlock(&srv.mutex);
+
+        if (poll(fds, n, -1) == -1 && errno != EINTR)
+            log_msg(LOG_ERROR, "feed: poll: %s", strerror(errno));
+
+        pthread_mutex_lock(&srv.mutex);
+
+        if (fds[0].revents & POLLIN) {
+            char buf[256];
+
+            while (read(srv.wake[0], buf, sizeof buf) > 0)
+                ;
+        }
+
+        if (fds[1].revents & POLLIN)
+            accept_client();
+
+        for (i = 2; i < n; ++i) {
+            feedclient_t *c = &srv.clients[slot[i]];
+            int ok = TRUE;
+
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                ok = read_client(c);
+
+            if (ok && c->head)
+                ok = send_frames(c);
+
+            if (!ok)
+                drop_client(c);
+        }
+    }
+
+    pthread_mutex_unlock(&srv.mutex);
+
+    return NULL;
+}
+
+int feedsrv_start(const char *path, size_t client_max, outqueue_policy_t policy)
+{
+    struct sockaddr_un sa;
+    struct stat st;
+    int i;
+
+    if (strlen(path) >= sizeof sa.sun_path) {
+        log_msg(LOG_ERROR, "%s: socket path too long", path);
+        return FALSE;
+    }
+
+    /* replace an old socket, but nothing else */
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            log_msg(LOG_ERROR, "%s: exists and is not a socket", path);
+            return FALSE;
+        }
+        unlink(path);
+    }
+
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+
+    if ((srv.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1
+            || bind(srv.listen_fd, (struct sockaddr*)&sa, sizeof sa) == -1
+            || listen(srv.listen_fd, 16) == -1
+            || pipe(srv.wake) == -1) {
+        log_msg(LOG_ERROR, "%s: %s", path, strerror(errno));
+        if (srv.listen_fd != -1)
+            close(srv.listen_fd);
+        srv.listen_fd = -1;
+        return FALSE;
+    }
+
+    set_nonblocking(srv.listen_fd);
+    set_nonblocking(srv.wake[0]);
+    set_nonblocking(srv.wake[1]);
+
+    srv.path = xstrdup(path);
+    srv.client_max = client_max;
+    srv.policy = policy;
+    srv.stop = FALSE;
+
+    for (i = 0; i < FEEDSRV_MAX_CLIENTS; ++i)
+        srv.clients[i].fd = -1;
+
+    if (pthread_create(&srv.thread, NULL, server_thread, NULL) != 0) {
+        log_msg(LOG_ERROR, "feed: can't start the server thread");
+        feedsrv_stop();
+        return FALSE;
+    }
+    srv.running = TRUE;
+
+    log_msg(LOG_INFO, "feed: listening on %s", path);
+
+    return TRUE;
+}
+
+void feedsrv_stop(void)
+{
+    int i;
+
+    if (!srv.path)
+        return;
+
+    if (srv.running) {
+        pthread_mutex_lock(&srv.mutex);
+        srv.stop = TRUE;
+        pthread_mutex_unlock(&srv.mutex);
+
+        wake_server();
+        pthread_join(srv.thread, NULL);
+        srv.running = FALSE;
+    }
+
+    pthread_mutex_lock(&srv.mutex);
+
+    for (i = 0; i < FEEDSRV_MAX_CLIENTS; ++i)
+        if (srv.clients[i].fd != -1)
+            drop_client(&srv.clients[i]);
+
+    if (srv.listen_fd != -1)
+        close(srv.listen_fd);
+    srv.listen_fd = -1;
+
+    for (i = 0; i < 2; ++i) {
+        if (srv.wake[i] != -1)
+            close(srv.wake[i]);
+        srv.wake[i] = -1;
+    }
+
+    if (srv.path) {
+        unlink(srv.path);
+        xfree(srv.path);
+        srv.path = NULL;
+    }
+
+    pthread_mutex_unlock(&srv.mutex);
+}
+
+void feedsrv_publish(const char *mname, const unsigned char *data, size_t len, const mediameta_t *meta)
+{
+    /* encoded once per format, and only if someone wants it */
+    adjbuf_t frames[2] = { { NULL, 0, 0 }, { NULL, 0, 0 } };
+    segrec_t rec;
+    int i, width = 0, height = 0, have_rec = FALSE, queued = FALSE;
+
+    pthread_mutex_lock(&srv.mutex);
+
+    if (!srv.running || srv.nsubscribed == 0) {
+        pthread_mutex_unlock(&srv.mutex);
+        return;
+    }
+
+    if (get_mediatype_by_name(mname) == MEDIATYPE_IMAGE && !image_probe(data, len, &width, &height))
+        width = height = 0;
+
+    for (i = 0; i < FEEDSRV_MAX_CLIENTS; ++i) {
+        feedclient_t *c = &srv.clients[i];
+        adjbuf_t *frame = &frames[c->format == ADJOUT_BINARY];
+
+        if (c->fd == -1 || !c->subscribed || !subfilter_match(&c->filter, mname, len, width, height, meta)
+                || !subfilter_sample(&c->filter))
+            continue;
+
+        if (!have_rec) {
+            segrec_init(&rec, mname, len, meta);
+            rec.hash = hash64(data, len);
+            rec.width = width;
+            rec.height = height;
+            have_rec = TRUE;
+        }
+
+        if (frame->len == 0)
+            adjout_encode(frame, c->format, &rec, data, NULL);
+
+        queue_frame(c, frame->buf, frame->len);
+        queued = TRUE;
+    }
+
+    pthread_mutex_unlock(&srv.mutex);
+
+    adjbuf_free(&frames[0]);
+    adjbuf_free(&frames[1]);
+
+    if (queued)
+        wake_server();
+}
+
+void feedsrv_get_stats(feedsrv_stats_t *stats)
+{
+    pthread_mutex_lock(&srv.mutex);
+    *stats = srv.stats;
+    pthread_mutex_unlock(&srv.mutex);
+}
@@ -0,0 +1,84 @@
+/**
+ * @file feedsrv.h
+ *
+ * @brief Local feed of the carved media, on a Unix socket.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 18:52:07 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __FEEDSRV_H__
+#define __FEEDSRV_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "media.h"
+#include "outqueue.h" /* for outqueue_policy_t */
+
+/**
+ * @brief Default limit of the bytes waiting to be sent to each subscriber.
+ */
+#define FEEDSRV_DEFAULT_CLIENT_MAX  (4 * 1024 * 1024)
+
+/**
+ * @brief Max subscribers at once.
+ */
+#define FEEDSRV_MAX_CLIENTS         64
+
+/**
+ * @brief Server counters.
+ */
+typedef struct {
+    /** Subscribers so far */
+    unsigned long clients;
+
+    /** Frames queued to the subscribers, and dropped because their buffer was full */
+    unsigned long frames, dropped;
+} feedsrv_stats_t;
+
+/**
+ * @brief Starts listening on a Unix socket.
+ *
+ * Each subscriber sends a line with its subscription, "key=value" fields
+ * separated by spaces: format (jsonl or binary) and the fields of a filter
+ * (see subfilter_set()). From then on it gets the frames (see adjout.h) of the
+ * media it wants, always with the data.
+ *
+ * @param path socket path (an old socket there is replaced)
+ * @param client_max bytes waiting to be sent to a subscriber before dropping frames
+ * @param policy OUTQUEUE_DROP_OLDEST or OUTQUEUE_DROP_NEWEST
+ * @return TRUE on success, FALSE on error
+ */
+int feedsrv_start(const char *path, size_t client_max, outqueue_policy_t policy);
+
+/**
+ * @brief Closes the subscribers and the socket.
+ */
+void feedsrv_stop(void);
+
+/**
+ * @brief Queues an object to the subscribers that want it. Never blocks on
+ * them; can be called from several threads.
+ *
+ * @param mname media name
+ * @param data the object
+ * @param len size of the object
+ * @param meta where and when it was captured
+ */
+void feedsrv_publish(const char *mname, const unsigned char *data, size_t len, const mediameta_t *meta);
+
+/**
+ * @brief Gets the server counters.
+ *
+ * @param stats where to store them
+ */
+void feedsrv_get_stats(feedsrv_stats_t *stats);
+
+#endif /* __FEEDSRV_H__ */
@@ -19,12 +19,18 @@
 
 #include "compat/compat.h"
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h> /* On many systems (Darwin...), stdio.h is a prerequisite. */
 #include <string.h>
 
 #include "common/util.h"
 
+#include "http.h"
+
+/* Longest response header we are willing to wait for. */
+#define MAX_RESP_HEADER     16384
+
 
 /* find_http_req DATA LEN FOUND FOUNDLEN
  * Look for an HTTP request and response in buffer DATA of length LEN. The
@@ -99,3 +105,125 @@ found:
     return blankline + 4;
 }
 
+
+int http_is_response(const unsigned char *data, const size_t len)
+{
+    if (len < 5)
+        return FALSE;
+
+    return memcmp(data, "HTTP/", 5) == 0;
+}
+
+/* header_value_is HEADER LEN VALUE
+ * Case-insensitive comparison of a (trimmed) header value against VALUE. */
+static int header_value_is(const char *value, size_t len, const char *expected)
+{
+    return strlen(expected) == len && strncasecmp(value, expected, len) == 0;
+}
+
+/* parse_header_line RESP NAME NAMELEN VALUE VALUELEN
+ * Store whatever we care about from a single header line. */
+static void parse_header_line(http_response_t *resp, const char *name, size_t namelen,
+        const char *value, size_t valuelen)
+{
+    #define is_header(h) (namelen == sizeof(h) - 1 && strncasecmp(name, h, namelen) == 0)
+
+    if (is_header("Content-Length")) {
+        long long l = 0;
+        size_t i;
+
+        for (i = 0; i < valuelen && isdigit((unsigned char)value[i]); ++i)
+            l = l * 10 + (value[i] - '0');
+
+        if (i > 0)
+            resp->content_length = l;
+
+    } else if (is_header("Transfer-Encoding")) {
+        /* chunked is always the last transfer coding applied. */
+        resp->chunked = valuelen >= 7 && strncasecmp(value + valuelen - 7, "chunked", 7) == 0;
+
+    } else if (is_header("Content-Encoding")) {
+        if (header_value_is(value, valuelen, "gzip") || header_value_is(value, valuelen, "x-gzip"))
+            resp->encoding = HTTP_ENCODING_GZIP;
+        else if (header_value_is(value, valuelen, "deflate"))
+            resp->encoding = HTTP_ENCODING_DEFLATE;
+        else if (header_value_is(value, valuelen, "br"))
+            resp->encoding = HTTP_ENCODING_BROTLI;
+        else if (!header_value_is(value, valuelen, "identity"))
+            resp->encoding = HTTP_ENCODING_UNKNOWN;
+
+    } else if (is_header("Content-Type")) {
+        size_t i;
+
+        for (i = 0; i < valuelen && i < HTTP_CONTENT_TYPE_LEN - 1; ++i) {
+            if (value[i] == ';' || value[i] == ' ')
+                break;
+            resp->content_type[i] = tolower((unsigned char)value[i]);
+        }
+        resp->content_type[i] = 0;
+    }
+
+    #undef is_header
+}
+
+/* http_parse_response DATA LEN RESP
+ * Parse the HTTP response header at the start of DATA. */
+int http_parse_response(const unsigned char *data, const size_t len, http_response_t *resp)
+{
+    const unsigned char *le, *blankline, *line;
+
+    memset(resp, 0, sizeof *resp);
+    resp->content_length = -1;
+
+    /* Status lines look like:
+     *
+     *      HTTP/1.(0|1) {code} {reason}\r\n
+     */
+    if (len < 12)
+        return http_is_response(data, len) || len < 5 ? 0 : -1;
+
+    if (memcmp(data, "HTTP/1.", 7) || data[8] != ' '
+            || !isdigit(data[9]) || !isdigit(data[10]) || !isdigit(data[11]))
+        return -1;
+
+    resp->status = (data[9] - '0') * 100 + (data[10] - '0') * 10 + (data[11] - '0');
+
+    if (!(blankline = memstr(data, len, (unsigned char*)"\r\n\r\n", 4)))
+        return len > MAX_RESP_HEADER ? -1 : 0;
+
+    resp->header_len = blankline + 4 - data;
+
+    /* Skip the status line and walk through the headers. */
+    line = memstr(data, blankline + 2 - data, (unsigned char*)"\r\n", 2) + 2;
+
+    while (line < blankline + 2) {
+        const unsigned char *colon, *value;
+
+        le = memstr(line, blankline + 2 - line, (unsigned char*)"\r\n", 2);
+
+        if ((colon = memchr(line, ':', le - line))) {
+            value = colon + 1;
+            while (value < le && (*value == ' ' || *value == '\t'))
+                ++value;
+
+            const unsigned char *vend = le;
+            while (vend > value && (*(vend - 1) == ' ' || *(vend - 1) == '\t'))
+                --vend;
+
+            parse_header_line(resp, (const char*)line, colon - line,
+                    (const char*)value, vend - value);
+        }
+
+        line = le + 2;
+    }
+
+    return 1;
+}
+
+int http_response_has_body(const http_response_t *resp)
+{
+    if ((resp->status >= 100 && resp->status < 200) || resp->status == 204 || resp->status == 304)
+        return FALSE;
+
+    return resp->chunked || resp->content_length != 0;
+}
@@ -26,4 +26,70 @@
 unsigned char *find_http_req(const unsigned char *data, const size_t len,
                              unsigned char **http, size_t *httplen);
 
+/**
+ * @brief Content codings we know how to undo.
+ */
+typedef enum {
+    HTTP_ENCODING_IDENTITY = 0,
+    HTTP_ENCODING_GZIP,
+    HTTP_ENCODING_DEFLATE,
+    HTTP_ENCODING_BROTLI,
+    HTTP_ENCODING_UNKNOWN
+} http_encoding_t;
+
+/**
+ * @brief Max length of the Content-Type value we keep.
+ */
+#define HTTP_CONTENT_TYPE_LEN 64
+
+/**
+ * @brief The parts of an HTTP response header needed to frame its body.
+ */
+typedef struct http_response {
+    /** Status code of the response */
+    int status;
+
+    /** Length of the header, including the terminating blank line */
+    size_t header_len;
+
+    /** Value of Content-Length, or -1 if not present */
+    long long content_length;
+
+    /** Is the body sent with chunked transfer coding ? */
+    int chunked;
+
+    /** Content coding of the body */
+    http_encoding_t encoding;
+
+    /** Lowercased media type of the body, without parameters ("" if not present) */
+    char content_type[HTTP_CONTENT_TYPE_LEN];
+} http_response_t;
+
+/**
+ * @brief Checks if a buffer looks like the start of an HTTP response.
+ *
+ * @param data the buffer
+ * @param len length of the buffer
+ * @return TRUE if it does, FALSE if not
+ */
+int http_is_response(const unsigned char *data, const size_t len);
+
+/**
+ * @brief Parses an HTTP response header.
+ *
+ * @param data buffer starting with the status line
+ * @param len length of the buffer
+ * @param resp where to store the parsed header
+ * @return 1 if parsed, 0 if we need more data, -1 if it isn't a valid HTTP response
+ */
+int http_parse_response(const unsigned char *data, const size_t len, http_response_t *resp);
+
+/**
+ * @brief Tells if a response carries a message body (RFC 7230, 3.3.3).
+ *
+ * @param resp the parsed response
+ * @return TRUE if it has a body, FALSE if not
+ */
+int http_response_has_body(const http_response_t *resp);
+
 #endif /* __HTTP_H__ */
@@ -0,0 +1,578 @@
+/**
+ * @file http_decoder.c
+ *
+ * @brief Streaming decoding of HTTP response bodies.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 10:12:31 +0200
+ *
+ * We follow the framing of the responses sent on a stream (Content-Length,
+ * chunked transfer coding or read until close) and undo the gzip, deflate
+ * and (if built with libbrotlidec) br content codings as the segments
+ * arrive, so the media drivers can look into compressed bodies. Identity
+ * bodies are just dechunked, so every body can be scanned apart from the
+ * headers and with only the drivers its content type calls for.
+ *
+ * The work is bounded: each flow can only produce so many decoded bytes, all
+ * the decoders together can only hold so much memory, and we can only spend
+ * so much time decoding each second. When the time budget is spent we just
+ * stop consuming; the data stays in the connection buffer and we try again
+ * later, or regardless of the budget once the connection is over (see
+ * closing). When the memory ones are hit we give up on the stream, and the
+ * caller goes back to scan the raw data.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+#ifdef HAVE_LIBBROTLIDEC
+    #include <brotli/decode.h>
+#endif
+
+#include "common/util.h"
+#include "common/log.h"
+
+#include "http_decoder.h"
+
+/* How much we grow the output buffer each time. */
+#define OUTPUT_CHUNK        16384
+
+/* Rough memory cost of the state of a decompressor. */
+#define ZLIB_STATE_COST     (48 * 1024)
+#define BROTLI_STATE_COST   (256 * 1024)
+
+/* Longest chunk-size or trailer line we accept. */
+#define MAX_CHUNK_LINE      1024
+
+static size_t flow_max = HTTP_DECODER_DEFAULT_FLOW_MAX;
+static size_t mem_max = HTTP_DECODER_DEFAULT_MEM_MAX;
+static unsigned int cpu_max = HTTP_DECODER_DEFAULT_CPU_MAX;
+
+/* Memory held by all the decoders. */
+static size_t mem_used;
+
+/* Time spent decoding in the current one second window. */
+static time_t cpu_window;
+static long long cpu_used_ns;
+
+static int start_decoding(http_decoder_t *d);
+static void stop_decoding(http_decoder_t *d);
+static size_t body_data(http_decoder_t *d, const unsigned char *data, size_t len);
+
+void http_decoder_set_limits(size_t flow, size_t mem, unsigned int cpu)
+{
+    flow_max = flow;
+    mem_max  = mem;
+    cpu_max  = cpu;
+}
+
+int http_decoder_enabled(void)
+{
+    return flow_max > 0;
+}
+
+http_decoder_t *http_decoder_new(void)
+{
+    http_decoder_t *d;
+
+    alloc_struct(http_decoder, d);
+    d->state = HTTP_DECODER_HEADER;
+
+    return d;
+}
+
+void http_decoder_delete(http_decoder_t *d)
+{
+    if (d == NULL)
+        return;
+
+    stop_decoding(d);
+    media_free_claims(&d->claims);
+
+    mem_used -= d->outalloc;
+    xfree(d->out);
+    xfree(d);
+}
+
+void http_decoder_next_message(http_decoder_t *d)
+{
+    stop_decoding(d);
+
+    d->outlen = 0;
+    d->msg_done = 0;
+    memset(d->moff, 0, sizeof d->moff);
+    media_free_claims(&d->claims);
+}
+
+/* now_ns:
+ * Monotonic time in nanoseconds. */
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* cpu_budget_left:
+ * Can we spend more time decoding in this second ? */
+static int cpu_budget_left(void)
+{
+    time_t now;
+
+    if (cpu_max == 0)
+        return TRUE;
+
+    now = time(NULL);
+
+    if (now != cpu_window) {
+        cpu_window = now;
+        cpu_used_ns = 0;
+    }
+
+    return cpu_used_ns < (long long)cpu_max * 1000000LL;
+}
+
+/* reserve_output DECODER
+ * Make sure there is some room in the output buffer. Returns FALSE if we hit
+ * one of the limits. */
+static int reserve_output(http_decoder_t *d)
+{
+    size_t alloc;
+
+    if (d->outalloc - d->outlen > 0)
+        return TRUE;
+
+    if (d->produced >= flow_max) {
+        log_msg(LOG_INFO, "http decoder: flow reached the %zu bytes limit", flow_max);
+        d->state = HTTP_DECODER_FAILED;
+        return FALSE;
+    }
+
+    alloc = d->outalloc ? d->outalloc * 2 : OUTPUT_CHUNK;
+    if (alloc > flow_max)
+        alloc = flow_max;
+
+    if (mem_used + alloc - d->outalloc > mem_max) {
+        log_msg(LOG_INFO, "http decoder: memory budget of %zu bytes exhausted", mem_max);
+        d->state = HTTP_DECODER_FAILED;
+        return FALSE;
+    }
+
+    d->out = xrealloc(d->out, alloc);
+    mem_used += alloc - d->outalloc;
+    d->outalloc = alloc;
+
+    return TRUE;
+}
+
+/* over_memory_budget DECODER COST
+ * Would we go over the memory budget with COST more bytes ? */
+static int over_memory_budget(http_decoder_t *d, size_t cost)
+{
+    if (mem_used + cost <= mem_max)
+        return FALSE;
+
+    log_msg(LOG_INFO, "http decoder: memory budget of %zu bytes exhausted", mem_max);
+    d->state = HTTP_DECODER_FAILED;
+
+    return TRUE;
+}
+
+/* start_decoding DECODER
+ * Set up the body of the current response for decoding: identity bodies are
+ * passed through, the others need a decompressor. */
+static int start_decoding(http_decoder_t *d)
+{
+    switch (d->resp.encoding) {
+        case HTTP_ENCODING_IDENTITY:
+            break;
+
+        case HTTP_ENCODING_GZIP:
+        case HTTP_ENCODING_DEFLATE: {
+            z_stream *z;
+
+            if (over_memory_budget(d, ZLIB_STATE_COST))
+                return FALSE;
+
+            z = xcalloc(1, sizeof *z);
+
+            /* 32: let zlib detect the gzip or zlib header. */
+            if (inflateInit2(z, 15 + 32) != Z_OK) {
+                xfree(z);
+                return FALSE;
+            }
+
+            mem_used += ZLIB_STATE_COST;
+            d->stream = z;
+            break;
+        }
+
+#ifdef HAVE_LIBBROTLIDEC
+        case HTTP_ENCODING_BROTLI:
+            if (over_memory_budget(d, BROTLI_STATE_COST))
+                return FALSE;
+
+            d->stream = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+            if (d->stream == NULL)
+                return FALSE;
+
+            mem_used += BROTLI_STATE_COST;
+            break;
+#endif
+
+        default:
+            return FALSE;
+    }
+
+    d->raw_deflate = FALSE;
+    d->decoding = TRUE;
+
+    return TRUE;
+}
+
+static void stop_decoding(http_decoder_t *d)
+{
+    if (d->stream == NULL) {
+        d->decoding = FALSE;
+        return;
+    }
+
+    switch (d->resp.encoding) {
+        case HTTP_ENCODING_GZIP:
+        case HTTP_ENCODING_DEFLATE:
+            inflateEnd(d->stream);
+            xfree(d->stream);
+            mem_used -= ZLIB_STATE_COST;
+            break;
+
+#ifdef HAVE_LIBBROTLIDEC
+        case HTTP_ENCODING_BROTLI:
+            BrotliDecoderDestroyInstance(d->stream);
+            mem_used -= BROTLI_STATE_COST;
+            break;
+#endif
+
+        default:
+            break;
+    }
+
+    d->stream = NULL;
+    d->decoding = FALSE;
+}
+
+/* inflate_data DECODER DATA LEN
+ * Run LEN bytes of a gzip/deflate body through zlib. Returns FALSE when we
+ * should stop decoding this body. */
+static int inflate_data(http_decoder_t *d, const unsigned char *data, size_t len)
+{
+    z_stream *z = d->stream;
+    int ret;
+
+    z->next_in = (Bytef*)data;
+    z->avail_in = len;
+
+    while (z->avail_in > 0) {
+        size_t avail;
+
+        if (!reserve_output(d))
+            return FALSE;
+
+        avail = d->outalloc - d->outlen;
+        z->next_out = d->out + d->outlen;
+        z->avail_out = avail;
+
+        ret = inflate(z, Z_NO_FLUSH);
+
+        d->outlen   += avail - z->avail_out;
+        d->produced += avail - z->avail_out;
+
+        if (ret == Z_STREAM_END)
+            return FALSE;
+
+        if (ret == Z_DATA_ERROR && d->resp.encoding == HTTP_ENCODING_DEFLATE
+                && !d->raw_deflate && z->total_out == 0) {
+            /* Some servers send deflate without the zlib wrapper. */
+            inflateEnd(z);
+            memset(z, 0, sizeof *z);
+
+            if (inflateInit2(z, -15) != Z_OK)
+                return FALSE;
+
+            d->raw_deflate = TRUE;
+            z->next_in = (Bytef*)data;
+            z->avail_in = len;
+            continue;
+        }
+
+        if (ret != Z_OK && ret != Z_BUF_ERROR)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+#ifdef HAVE_LIBBROTLIDEC
+/* brotli_data DECODER DATA LEN
+ * Run LEN bytes of a br body through the brotli decoder. */
+static int brotli_data(http_decoder_t *d, const unsigned char *data, size_t len)
+{
+    const uint8_t *next_in = data;
+    size_t avail_in = len;
+
+    do {
+        BrotliDecoderResult ret;
+        uint8_t *next_out;
+        size_t avail, avail_out;
+
+        if (!reserve_output(d))
+            return FALSE;
+
+        avail = avail_out = d->outalloc - d->outlen;
+        next_out = d->out + d->outlen;
+
+        ret = BrotliDecoderDecompressStream(d->stream, &avail_in, &next_in, &avail_out, &next_out, NULL);
+
+        d->outlen   += avail - avail_out;
+        d->produced += avail - avail_out;
+
+        if (ret == BROTLI_DECODER_RESULT_SUCCESS || ret == BROTLI_DECODER_RESULT_ERROR)
+            return FALSE;
+
+    } while (avail_in > 0 || BrotliDecoderHasMoreOutput(d->stream));
+
+    return TRUE;
+}
+#endif
+
+/* copy_data DECODER DATA LEN
+ * Pass LEN bytes of an identity body through. */
+static int copy_data(http_decoder_t *d, const unsigned char *data, size_t len)
+{
+    while (len > 0) {
+        size_t n;
+
+        if (!reserve_output(d))
+            return FALSE;
+
+        n = d->outalloc - d->outlen;
+        if (n > len)
+            n = len;
+
+        memcpy(d->out + d->outlen, data, n);
+        d->outlen   += n;
+        d->produced += n;
+        data += n;
+        len  -= n;
+    }
+
+    return TRUE;
+}
+
+/* body_data DECODER DATA LEN
+ * Handle LEN bytes of body data. Returns the number of bytes consumed, which
+ * can be less than LEN if we ran out of decoding time, or 0 if we ran out of
+ * memory. */
+static size_t body_data(http_decoder_t *d, const unsigned char *data, size_t len)
+{
+    long long start;
+    int more;
+
+    if (!d->decoding || len == 0)
+        return len;
+
+    if (d->stream == NULL)
+        return copy_data(d, data, len) ? len : 0;
+
+    if (!d->closing && !cpu_budget_left())
+        return 0;
+
+    start = now_ns();
+
+#ifdef HAVE_LIBBROTLIDEC
+    if (d->resp.encoding == HTTP_ENCODING_BROTLI)
+        more = brotli_data(d, data, len);
+    else
+#endif
+        more = inflate_data(d, data, len);
+
+    cpu_used_ns += now_ns() - start;
+
+    if (d->state == HTTP_DECODER_FAILED)
+        return 0;
+
+    if (!more)
+        stop_decoding(d);
+
+    return len;
+}
+
+/* find_line DATA LEN
+ * Length of the CRLF terminated line at DATA, including the CRLF; 0 if not
+ * complete yet or -1 if too long. */
+static long find_line(const unsigned char *data, size_t len)
+{
+    const unsigned char *le = memstr(data, len, (unsigned char*)"\r\n", 2);
+
+    if (!le)
+        return len > MAX_CHUNK_LINE ? -1 : 0;
+
+    return le + 2 - data;
+}
+
+/* end_message DECODER
+ * The current response is complete. */
+static void end_message(http_decoder_t *d)
+{
+    stop_decoding(d);
+    d->state = HTTP_DECODER_HEADER;
+    d->msg_done = TRUE;
+}
+
+/* start_message DECODER DATA LEN
+ * Parse a new response header. Returns the bytes consumed. */
+static size_t start_message(http_decoder_t *d, const unsigned char *data, size_t len)
+{
+    int ret = http_parse_response(data, len, &d->resp);
+
+    if (ret == 0)
+        return 0;
+
+    if (ret < 0) {
+        log_msg(LOG_DEBUG, "http decoder: lost the response framing");
+        d->state = HTTP_DECODER_FAILED;
+        return 0;
+    }
+
+    if (!http_response_has_body(&d->resp)) {
+        end_message(d);
+        return d->resp.header_len;
+    }
+
+    if (!start_decoding(d)) {
+        if (d->state == HTTP_DECODER_FAILED)
+            return 0;
+
+        log_msg(LOG_DEBUG, "http decoder: can't decode body (encoding %d)", d->resp.encoding);
+    }
+
+    if (d->resp.chunked) {
+        d->state = HTTP_DECODER_CHUNK_SIZE;
+
+    } else {
+        d->state = HTTP_DECODER_BODY;
+        d->remaining = d->resp.content_length;
+    }
+
+    return d->resp.header_len;
+}
+
+/* body_extent DECODER DATA LEN
+ * Consume the data of a body or a chunk. */
+static size_t body_extent(http_decoder_t *d, const unsigned char *data, size_t len)
+{
+    size_t n = len;
+
+    if (d->remaining >= 0 && (long long)n > d->remaining)
+        n = d->remaining;
+
+    n = body_data(d, data, n);
+
+    if (d->remaining >= 0)
+        d->remaining -= n;
+
+    return n;
+}
+
+size_t http_decoder_feed(http_decoder_t *d, const unsigned char *data, const size_t len)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = data + len;
+
+    while (p < end && !d->msg_done) {
+        size_t n = 0;
+        long line;
+
+        switch (d->state) {
+            case HTTP_DECODER_HEADER:
+                n = start_message(d, p, end - p);
+                break;
+
+            case HTTP_DECODER_BODY:
+                n = body_extent(d, p, end - p);
+                if (d->remaining == 0)
+                    end_message(d);
+                break;
+
+            case HTTP_DECODER_CHUNK_SIZE:
+                if ((line = find_line(p, end - p)) <= 0) {
+                    if (line < 0)
+                        d->state = HTTP_DECODER_FAILED;
+                    break;
+                }
+
+                if (!isxdigit(*p)) {
+                    d->state = HTTP_DECODER_FAILED;
+                    break;
+                }
+
+                d->remaining = strtoll((const char*)p, NULL, 16);
+                d->state = d->remaining > 0 ? HTTP_DECODER_CHUNK_DATA : HTTP_DECODER_TRAILER;
+                n = line;
+                break;
+
+            case HTTP_DECODER_CHUNK_DATA:
+                n = body_extent(d, p, end - p);
+                if (d->remaining == 0)
+                    d->state = HTTP_DECODER_CHUNK_END;
+                break;
+
+            case HTTP_DECODER_CHUNK_END:
+                if (end - p < 2)
+                    break;
+
+                if (memcmp(p, "\r\n", 2)) {
+                    d->state = HTTP_DECODER_FAILED;
+                    break;
+                }
+
+                d->state = HTTP_DECODER_CHUNK_SIZE;
+                n = 2;
+                break;
+
+            case HTTP_DECODER_TRAILER:
+                if ((line = find_line(p, end - p)) <= 0) {
+                    if (line < 0)
+                        d->state = HTTP_DECODER_FAILED;
+                    break;
+                }
+
+                /* an empty line ends the trailer */
+                if (line == 2)
+                    end_message(d);
+                n = line;
+                break;
+
+            case HTTP_DECODER_FAILED:
+                break;
+        }
+
+        if (n == 0)
+            break;
+
+        p += n;
+    }
+
+    d->off += p - data;
+
+    return p - data;
+}
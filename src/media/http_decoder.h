@@ -0,0 +1,164 @@
+/**
+ * @file http_decoder.h
+ *
+ * @brief Streaming decoding of HTTP response bodies.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 10:12:31 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __HTTP_DECODER_H__
+#define __HTTP_DECODER_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "media.h" /* NMEDIATYPES */
+#include "http.h"
+
+/**
+ * @brief Default limit of decoded bytes per flow.
+ */
+#define HTTP_DECODER_DEFAULT_FLOW_MAX   (8 * 1024 * 1024)
+
+/**
+ * @brief Default limit of memory used by all the decoders together.
+ */
+#define HTTP_DECODER_DEFAULT_MEM_MAX    (64 * 1024 * 1024)
+
+/**
+ * @brief Default decoding time allowed per second, in miliseconds.
+ */
+#define HTTP_DECODER_DEFAULT_CPU_MAX    250
+
+/**
+ * @brief Where we are in the HTTP stream.
+ */
+typedef enum {
+    /** Waiting for a complete response header */
+    HTTP_DECODER_HEADER = 0,
+
+    /** In a body delimited by Content-Length or by the connection close */
+    HTTP_DECODER_BODY,
+
+    /** Waiting for a chunk-size line */
+    HTTP_DECODER_CHUNK_SIZE,
+
+    /** In the data of a chunk */
+    HTTP_DECODER_CHUNK_DATA,
+
+    /** Waiting for the CRLF after the chunk data */
+    HTTP_DECODER_CHUNK_END,
+
+    /** In the trailer part of a chunked body */
+    HTTP_DECODER_TRAILER,
+
+    /** We lost track of the message framing or ran out of memory; the rest
+     * of the stream should be scanned as raw data */
+    HTTP_DECODER_FAILED
+} http_decoder_state_t;
+
+/**
+ * @brief Decoder state for one half of a TCP stream carrying HTTP responses.
+ */
+typedef struct http_decoder {
+    /** Where we are in the stream */
+    http_decoder_state_t state;
+
+    /** Stream bytes consumed so far */
+    size_t off;
+
+    /** Header of the current response */
+    http_response_t resp;
+
+    /** Bytes left in the current body or chunk; -1 if the body ends with the connection */
+    long long remaining;
+
+    /** Are we delivering the current body to out ? */
+    int decoding;
+
+    /** zlib or brotli state of the current body */
+    void *stream;
+
+    /** Did we retry the current deflate body as raw deflate ? */
+    int raw_deflate;
+
+    /** Decoded bytes produced by this flow */
+    size_t produced;
+
+    /** Decoded body of the current response */
+    unsigned char *out;
+    size_t outlen, outalloc;
+
+    /** Set when the current response is complete; see http_decoder_next_message() */
+    int msg_done;
+
+    /** Set by the caller when the stream is over: what is left is decoded
+     * whatever the time budget, as there won't be a later try */
+    int closing;
+
+    /** Scan offsets of each media driver in the decoded body */
+    int moff[NMEDIATYPES];
+
+    /** Regions of the decoded body already carved */
+    mediaclaim_t *claims;
+} http_decoder_t;
+
+/**
+ * @brief Configures the budgets shared by all the decoders.
+ *
+ * @param flow_max maximum decoded bytes per flow
+ * @param mem_max maximum memory used by all the decoders
+ * @param cpu_max maximum decoding time per second, in miliseconds (0 = unlimited)
+ */
+void http_decoder_set_limits(size_t flow_max, size_t mem_max, unsigned int cpu_max);
+
+/**
+ * @brief Tells whether body decoding is enabled (a flow_max of 0 disables it).
+ *
+ * @return TRUE if enabled, FALSE otherwise
+ */
+int http_decoder_enabled(void);
+
+/**
+ * @brief Creates a decoder for a new stream.
+ *
+ * @return the decoder (should be freed with http_decoder_delete)
+ */
+http_decoder_t *http_decoder_new(void);
+
+/**
+ * @brief Frees a decoder.
+ *
+ * @param d the decoder
+ */
+void http_decoder_delete(http_decoder_t *d);
+
+/**
+ * @brief Pushes stream data through the decoder.
+ *
+ * Decoded body bytes are appended to d->out. The decoder stops after the end
+ * of each response (setting d->msg_done) so the caller can look at the whole
+ * body before calling http_decoder_next_message().
+ *
+ * @param d the decoder
+ * @param data stream data, starting at offset d->off of the stream
+ * @param len length of data
+ * @return number of bytes consumed (0 when no progress can be made)
+ */
+size_t http_decoder_feed(http_decoder_t *d, const unsigned char *data, const size_t len);
+
+/**
+ * @brief Discards the decoded body of the finished response.
+ *
+ * @param d the decoder
+ */
+void http_decoder_next_message(http_decoder_t *d);
+
+#endif /* __HTTP_DECODER_H__ */
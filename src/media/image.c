@@ -15,6 +15,8 @@
 #include <stdio.h>
 #include <stdlib.h> /* On many systems (Darwin...), stdio.h is a prerequisite. */
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
 #include <byteswap.h>
 
 #ifdef __FreeBSD__
@@ -494,6 +496,90 @@ unsigned char *find_avif_image(const unsigned char *data, const size_t len, unsi
     return avifhdr;
 }
 
+/* probe_jpeg DATA LEN WIDTH HEIGHT
+ * Walk the JPEG segments up to the start of frame, which has the
+ * dimensions. */
+static int probe_jpeg(const unsigned char *data, const size_t len, int *width, int *height)
+{
+    const unsigned char *block = data + 2;
+    jpg_segment_t *segment;
+    unsigned int segment_lenght;
+
+    while (block + sizeof(jpg_segment_t) <= data + len) {
+        segment = (jpg_segment_t*) block;
+
+        if (segment->start_of_marker != 0xFF)
+            return 0;
+
+        switch (segment->marker_type) {
+            case SOF0:case SOF1:case SOF2:case SOF3:case SOF5:case SOF6:case SOF7:
+            case SOF9:case SOFA:case SOFB:case SOFD:case SOFE:case SOFF:
+                if (block + 9 > data + len)
+                    return 0;
+
+                *height = jpegcount(block + 5);
+                *width = jpegcount(block + 7);
+                return 1;
+
+            case SOS:
+            case EOI:
+                return 0;
+        }
+
+        segment_lenght = is_jpeg_segment(segment);
+        if (segment_lenght == 0)
+            return 0;
+
+        block += segment_lenght;
+    }
+
+    return 0;
+}
+
+int image_probe(const unsigned char *data, const size_t len, int *width, int *height)
+{
+    *width = *height = 0;
+
+    if (data == NULL || len < 24)
+        return 0;
+
+    /* GIF: logical screen descriptor, little endian */
+    if (!memcmp(data, "GIF87a", 6) || !memcmp(data, "GIF89a", 6)) {
+        *width = data[6] | (data[7] << 8);
+        *height = data[8] | (data[9] << 8);
+
+    /* PNG: the IHDR chunk comes first, big endian */
+    } else if (!memcmp(data, "\x89\x50\x4e\x47\x0d\x0a\x1a\x0a", PNG_SIG_LEN)) {
+        uint32_t w, h;
+
+        if (memcmp(data + 12, "IHDR", 4))
+            return 0;
+
+        w = ((uint32_t)data[16] << 24) | ((uint32_t)data[17] << 16) | ((uint32_t)data[18] << 8) | data[19];
+        h = ((uint32_t)data[20] << 24) | ((uint32_t)data[21] << 16) | ((uint32_t)data[22] << 8) | data[23];
+
+        /* the format caps them at 2^31 - 1, anything above is garbage */
+        if (w > INT_MAX || h > INT_MAX)
+            return 0;
+
+        *width = (int)w;
+        *height = (int)h;
+
+    } else if (data[0] == 0xFF && data[1] == 0xD8) {
+        if (!probe_jpeg(data, len, width, height))
+            return 0;
+
+    } else if (!memcmp(data, "RIFF", 4) && !memcmp(data + 8, "WEBP", 4)) {
+        /* only parses the headers */
+        if (!WebPGetInfo(data, len, width, height))
+            return 0;
+
+    } else
+        return 0;
+
+    return *width > 0 && *height > 0;
+}
+
 
 #if 0
 #include <unistd.h>
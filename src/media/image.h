@@ -30,4 +30,10 @@ unsigned char *find_webp_image(const unsigned char *data, const size_t len,
 unsigned char *find_avif_image(const unsigned char *data, const size_t len,
         unsigned char **avifdata, size_t *aviflen);
 
+/* image_probe DATA LEN WIDTH HEIGHT
+ * Read the dimensions of the GIF, PNG, JPEG or WebP image in the LEN bytes
+ * of DATA from its header, without decoding it. Returns 1 on success or 0
+ * if the header can't be parsed. */
+int image_probe(const unsigned char *data, const size_t len, int *width, int *height);
+
 #endif /* __IMAGE_H__ */
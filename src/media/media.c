@@ -39,6 +39,38 @@ static mediadrv_t media_drivers[NMEDIATYPES] = {
     { "HTTP", MEDIATYPE_TEXT,  find_http_req }
 };
 
+/*
+ * Drivers for the content types of HTTP bodies. Entries are matched by
+ * prefix, in order; a NULL driver marks content types carrying no media.
+ */
+static const struct {
+    const char *content_type;
+    const char *driver;
+} content_type_drivers[] = {
+    { "image/gif",                "gif" },
+    { "image/jpeg",               "jpeg" },
+    { "image/jpg",                "jpeg" },
+    { "image/pjpeg",              "jpeg" },
+    { "image/png",                "png" },
+    { "image/apng",               "png" },
+    { "image/x-png",              "png" },
+    { "image/webp",               "webp" },
+    { "audio/mpeg",               "mpeg" },
+    { "audio/mp3",                "mpeg" },
+    { "audio/x-mpeg",             "mpeg" },
+    { "image/svg",                NULL },
+    { "text/",                    NULL },
+    { "font/",                    NULL },
+    { "application/font-",        NULL },
+    { "application/json",         NULL },
+    { "application/javascript",   NULL },
+    { "application/x-javascript", NULL },
+    { "application/xml",          NULL },
+    { "application/wasm",         NULL }
+};
+
+#define NCONTENTTYPES (sizeof content_type_drivers / sizeof content_type_drivers[0])
+
 
 drivers_t* get_drivers_for_mediatype(mediatype_t type)
 {
@@ -68,6 +100,17 @@ drivers_t* get_drivers_for_mediatype(mediatype_t type)
     return drivers;
 }
 
+mediatype_t get_mediatype_by_name(const char *mname)
+{
+    for (int i = 0; i < NMEDIATYPES; ++i) {
+        if (strcmp(media_drivers[i].name, mname) == 0) {
+            return media_drivers[i].type;
+        }
+    }
+
+    return 0;
+}
+
 void close_media_drivers(drivers_t* drivers)
 {
     if (drivers == NULL) {
@@ -77,3 +120,94 @@ void close_media_drivers(drivers_t* drivers)
     xfree(drivers->list);
     xfree(drivers);
 }
+
+unsigned int get_drivers_mask_for_content_type(const drivers_t* drivers, const char* content_type)
+{
+    unsigned int mask = 0;
+
+    if (content_type == NULL || *content_type == '\0') {
+        return DRIVERS_MASK_ALL;
+    }
+
+    for (size_t i = 0; i < NCONTENTTYPES; ++i) {
+        if (strncmp(content_type, content_type_drivers[i].content_type, strlen(content_type_drivers[i].content_type))) {
+            continue;
+        }
+
+        if (content_type_drivers[i].driver == NULL) {
+            return 0;
+        }
+
+        for (int j = 0; j < drivers->count; ++j) {
+            if (!strcmp(drivers->list[j]->name, content_type_drivers[i].driver)) {
+                mask |= 1U << j;
+            }
+        }
+
+        return mask;
+    }
+
+    return DRIVERS_MASK_ALL;
+}
+
+void media_claim(mediaclaim_t **claims, size_t off, size_t len)
+{
+    mediaclaim_t **pc, *c;
+
+    if (len == 0) {
+        return;
+    }
+
+    for (pc = claims; *pc && (*pc)->off + (*pc)->len < off; pc = &(*pc)->next);
+
+    if (*pc && (*pc)->off <= off + len) {
+        /* overlaps or touches an existing region: merge them */
+        c = *pc;
+        if (off < c->off) {
+            c->len += c->off - off;
+            c->off = off;
+        }
+        if (off + len > c->off + c->len) {
+            c->len = off + len - c->off;
+        }
+
+        while (c->next && c->next->off <= c->off + c->len) {
+            mediaclaim_t *n = c->next;
+
+            if (n->off + n->len > c->off + c->len) {
+                c->len = n->off + n->len - c->off;
+            }
+            c->next = n->next;
+            xfree(n);
+        }
+
+        return;
+    }
+
+    alloc_struct(mediaclaim, c);
+    c->off = off;
+    c->len = len;
+    c->next = *pc;
+    *pc = c;
+}
+
+const mediaclaim_t *media_next_claim(const mediaclaim_t *claims, size_t off)
+{
+    for (; claims; claims = claims->next) {
+        if (claims->off + claims->len > off) {
+            return claims;
+        }
+    }
+
+    return NULL;
+}
+
+void media_free_claims(mediaclaim_t **claims)
+{
+    while (*claims) {
+        mediaclaim_t *n = (*claims)->next;
+
+        xfree(*claims);
+        *claims = n;
+    }
+}
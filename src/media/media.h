@@ -22,6 +22,8 @@
 #endif
 
 #include <stddef.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 
 /**
  * @brief Number of media types we recognize.
@@ -39,6 +41,17 @@ typedef enum mediatype {
     MEDIATYPE_TEXT  = 1 << 2
 } mediatype_t;
 
+/**
+ * @brief Where and when a media object was captured.
+ */
+typedef struct mediameta {
+    /** Source/destination address/port of the stream it came from */
+    struct sockaddr_storage src, dst;
+
+    /** Capture time of the segment that completed it */
+    struct timeval ts;
+} mediameta_t;
+
 /**
  * @brief Info for each media driver.
  */
@@ -53,7 +66,7 @@ typedef struct mediadrv {
     unsigned char *(*find_data)(const unsigned char *data, const size_t len, unsigned char **found, size_t *foundlen);
 
     /** Pointer to function to dispatch this type of media; this should be initialized by the user */
-    void (*dispatch_data)(const char *mname, const unsigned char *data, const size_t len);
+    void (*dispatch_data)(const char *mname, const unsigned char *data, const size_t len, const mediameta_t *meta);
 } mediadrv_t;
 
 /**
@@ -65,6 +78,19 @@ typedef struct drivers {
     int count;
 } drivers_t;
 
+/**
+ * @brief A region of a buffer already carved by a driver.
+ */
+typedef struct mediaclaim {
+    size_t off, len;
+    struct mediaclaim *next;
+} mediaclaim_t;
+
+/**
+ * @brief Mask selecting every driver of a drivers list.
+ */
+#define DRIVERS_MASK_ALL    (~0U)
+
 /**
  * @brief Obtains a list of media drivers.
  *
@@ -73,6 +99,14 @@ typedef struct drivers {
  */
 drivers_t* get_drivers_for_mediatype(mediatype_t type);
 
+/**
+ * @brief Finds the media type of a driver.
+ *
+ * @param mname driver (media) name: gif, jpeg ...
+ * @return its media type, or 0 if there is no such driver
+ */
+mediatype_t get_mediatype_by_name(const char *mname);
+
 /**
  * @brief Frees from memory the drivers list.
  *
@@ -81,4 +115,42 @@ drivers_t* get_drivers_for_mediatype(mediatype_t type);
  */
 void close_media_drivers(drivers_t* drivers);
 
+/**
+ * @brief Selects the drivers that apply to data of a given content type.
+ *
+ * Bit i of the returned mask stands for drivers->list[i]. Content types we
+ * know carry no media (text, scripts, fonts ...) get an empty mask; unknown
+ * or missing ones get DRIVERS_MASK_ALL, so the data is fully scanned.
+ *
+ * @param drivers the list
+ * @param content_type the lowercase media type (e.g.: image/png), can be empty
+ * @return mask of the drivers to run
+ */
+unsigned int get_drivers_mask_for_content_type(const drivers_t* drivers, const char* content_type);
+
+/**
+ * @brief Records a carved region, so other drivers can skip it.
+ *
+ * @param claims the list of claimed regions, sorted by offset
+ * @param off offset of the region
+ * @param len length of the region
+ */
+void media_claim(mediaclaim_t **claims, size_t off, size_t len);
+
+/**
+ * @brief Finds the first claimed region ending after an offset.
+ *
+ * @param claims the list of claimed regions
+ * @param off the offset
+ * @return the region or NULL if there is none
+ */
+const mediaclaim_t *media_next_claim(const mediaclaim_t *claims, size_t off);
+
+/**
+ * @brief Frees a list of claimed regions.
+ *
+ * @param claims the list (set to NULL)
+ */
+void media_free_claims(mediaclaim_t **claims);
+
 #endif /* __MEDIA_H__ */
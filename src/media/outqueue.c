@@ -0,0 +1,305 @@
+/**
+ * @file outqueue.c
+ *
+ * @brief Asynchronous output of the carved media.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 14:02:18 +0200
+ *
+ * The drivers find media on the capture thread, but writing it out (disk,
+ * display pipe, websockets) can stall for a long time. So the images are
+ * copied to a bounded FIFO, and a pool of writer threads takes them to the
+ * dispatch functions. When the FIFO is full we block or drop, as asked.
+ *
+ * Each writer takes several items at once and dispatches them inside a
+ * tmpfile batch, so their files are written together; the items are kept
+ * until the batch is flushed.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "common/util.h"
+#include "common/log.h"
+#include "common/tmpdir.h"
+#include "common/metrics.h"
+
+#include "outqueue.h"
+
+/* Items taken at once by a writer. */
+#define WRITER_BATCH_MAX    32
+
+typedef struct outitem {
+    void (*dispatch_data)(const char *mname, const unsigned char *data, const size_t len, const mediameta_t *meta);
+    const char *mname;
+    unsigned char *data;
+    size_t len;
+    mediameta_t meta;
+    struct outitem *next;
+} outitem_t;
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty, not_full;
+
+    outitem_t *head, *tail;
+
+    size_t max_bytes;
+    outqueue_policy_t policy;
+
+    pthread_t *threads;
+    int nthreads;
+    atomic_int running;         /* read out of the lock by the dispatch */
+    int stopping;
+    int queue_all;              /* not only the images */
+
+    outqueue_stats_t stats;
+} q = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
+
+static void *writer_thread(void *arg);
+
+/* write_metrics FP
+ * Writes the depth and the counters of the queue. */
+static void write_metrics(FILE *fp)
+{
+    outqueue_stats_t stats;
+
+    outqueue_get_stats(&stats);
+
+    metrics_write_value(fp, "driftnet_queue_bytes", "gauge",
+            "Bytes of the images waiting for the writer threads.", stats.queued_bytes);
+    metrics_write_value(fp, "driftnet_queue_queued_total", "counter",
+            "Images queued for the writer threads.", stats.queued);
+    metrics_write_value(fp, "driftnet_queue_dispatched_total", "counter",
+            "Images dispatched by the writer threads.", stats.dispatched);
+    metrics_write_value(fp, "driftnet_queue_dropped_total", "counter",
+            "Images dropped because the queue was full.", stats.dropped);
+}
+
+int outqueue_start(int threads, size_t max_bytes, outqueue_policy_t policy)
+{
+    if (threads <= 0)
+        return TRUE;
+
+    metrics_add_collector(write_metrics);
+
+    q.max_bytes = max_bytes;
+    q.policy = policy;
+    q.threads = xcalloc(threads, sizeof(pthread_t));
+    q.stopping = FALSE;
+
+    for (q.nthreads = 0; q.nthreads < threads; ++q.nthreads) {
+        if (pthread_create(&q.threads[q.nthreads], NULL, writer_thread, NULL) != 0) {
+            log_msg(LOG_ERROR, "can't create writer thread");
+            outqueue_stop();
+            return FALSE;
+        }
+    }
+
+    atomic_store(&q.running, TRUE);
+
+    return TRUE;
+}
+
+void outqueue_queue_all(int all)
+{
+    q.queue_all = all;
+}
+
+void outqueue_stop(void)
+{
+    int i;
+
+    pthread_mutex_lock(&q.mutex);
+    q.stopping = TRUE;
+    pthread_cond_broadcast(&q.not_empty);
+    pthread_cond_broadcast(&q.not_full);
+    pthread_mutex_unlock(&q.mutex);
+
+    for (i = 0; i < q.nthreads; ++i)
+        pthread_join(q.threads[i], NULL);
+
+    xfree(q.threads);
+    q.threads = NULL;
+    q.nthreads = 0;
+    atomic_store(&q.running, FALSE);
+}
+
+static void free_item(outitem_t *item)
+{
+    xfree(item->data);
+    xfree(item);
+}
+
+/* pop_item:
+ * Take the oldest item of the queue; must be called with the mutex held. */
+static outitem_t *pop_item(void)
+{
+    outitem_t *item = q.head;
+
+    q.head = item->next;
+    if (!q.head)
+        q.tail = NULL;
+
+    q.stats.queued_bytes -= item->len;
+    pthread_cond_signal(&q.not_full);
+
+    return item;
+}
+
+/* writer_thread:
+ * Dispatch the queued items until we are stopped and the queue is empty. */
+static void *writer_thread(void *arg)
+{
+    outitem_t *items[WRITER_BATCH_MAX];
+
+    for (;;) {
+        int i, n = 0;
+
+        pthread_mutex_lock(&q.mutex);
+
+        while (!q.head && !q.stopping)
+            pthread_cond_wait(&q.not_empty, &q.mutex);
+
+        while (q.head && n < WRITER_BATCH_MAX)
+            items[n++] = pop_item();
+
+        pthread_mutex_unlock(&q.mutex);
+
+        if (n == 0)
+            break;
+
+        tmpfile_batch_begin();
+
+        for (i = 0; i < n; ++i)
+            items[i]->dispatch_data(items[i]->mname, items[i]->data, items[i]->len, &items[i]->meta);
+
+        tmpfile_batch_flush();
+
+        pthread_mutex_lock(&q.mutex);
+        q.stats.dispatched += n;
+        pthread_mutex_unlock(&q.mutex);
+
+        for (i = 0; i < n; ++i)
+            free_item(items[i]);
+    }
+
+    tmpfile_batch_release();
+
+    return NULL;
+}
+
+/* make_room LEN
+ * Apply the overflow policy until LEN more bytes fit in the queue; must be
+ * called with the mutex held. Returns FALSE if the new item must be
+ * dropped. */
+static int make_room(size_t len)
+{
+    while (q.stats.queued_bytes + len > q.max_bytes && q.head && !q.stopping) {
+        switch (q.policy) {
+            case OUTQUEUE_BLOCK:
+                pthread_cond_wait(&q.not_full, &q.mutex);
+                break;
+
+            case OUTQUEUE_DROP_NEWEST:
+                return FALSE;
+
+            case OUTQUEUE_DROP_OLDEST:
+                free_item(pop_item());
+                ++q.stats.dropped;
+                break;
+        }
+    }
+
+    /* bigger than the whole queue */
+    if (q.stats.queued_bytes + len > q.max_bytes || q.stopping)
+        return FALSE;
+
+    return TRUE;
+}
+
+void outqueue_dispatch(const mediadrv_t *driver, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    outitem_t *item;
+
+    if (!atomic_load(&q.running) || (driver->type != MEDIATYPE_IMAGE && !q.queue_all)) {
+        driver->dispatch_data(driver->name, data, len, meta);
+        return;
+    }
+
+    pthread_mutex_lock(&q.mutex);
+
+    if (!make_room(len)) {
+        ++q.stats.dropped;
+        pthread_mutex_unlock(&q.mutex);
+        log_msg(LOG_DEBUG, "output queue full: dropping %s image of %zu bytes", driver->name, len);
+        return;
+    }
+
+    /* reserve the room before copying, out of the lock */
+    q.stats.queued_bytes += len;
+    pthread_mutex_unlock(&q.mutex);
+
+    alloc_struct(outitem, item);
+    item->dispatch_data = driver->dispatch_data;
+    item->mname = driver->name;
+    item->data = xmalloc(len);
+    item->len = len;
+    item->meta = *meta;
+    memcpy(item->data, data, len);
+
+    pthread_mutex_lock(&q.mutex);
+
+    /* stopped meanwhile: the writers may be gone, so write it here */
+    if (q.stopping) {
+        q.stats.queued_bytes -= item->len;
+        pthread_mutex_unlock(&q.mutex);
+
+        item->dispatch_data(item->mname, item->data, item->len, &item->meta);
+        free_item(item);
+        return;
+    }
+
+    if (q.tail)
+        q.tail->next = item;
+    else
+        q.head = item;
+    q.tail = item;
+
+    ++q.stats.queued;
+    if (q.stats.queued_bytes > q.stats.peak_bytes)
+        q.stats.peak_bytes = q.stats.queued_bytes;
+
+    pthread_cond_signal(&q.not_empty);
+    pthread_mutex_unlock(&q.mutex);
+}
+
+void outqueue_get_stats(outqueue_stats_t *stats)
+{
+    pthread_mutex_lock(&q.mutex);
+    *stats = q.stats;
+    pthread_mutex_unlock(&q.mutex);
+}
+
+int outqueue_parse_policy(const char *name, outqueue_policy_t *policy)
+{
+    if (!strcmp(name, "block"))
+        *policy = OUTQUEUE_BLOCK;
+    else if (!strcmp(name, "drop-newest"))
+        *policy = OUTQUEUE_DROP_NEWEST;
+    else if (!strcmp(name, "drop-oldest"))
+        *policy = OUTQUEUE_DROP_OLDEST;
+    else
+        return FALSE;
+
+    return TRUE;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file outqueue.h
+ *
+ * @brief Asynchronous output of the carved media.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 14:02:18 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __OUTQUEUE_H__
+#define __OUTQUEUE_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "media.h"
+
+/**
+ * @brief Default number of writer threads.
+ */
+#define OUTQUEUE_DEFAULT_THREADS    1
+
+/**
+ * @brief Default limit of bytes waiting in the queue.
+ */
+#define OUTQUEUE_DEFAULT_MAX_BYTES  (32 * 1024 * 1024)
+
+/**
+ * @brief What to do when the queue is full.
+ */
+typedef enum {
+    /** Wait for the writers (stalls the capture) */
+    OUTQUEUE_BLOCK = 0,
+
+    /** Drop the new object */
+    OUTQUEUE_DROP_NEWEST,
+
+    /** Drop the oldest queued objects to make room */
+    OUTQUEUE_DROP_OLDEST
+} outqueue_policy_t;
+
+/**
+ * @brief Queue counters.
+ */
+typedef struct {
+    /** Bytes waiting in the queue, now and at most */
+    size_t queued_bytes, peak_bytes;
+
+    /** Objects queued and dispatched so far */
+    unsigned long queued, dispatched;
+
+    /** Objects dropped because the queue was full */
+    unsigned long dropped;
+} outqueue_stats_t;
+
+/**
+ * @brief Starts the writer threads.
+ *
+ * @param threads number of writer threads (0 keeps dispatching on the caller thread)
+ * @param max_bytes maximum bytes waiting in the queue
+ * @param policy what to do when the queue is full
+ * @return TRUE on success, FALSE otherwise
+ */
+int outqueue_start(int threads, size_t max_bytes, outqueue_policy_t policy);
+
+/**
+ * @brief Queues every media, not only the images, for the writer threads.
+ *
+ * For outputs where the order of the objects doesn't matter, like the
+ * archive, whose records stand on their own. Call before outqueue_start().
+ *
+ * @param all TRUE to queue every media
+ */
+void outqueue_queue_all(int all);
+
+/**
+ * @brief Dispatches what is still queued and stops the writer threads.
+ */
+void outqueue_stop(void);
+
+/**
+ * @brief Hands a carved object to its driver dispatch function.
+ *
+ * Images are copied and queued for the writer threads; other media (whose
+ * order matters, like audio frames) are dispatched right away, unless
+ * outqueue_queue_all() was asked for.
+ *
+ * @param driver the driver which found the object
+ * @param data the object
+ * @param len size of the object
+ */
+void outqueue_dispatch(const mediadrv_t *driver, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
+
+/**
+ * @brief Gets the queue counters.
+ *
+ * @param stats where to store them
+ */
+void outqueue_get_stats(outqueue_stats_t *stats);
+
+/**
+ * @brief Parses a policy name: block, drop-newest or drop-oldest.
+ *
+ * @param name the policy name
+ * @param policy where to store the policy
+ * @return TRUE if valid, FALSE otherwise
+ */
+int outqueue_parse_policy(const char *name, outqueue_policy_t *policy);
+
+#endif /* __OUTQUEUE_H__ */
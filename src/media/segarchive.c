@@ -0,0 +1,371 @@
+/**
+ * @file segarchive.c
+ *
+ * @brief Archive of carved media in big, append-only segment files.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 15:02:47 +0200
+ *
+ * Appending the objects to a few big files turns lots of small random
+ * writes into sequential ones. Each segment has a sidecar index with a copy
+ * of the header of each record, small enough to be scanned by time, host or
+ * type without touching the segment.
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common/util.h"
+#include "common/log.h"
+
+#include "segarchive.h"
+
+#define SEGMENT_MAGIC   "DRIFTSEG"
+#define INDEX_MAGIC     "DRIFTIDX"
+#define RECORD_MAGIC    "DREC"
+#define FORMAT_VERSION  1
+
+/* Buffers of the segment and index files. */
+#define SEGMENT_BUFFER  (1024 * 1024)
+#define INDEX_BUFFER    (64 * 1024)
+
+static struct {
+    pthread_mutex_t mutex;
+
+    char *dir;
+    size_t segment_max;
+
+    /* current segment, its index, and their names */
+    FILE *seg, *idx;
+    char *seg_path, *idx_path;
+    uint64_t seg_len;
+
+    /* segments are named after the time we started and a sequence number */
+    time_t stamp;
+    unsigned int seq;
+} archive = { PTHREAD_MUTEX_INITIALIZER };
+
+static void put_u16(unsigned char *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    put_u16(p, v);
+    put_u16(p + 2, v >> 16);
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+    put_u32(p, v);
+    put_u32(p + 4, v >> 32);
+}
+
+static uint16_t get_u16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+    return get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+void segrec_encode(const segrec_t *rec, unsigned char buf[SEGREC_LEN])
+{
+    memset(buf, 0, SEGREC_LEN);
+
+    memcpy(buf, RECORD_MAGIC, 4);
+    put_u32(buf + 4, rec->ts_usec);
+    put_u64(buf + 8, rec->offset);
+    put_u64(buf + 16, rec->len);
+    put_u64(buf + 24, (uint64_t)rec->ts_sec);
+    put_u64(buf + 32, rec->hash);
+    memcpy(buf + 40, rec->type, sizeof rec->type);
+    memcpy(buf + 48, rec->src, 16);
+    memcpy(buf + 64, rec->dst, 16);
+    put_u16(buf + 80, rec->sport);
+    put_u16(buf + 82, rec->dport);
+    put_u32(buf + 84, rec->width);
+    put_u32(buf + 88, rec->height);
+    buf[92] = rec->family;
+}
+
+/* segrec_decode BUF REC
+ * Parses a record header; returns FALSE if it doesn't look like one. */
+static int segrec_decode(const unsigned char *buf, segrec_t *rec)
+{
+    if (memcmp(buf, RECORD_MAGIC, 4) != 0)
+        return FALSE;
+
+    rec->ts_usec = get_u32(buf + 4);
+    rec->offset = get_u64(buf + 8);
+    rec->len = get_u64(buf + 16);
+    rec->ts_sec = (int64_t)get_u64(buf + 24);
+    rec->hash = get_u64(buf + 32);
+    memcpy(rec->type, buf + 40, sizeof rec->type);
+    rec->type[sizeof rec->type - 1] = '\0';
+    memcpy(rec->src, buf + 48, 16);
+    memcpy(rec->dst, buf + 64, 16);
+    rec->sport = get_u16(buf + 80);
+    rec->dport = get_u16(buf + 82);
+    rec->width = get_u32(buf + 84);
+    rec->height = get_u32(buf + 88);
+    rec->family = buf[92];
+
+    return TRUE;
+}
+
+int segrec_read(FILE *f, segrec_t *rec)
+{
+    unsigned char buf[SEGREC_LEN];
+    size_t n = fread(buf, 1, SEGREC_LEN, f);
+
+    if (n == 0)
+        return 0;
+
+    if (n < SEGREC_LEN || !segrec_decode(buf, rec))
+        return -1;
+
+    return 1;
+}
+
+/* copy_addr SOCKADDR ADDR PORT
+ * Copies the address and port of SOCKADDR; returns the family as 4 or 6, or
+ * 0 if unknown. */
+static uint8_t copy_addr(const struct sockaddr_storage *ss, uint8_t *addr, uint16_t *port)
+{
+    if (ss->ss_family == AF_INET) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in*)ss;
+
+        memcpy(addr, &sin->sin_addr, 4);
+        *port = ntohs(sin->sin_port);
+        return 4;
+
+    } else if (ss->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6*)ss;
+
+        memcpy(addr, &sin6->sin6_addr, 16);
+        *port = ntohs(sin6->sin6_port);
+        return 6;
+    }
+
+    return 0;
+}
+
+void segrec_init(segrec_t *rec, const char *mname, size_t len, const mediameta_t *meta)
+{
+    memset(rec, 0, sizeof *rec);
+
+    rec->len = len;
+    snprintf(rec->type, sizeof rec->type, "%s", mname);
+
+    if (meta) {
+        rec->ts_sec = meta->ts.tv_sec;
+        rec->ts_usec = meta->ts.tv_usec;
+        rec->family = copy_addr(&meta->src, rec->src, &rec->sport);
+        copy_addr(&meta->dst, rec->dst, &rec->dport);
+    }
+}
+
+char *segrec_addr(const segrec_t *rec, int dst, char *buf, size_t len)
+{
+    char addr[INET6_ADDRSTRLEN];
+
+    if (rec->family == 0
+            || !inet_ntop(rec->family == 4 ? AF_INET : AF_INET6, dst ? rec->dst : rec->src, addr, sizeof addr)) {
+        snprintf(buf, len, "?");
+        return buf;
+    }
+
+    snprintf(buf, len, rec->family == 4 ? "%s:%u" : "[%s]:%u", addr, dst ? rec->dport : rec->sport);
+
+    return buf;
+}
+
+/* write_file_header FILE MAGIC
+ * Writes the header of a segment or index file. */
+static int write_file_header(FILE *f, const char *magic)
+{
+    unsigned char hdr[SEGARCHIVE_FILE_HDR_LEN] = { 0 };
+
+    memcpy(hdr, magic, 8);
+    put_u32(hdr + 8, FORMAT_VERSION);
+
+    return fwrite(hdr, sizeof hdr, 1, f) == 1;
+}
+
+FILE *segarchive_open_file(const char *path, int index)
+{
+    unsigned char hdr[SEGARCHIVE_FILE_HDR_LEN];
+    FILE *f;
+
+    if (!(f = fopen(path, "rb")))
+        return NULL;
+
+    if (fread(hdr, sizeof hdr, 1, f) != 1
+            || memcmp(hdr, index ? INDEX_MAGIC : SEGMENT_MAGIC, 8) != 0
+            || get_u32(hdr + 8) != FORMAT_VERSION) {
+        log_msg(LOG_ERROR, "%s: not a driftnet %s", path, index ? "index" : "segment");
+        fclose(f);
+        return NULL;
+    }
+
+    return f;
+}
+
+/* close_segment
+ * Closes the current segment and its index, if any. */
+static void close_segment(void)
+{
+    if (archive.seg && fclose(archive.seg) != 0)
+        log_msg(LOG_ERROR, "%s: %s", archive.seg_path, strerror(errno));
+
+    if (archive.idx && fclose(archive.idx) != 0)
+        log_msg(LOG_ERROR, "%s: %s", archive.idx_path, strerror(errno));
+
+    archive.seg = archive.idx = NULL;
+
+    xfree(archive.seg_path);
+    xfree(archive.idx_path);
+    archive.seg_path = archive.idx_path = NULL;
+}
+
+/* new_segment
+ * Closes the current segment and starts the next one. */
+static int new_segment(void)
+{
+    char name[64];
+
+    close_segment();
+
+    snprintf(name, sizeof name, "driftnet-%lu-%04u"SEGARCHIVE_SEGMENT_EXT,
+            (unsigned long)archive.stamp, archive.seq++);
+
+    archive.seg_path = compose_path(archive.dir, name);
+    archive.idx_path = xmalloc(strlen(archive.seg_path) + strlen(SEGARCHIVE_INDEX_EXT) + 1);
+    sprintf(archive.idx_path, "%s"SEGARCHIVE_INDEX_EXT, archive.seg_path);
+
+    if (!(archive.seg = fopen(archive.seg_path, "wbx"))) {
+        log_msg(LOG_ERROR, "%s: %s", archive.seg_path, strerror(errno));
+        return FALSE;
+    }
+
+    if (!(archive.idx = fopen(archive.idx_path, "wbx"))) {
+        log_msg(LOG_ERROR, "%s: %s", archive.idx_path, strerror(errno));
+        return FALSE;
+    }
+
+    setvbuf(archive.seg, NULL, _IOFBF, SEGMENT_BUFFER);
+    setvbuf(archive.idx, NULL, _IOFBF, INDEX_BUFFER);
+
+    if (!write_file_header(archive.seg, SEGMENT_MAGIC) || !write_file_header(archive.idx, INDEX_MAGIC)) {
+        log_msg(LOG_ERROR, "%s: %s", archive.seg_path, strerror(errno));
+        return FALSE;
+    }
+
+    archive.seg_len = SEGARCHIVE_FILE_HDR_LEN;
+
+    log_msg(LOG_INFO, "archiving to segment %s", archive.seg_path);
+
+    return TRUE;
+}
+
+int segarchive_open(const char *dir, size_t segment_max)
+{
+    pthread_mutex_lock(&archive.mutex);
+
+    archive.dir = xstrdup(dir);
+    archive.segment_max = segment_max;
+    archive.stamp = time(NULL);
+    archive.seq = 0;
+
+    /* so we fail early if the directory is not usable */
+    if (!new_segment()) {
+        close_segment();
+        pthread_mutex_unlock(&archive.mutex);
+        return FALSE;
+    }
+
+    pthread_mutex_unlock(&archive.mutex);
+
+    return TRUE;
+}
+
+void segarchive_close(void)
+{
+    pthread_mutex_lock(&archive.mutex);
+
+    close_segment();
+
+    xfree(archive.dir);
+    archive.dir = NULL;
+
+    pthread_mutex_unlock(&archive.mutex);
+}
+
+int segarchive_append(segrec_t *rec, const unsigned char *data)
+{
+    unsigned char hdr[SEGREC_LEN];
+    int ok = TRUE;
+
+    pthread_mutex_lock(&archive.mutex);
+
+    if (!archive.dir) {
+        pthread_mutex_unlock(&archive.mutex);
+        return FALSE;
+    }
+
+    /* a record never spans segments; a big one gets a segment of its own */
+    if (!archive.seg
+            || (archive.seg_len > SEGARCHIVE_FILE_HDR_LEN
+                && archive.seg_len + SEGREC_LEN + rec->len > archive.segment_max)) {
+        if (!new_segment()) {
+            close_segment();
+            pthread_mutex_unlock(&archive.mutex);
+            return FALSE;
+        }
+    }
+
+    rec->offset = archive.seg_len + SEGREC_LEN;
+    segrec_encode(rec, hdr);
+
+    if (fwrite(hdr, SEGREC_LEN, 1, archive.seg) != 1
+            || (rec->len && fwrite(data, rec->len, 1, archive.seg) != 1)) {
+        log_msg(LOG_ERROR, "%s: %s", archive.seg_path, strerror(errno));
+        ok = FALSE;
+
+    } else if (fwrite(hdr, SEGREC_LEN, 1, archive.idx) != 1) {
+        log_msg(LOG_ERROR, "%s: %s", archive.idx_path, strerror(errno));
+        ok = FALSE;
+    }
+
+    if (ok) {
+        archive.seg_len += SEGREC_LEN + rec->len;
+
+    } else {
+        /* the segment may be left with a partial record; go on in a new one */
+        close_segment();
+    }
+
+    pthread_mutex_unlock(&archive.mutex);
+
+    return ok;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file segarchive.h
+ *
+ * @brief Archive of carved media in big, append-only segment files.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 15:02:47 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __SEGARCHIVE_H__
+#define __SEGARCHIVE_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "media.h" /* for mediameta_t */
+
+/**
+ * @brief Default size of a segment before starting the next one.
+ */
+#define SEGARCHIVE_DEFAULT_SEGMENT_MAX  (256 * 1024 * 1024)
+
+/**
+ * @brief Size of the header at the start of segment and index files.
+ */
+#define SEGARCHIVE_FILE_HDR_LEN     16
+
+/**
+ * @brief Size of a record header in a segment (and of an index entry).
+ */
+#define SEGREC_LEN                  96
+
+/**
+ * @brief Extension of the segment files; their index adds ".idx" to it.
+ */
+#define SEGARCHIVE_SEGMENT_EXT      ".seg"
+#define SEGARCHIVE_INDEX_EXT        ".idx"
+
+/**
+ * @brief A record of the archive.
+ *
+ * Each record is stored in the segment as its header followed by the data;
+ * the index has a copy of the header of each record of the segment.
+ */
+typedef struct {
+    /** Offset of the data in the segment */
+    uint64_t offset;
+
+    /** Length of the data */
+    uint64_t len;
+
+    /** Capture time */
+    int64_t ts_sec;
+    uint32_t ts_usec;
+
+    /** Media name: gif, jpeg ... (null terminated) */
+    char type[8];
+
+    /** 4 or 6 for IPv4 or IPv6 flows, 0 if unknown */
+    uint8_t family;
+
+    /** Flow addresses (IPv4 ones in the first 4 bytes) and ports */
+    uint8_t src[16], dst[16];
+    uint16_t sport, dport;
+
+    /** Hash of the data (see hash64()) */
+    uint64_t hash;
+
+    /** Image dimensions (0 if unknown or not an image) */
+    uint32_t width, height;
+} segrec_t;
+
+/**
+ * @brief Starts archiving in a directory.
+ *
+ * @param dir directory for the segments
+ * @param segment_max size of a segment before starting the next one
+ * @return TRUE on success, FALSE on error
+ */
+int segarchive_open(const char *dir, size_t segment_max);
+
+/**
+ * @brief Finishes the current segment and its index.
+ */
+void segarchive_close(void);
+
+/**
+ * @brief Appends a media object to the archive. Can be called from several threads.
+ *
+ * @param rec header of the record (the offset is filled in)
+ * @param data the media
+ * @return TRUE on success, FALSE on error
+ */
+int segarchive_append(segrec_t *rec, const unsigned char *data);
+
+/**
+ * @brief Fills the flow and time of a record header.
+ *
+ * @param rec the record header
+ * @param mname media name
+ * @param len length of the data
+ * @param meta where and when it was captured
+ */
+void segrec_init(segrec_t *rec, const char *mname, size_t len, const mediameta_t *meta);
+
+/**
+ * @brief Serializes a record header (little endian).
+ *
+ * @param rec the record header
+ * @param buf where to store it
+ */
+void segrec_encode(const segrec_t *rec, unsigned char buf[SEGREC_LEN]);
+
+/**
+ * @brief Reads a record header from a segment or index file.
+ *
+ * @param f the file, positioned at a record header
+ * @param rec where to store it
+ * @return 1 if read, 0 at the end of the file, -1 if corrupt
+ */
+int segrec_read(FILE *f, segrec_t *rec);
+
+/**
+ * @brief Opens a segment or an index file, checking its header.
+ *
+ * @param path file path
+ * @param index TRUE for an index file, FALSE for a segment
+ * @return the file positioned at the first record, or NULL on error
+ */
+FILE *segarchive_open_file(const char *path, int index);
+
+/**
+ * @brief Formats a flow address of a record header.
+ *
+ * @param rec the record header
+ * @param dst TRUE for the destination, FALSE for the source
+ * @param buf where to store it
+ * @param len size of buf
+ * @return buf
+ */
+char *segrec_addr(const segrec_t *rec, int dst, char *buf, size_t len);
+
+#endif /* __SEGARCHIVE_H__ */
@@ -0,0 +1,294 @@
+/**
+ * @file subfilter.c
+ *
+ * @brief Filters of the media a subscriber wants.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 18:34:50 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#include "compat/compat.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common/util.h"
+
+#include "subfilter.h"
+
+/* mediatype_by_class NAME
+ * Media type of a class name (image, audio or text), or 0. */
+static mediatype_t mediatype_by_class(const char *name)
+{
+    if (!strcmp(name, "image"))
+        return MEDIATYPE_IMAGE;
+    else if (!strcmp(name, "audio"))
+        return MEDIATYPE_AUDIO;
+    else if (!strcmp(name, "text"))
+        return MEDIATYPE_TEXT;
+
+    return 0;
+}
+
+static int set_types(subfilter_t *f, const char *value)
+{
+    char list[SUBFILTER_MAX_TYPES * 8 + 1], *name, *saveptr;
+    subfilter_t t;
+
+    if (strlen(value) >= sizeof list)
+        return FALSE;
+    strcpy(list, value);
+
+    /* the filter is left as it was on errors */
+    t.ntypes = 0;
+
+    for (name = strtok_r(list, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+        if (t.ntypes == SUBFILTER_MAX_TYPES || strlen(name) >= sizeof t.types[0])
+            return FALSE;
+
+        if (!get_mediatype_by_name(name) && !mediatype_by_class(name))
+            return FALSE;
+
+        strcpy(t.types[t.ntypes++], name);
+    }
+
+    memcpy(f->types, t.types, sizeof t.types);
+    f->ntypes = t.ntypes;
+
+    return TRUE;
+}
+
+/* set_host FILTER VALUE
+ * Sets the network of FILTER from an address, with an optional /prefix. */
+static int set_host(subfilter_t *f, const char *value)
+{
+    char addr[INET6_ADDRSTRLEN];
+    const char *slash = strchr(value, '/');
+    size_t n = slash ? (size_t)(slash - value) : strlen(value);
+    uint8_t host[16];
+    int family, bits;
+    char *end;
+
+    if (n >= sizeof addr)
+        return FALSE;
+    memcpy(addr, value, n);
+    addr[n] = 0;
+
+    if (inet_pton(AF_INET, addr, host) == 1)
+        family = AF_INET;
+    else if (inet_pton(AF_INET6, addr, host) == 1)
+        family = AF_INET6;
+    else
+        return FALSE;
+
+    bits = family == AF_INET ? 32 : 128;
+
+    if (slash) {
+        long prefix = strtol(slash + 1, &end, 10);
+
+        if (end == slash + 1 || *end || prefix < 0 || prefix > bits)
+            return FALSE;
+        bits = prefix;
+    }
+
+    f->family = family;
+    memcpy(f->host, host, sizeof host);
+    f->prefix = bits;
+
+    return TRUE;
+}
+
+int subfilter_set(subfilter_t *f, const char *key, const char *value)
+{
+    if (!strcmp(key, "type"))
+        return set_types(f, value);
+
+    if (!strcmp(key, "min-size"))
+        return parse_size(value, &f->min_size);
+
+    if (!strcmp(key, "min-dim") || !strcmp(key, "sample")) {
+        char *end;
+        long n = strtol(value, &end, 10);
+
+        if (end == value || *end || n < 0 || n > 1000000)
+            return FALSE;
+
+        if (key[1] == 'i')
+            f->min_dim = n;
+        else
+            f->sample = n;
+
+        return TRUE;
+    }
+
+    if (!strcmp(key, "host"))
+        return set_host(f, value);
+
+    return FALSE;
+}
+
+/* host_is SOCKADDR FILTER
+ * Is SOCKADDR in the network of FILTER ? */
+static int host_is(const struct sockaddr_storage *ss, const subfilter_t *f)
+{
+    const uint8_t *addr;
+    int bytes = f->prefix / 8, bits = f->prefix % 8;
+
+    if (ss->ss_family != f->family)
+        return FALSE;
+
+    if (f->family == AF_INET)
+        addr = (const uint8_t*)&((const struct sockaddr_in*)ss)->sin_addr;
+    else
+        addr = (const uint8_t*)&((const struct sockaddr_in6*)ss)->sin6_addr;
+
+    if (memcmp(addr, f->host, bytes))
+        return FALSE;
+
+    return !bits || ((addr[bytes] ^ f->host[bytes]) & (0xff << (8 - bits)) & 0xff) == 0;
+}
+
+int subfilter_match(const subfilter_t *f, const char *mname, size_t len, int width, int height,
+        const mediameta_t *meta)
+{
+    if (len < f->min_size)
+        return FALSE;
+
+    if (f->min_dim && width && (width < f->min_dim || height < f->min_dim))
+        return FALSE;
+
+    if (f->ntypes) {
+        mediatype_t type = get_mediatype_by_name(mname);
+        int i;
+
+        for (i = 0; i < f->ntypes; ++i)
+            if (!strcmp(f->types[i], mname) || (type && mediatype_by_class(f->types[i]) == type))
+                break;
+
+        if (i == f->ntypes)
+            return FALSE;
+    }
+
+    if (f->family && (!meta || !(host_is(&meta->src, f) || host_is(&meta->dst, f))))
+        return FALSE;
+
+    return TRUE;
+}
+
+int subfilter_sample(subfilter_t *f)
+{
+    return f->sample <= 1 || f->matched++ % f->sample == 0;
+}
+
+/* json_string P END OUT SIZE
+ * Copies the JSON string at P (past its opening quote) to OUT; returns the
+ * position past its closing quote, or NULL. */
+static const char *json_string(const char *p, const char *end, char *out, size_t size)
+{
+    size_t n = 0;
+
+    while (p < end && *p != '"') {
+        if (*p == '\\' && ++p == end)
+            return NULL;
+
+        if (n + 1 == size || (unsigned char)*p < ' ')
+            return NULL;
+        out[n++] = *p++;
+    }
+
+    if (p == end)
+        return NULL;
+    out[n] = 0;
+
+    return p + 1;
+}
+
+static const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && isspace((unsigned char)*p))
+        ++p;
+
+    return p;
+}
+
+int subfilter_parse_json(subfilter_t *f, const char *json, size_t len)
+{
+    const char *p = json, *end = json + len;
+    char key[32], value[256];
+    subfilter_t t;
+
+    memset(&t, 0, sizeof t);
+
+    p = skip_space(p, end);
+    if (p == end || *p++ != '{')
+        return FALSE;
+
+    for (p = skip_space(p, end); p < end && *p != '}'; ) {
+        size_t n;
+
+        if (*p != '"' || !(p = json_string(p + 1, end, key, sizeof key)))
+            return FALSE;
+
+        p = skip_space(p, end);
+        if (p == end || *p++ != ':')
+            return FALSE;
+        p = skip_space(p, end);
+
+        if (p < end && *p == '"') {
+            if (!(p = json_string(p + 1, end, value, sizeof value)))
+                return FALSE;
+
+        } else if (p < end && *p == '[') {
+            /* a list of strings, joined with commas */
+            for (n = 0, p = skip_space(p + 1, end); p < end && *p != ']'; ) {
+                if (*p != '"' || n + 1 >= sizeof value
+                        || !(p = json_string(p + 1, end, value + n, sizeof value - n)))
+                    return FALSE;
+                n += strlen(value + n);
+
+                p = skip_space(p, end);
+                if (p < end && *p == ',') {
+                    value[n++] = ',';
+                    p = skip_space(p + 1, end);
+                }
+            }
+            if (p == end)
+                return FALSE;
+            ++p;
+            value[n] = 0;
+
+        } else {
+            /* a number, or true, false ... */
+            for (n = 0; p < end && (isalnum((unsigned char)*p) || *p == '.' || *p == '-'); ++p) {
+                if (n + 1 == sizeof value)
+                    return FALSE;
+                value[n++] = *p;
+            }
+            if (n == 0)
+                return FALSE;
+            value[n] = 0;
+        }
+
+        if (!subfilter_set(&t, key, value))
+            return FALSE;
+
+        p = skip_space(p, end);
+        if (p < end && *p == ',')
+            p = skip_space(p + 1, end);
+    }
+
+    if (p == end)
+        return FALSE;
+
+    *f = t;
+
+    return TRUE;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file subfilter.h
+ *
+ * @brief Filters of the media a subscriber wants.
+ * @author David Suárez
+ * @date Mon, 19 Oct 2026 18:34:50 +0200
+ *
+ * Copyright (c) 2026 David Suárez.
+ * Email: david.sephirot@gmail.com
+ *
+ */
+
+#ifndef __SUBFILTER_H__
+#define __SUBFILTER_H__
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "media.h" /* for mediameta_t */
+
+/**
+ * @brief Max media names or types in a filter.
+ */
+#define SUBFILTER_MAX_TYPES     8
+
+/**
+ * @brief What a subscriber wants; an empty (zeroed) filter matches everything.
+ */
+typedef struct {
+    /** Media names (gif, jpeg ...) or types (image, audio, text) */
+    char types[SUBFILTER_MAX_TYPES][8];
+    int ntypes;
+
+    /** Objects smaller than this are left out */
+    size_t min_size;
+
+    /** Images with a smaller width or height are left out */
+    int min_dim;
+
+    /** Only objects with a host of this network at either end of the flow (family 0: any) */
+    int family;
+    uint8_t host[16];
+    int prefix;
+
+    /** Only one in every sample objects matching is wanted (0 or 1: all) */
+    unsigned int sample;
+    unsigned long matched;
+} subfilter_t;
+
+/**
+ * @brief Sets a field of a filter.
+ *
+ * The keys are: type (a comma separated list of media names or types),
+ * min-size (bytes, with an optional k, M or G suffix), min-dim (pixels),
+ * host (an IPv4 or IPv6 address, or a network as address/prefix) and sample
+ * (keep one object in every n).
+ *
+ * @param f the filter
+ * @param key field name
+ * @param value field value
+ * @return TRUE on success, FALSE if the key or the value are not valid
+ */
+int subfilter_set(subfilter_t *f, const char *key, const char *value);
+
+/**
+ * @brief Sets a filter from a JSON object of fields, such as
+ * {"type": ["jpeg", "png"], "min-dim": 100, "host": "10.0.0.0/8"}.
+ *
+ * Values are strings, numbers or arrays of strings (joined with commas). The
+ * filter is only changed if all the fields are valid, and then it is reset
+ * first.
+ *
+ * @param f the filter
+ * @param json the object
+ * @param len its length
+ * @return TRUE on success, FALSE on errors
+ */
+int subfilter_parse_json(subfilter_t *f, const char *json, size_t len);
+
+/**
+ * @brief Checks an object against a filter.
+ *
+ * Sampling is not applied, see subfilter_sample().
+ *
+ * @param f the filter
+ * @param mname media name of the object
+ * @param len size of the object
+ * @param width width of an image, or 0 if unknown
+ * @param height height of an image, or 0 if unknown
+ * @param meta where it was captured (may be NULL)
+ * @return TRUE if the object is wanted
+ */
+int subfilter_match(const subfilter_t *f, const char *mname, size_t len, int width, int height,
+        const mediameta_t *meta);
+
+/**
+ * @brief Samples the objects matching a filter; to be called for each.
+ *
+ * @param f the filter
+ * @return TRUE if this object is wanted
+ */
+int subfilter_sample(subfilter_t *f);
+
+#endif /* __SUBFILTER_H__ */
@@ -14,13 +14,44 @@
 #include <cmocka.h>
 
 #include <fcntl.h> /* for O_CREAT, O_EXCL, O_WRONLY */
+#include <glob.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <unistd.h>
 
+#include <zlib.h>
+
+#include <sys/time.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 
 #include "media/image.h"
 #include "media/media.h"
+#include "media/http.h"
+#include "media/http_decoder.h"
+#include "media/dedup.h"
+#include "media/outqueue.h"
+#include "media/segarchive.h"
+#include "media/adjout.h"
+#include "media/subfilter.h"
+#include "media/feedsrv.h"
+#include "common/tmpdir.h"
+#include "common/memstore.h"
+#include "common/mpscq.h"
+#include "common/metrics.h"
+#include "common/util.h"
+#include "common/hash.h"
+#include "display/shmring.h"
+#include "http_display/history.h"
 
 char* gif_image_list[] = {
         "tests/resources/gif_test_file_1.gif",
@@ -275,6 +306,947 @@ void test_correct_media_drivers_for_mediatype_count()
     close_media_drivers(text_drivers);
 }
 
+void test_probe_image_dimensions()
+{
+    test_media_state_t* resources[] = {
+        &gif_test_media_resource, &jpeg_test_media_resource,
+        &png_test_media_resource, &webp_test_media_resource
+    };
+    unsigned char *media = NULL;
+    size_t mlen = 0;
+    int width, height;
+
+    for (int res = 0; res < 4; res++) {
+
+        for (int file_idx = 0; file_idx < 3; file_idx++) {
+
+            find_media(resources[res]->image_list[file_idx], &media, &mlen, resources[res]->find_media_func);
+
+            assert_non_null(media);
+            assert_true(image_probe(media, mlen, &width, &height));
+            assert_true(width > 0);
+            assert_true(height > 0);
+        }
+    }
+
+    /* truncated or unknown headers */
+    assert_false(image_probe(media, 10, &width, &height));
+    assert_false(image_probe((unsigned char*)"not an image, just some text", 28, &width, &height));
+
+    /* PNG dimensions past 2^31 - 1 */
+    {
+        unsigned char png[24] = {
+            0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a,
+            0, 0, 0, 13, 'I', 'H', 'D', 'R',
+            0x80, 0, 0, 1, 0, 0, 0, 1
+        };
+
+        assert_false(image_probe(png, sizeof png, &width, &height));
+        memcpy(png + 16, "\x00\x00\x00\x01\xff\xff\xff\xff", 8);
+        assert_false(image_probe(png, sizeof png, &width, &height));
+        memcpy(png + 16, "\x7f\xff\xff\xff\x00\x00\x00\x02", 8);
+        assert_true(image_probe(png, sizeof png, &width, &height));
+        assert_int_equal(INT_MAX, width);
+        assert_int_equal(2, height);
+    }
+}
+
+void test_drivers_mask_for_content_type()
+{
+    drivers_t* image_drivers = get_drivers_for_mediatype(MEDIATYPE_IMAGE);
+    drivers_t* audio_drivers = get_drivers_for_mediatype(MEDIATYPE_AUDIO);
+
+    /* image drivers are gif, jpeg, png, webp */
+    assert_int_equal(1 << 2, get_drivers_mask_for_content_type(image_drivers, "image/png"));
+    assert_int_equal(1 << 1, get_drivers_mask_for_content_type(image_drivers, "image/jpeg"));
+    assert_int_equal(0, get_drivers_mask_for_content_type(image_drivers, "text/html"));
+    assert_int_equal(0, get_drivers_mask_for_content_type(image_drivers, "image/svg+xml"));
+    assert_int_equal(DRIVERS_MASK_ALL, get_drivers_mask_for_content_type(image_drivers, "application/octet-stream"));
+    assert_int_equal(DRIVERS_MASK_ALL, get_drivers_mask_for_content_type(image_drivers, ""));
+
+    /* no enabled driver for the content type */
+    assert_int_equal(0, get_drivers_mask_for_content_type(audio_drivers, "image/gif"));
+    assert_int_equal(1, get_drivers_mask_for_content_type(audio_drivers, "audio/mpeg"));
+
+    close_media_drivers(image_drivers);
+    close_media_drivers(audio_drivers);
+}
+
+void test_media_claims()
+{
+    mediaclaim_t *claims = NULL;
+
+    media_claim(&claims, 100, 50);
+    media_claim(&claims, 10, 20);
+    media_claim(&claims, 300, 10);
+
+    assert_int_equal(10, media_next_claim(claims, 0)->off);
+    assert_int_equal(100, media_next_claim(claims, 30)->off);
+    assert_int_equal(100, media_next_claim(claims, 149)->off);
+    assert_int_equal(300, media_next_claim(claims, 150)->off);
+    assert_null(media_next_claim(claims, 310));
+
+    /* overlapping and touching regions are merged */
+    media_claim(&claims, 140, 160);
+
+    assert_int_equal(100, media_next_claim(claims, 150)->off);
+    assert_int_equal(210, media_next_claim(claims, 150)->len);
+    assert_null(media_next_claim(claims, 150)->next);
+
+    media_free_claims(&claims);
+    assert_null(claims);
+}
+
+void test_dedup_window()
+{
+    unsigned char objects[5][16];
+    unsigned long unique, duplicates;
+    unsigned int times;
+
+    for (int i = 0; i < 5; i++)
+        memset(objects[i], 'a' + i, sizeof objects[i]);
+
+    assert_int_equal(4, dedup_init(4, DEDUP_DEFAULT_MEM_MAX));
+
+    for (int i = 0; i < 4; i++)
+        assert_false(dedup_check(objects[i], sizeof objects[i], NULL, NULL));
+
+    /* refresh the first one, so the second is the least recently seen */
+    assert_true(dedup_check(objects[0], sizeof objects[0], NULL, &times));
+    assert_int_equal(2, times);
+
+    assert_false(dedup_check(objects[4], sizeof objects[4], NULL, NULL));
+    assert_false(dedup_check(objects[1], sizeof objects[1], NULL, NULL));
+    assert_true(dedup_check(objects[0], sizeof objects[0], NULL, &times));
+    assert_int_equal(3, times);
+
+    dedup_get_stats(&unique, &duplicates);
+    assert_int_equal(6, unique);
+    assert_int_equal(2, duplicates);
+
+    /* the window is shrunk to the memory bound */
+    assert_true(dedup_init(1000, 4096) < 1000);
+
+    dedup_close();
+}
+
+static pthread_mutex_t writer_gate = PTHREAD_MUTEX_INITIALIZER;
+static size_t written_bytes;
+
+static void gated_dispatch(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    pthread_mutex_lock(&writer_gate);
+    written_bytes += len;
+    pthread_mutex_unlock(&writer_gate);
+}
+
+void test_outqueue_overflow_policies()
+{
+    mediadrv_t image_driver = { "png", MEDIATYPE_IMAGE, NULL, gated_dispatch };
+    mediadrv_t audio_driver = { "mpeg", MEDIATYPE_AUDIO, NULL, gated_dispatch };
+    unsigned char object[100] = { 0 };
+    mediameta_t meta = { 0 };
+    outqueue_stats_t stats;
+    outqueue_policy_t policy;
+
+    assert_true(outqueue_parse_policy("drop-oldest", &policy));
+    assert_int_equal(OUTQUEUE_DROP_OLDEST, policy);
+    assert_false(outqueue_parse_policy("drop-some", &policy));
+
+    /* the writer takes the first object and blocks on it, then 3 fit in
+     * the queue and the other 2 are dropped */
+    pthread_mutex_lock(&writer_gate);
+    written_bytes = 0;
+    assert_true(outqueue_start(1, 3 * sizeof object, OUTQUEUE_DROP_NEWEST));
+
+    outqueue_dispatch(&image_driver, object, sizeof object, &meta);
+    for (int ms = 0; ; ms++) {
+        outqueue_get_stats(&stats);
+        if (stats.queued_bytes == 0)
+            break;
+        /* the writer didn't take it within 5 seconds */
+        assert_true(ms < 5000);
+        mssleep(1);
+    }
+
+    for (int i = 0; i < 5; i++)
+        outqueue_dispatch(&image_driver, object, sizeof object, &meta);
+
+    outqueue_get_stats(&stats);
+    assert_int_equal(4, stats.queued);
+    assert_int_equal(2, stats.dropped);
+    assert_int_equal(3 * sizeof object, stats.queued_bytes);
+
+    pthread_mutex_unlock(&writer_gate);
+
+    outqueue_stop();
+
+    outqueue_get_stats(&stats);
+    assert_int_equal(4, stats.dispatched);
+    assert_int_equal(4 * sizeof object, written_bytes);
+    assert_int_equal(0, stats.queued_bytes);
+
+    /* other media are dispatched right away, unless all are queued */
+    assert_true(outqueue_start(1, 3 * sizeof object, OUTQUEUE_DROP_NEWEST));
+    outqueue_dispatch(&audio_driver, object, sizeof object, &meta);
+    outqueue_stop();
+    outqueue_get_stats(&stats);
+    assert_int_equal(4, stats.queued);
+    assert_int_equal(5 * sizeof object, written_bytes);
+
+    outqueue_queue_all(1);
+    assert_true(outqueue_start(1, 3 * sizeof object, OUTQUEUE_DROP_NEWEST));
+    outqueue_dispatch(&audio_driver, object, sizeof object, &meta);
+    outqueue_stop();
+    outqueue_queue_all(0);
+    outqueue_get_stats(&stats);
+    assert_int_equal(5, stats.queued);
+    assert_int_equal(5, stats.dispatched);
+    assert_int_equal(6 * sizeof object, written_bytes);
+}
+
+void test_tmpdir_quota_and_layout()
+{
+    char dir[] = "/tmp/driftnet-test-XXXXXX";
+    unsigned char object[100] = { 0 };
+    tmpfiles_stats_t stats;
+    char name1[TMPNAMELEN], name2[TMPNAMELEN];
+    char *path;
+
+    assert_non_null(mkdtemp(dir));
+
+    /* at most 3 files and 250 bytes */
+    set_tmpdir(xstrdup(dir), TMPDIR_APP_OWNED, 3, 250, 0);
+
+    assert_true(tmpfile_write_file("driftnet-1.png", object, 100));
+    assert_true(tmpfile_write_file("driftnet-2.webp", object, 100));
+    assert_true(tmpfile_write_file("driftnet-3.png", object, 100));
+    assert_false(tmpfile_write_file("driftnet-4.png", object, 251));
+
+    path = compose_path(dir, "driftnet-1.png");
+    assert_int_equal(-1, access(path, F_OK));
+    xfree(path);
+
+    tmpfile_delete_file("driftnet-2.webp");
+    assert_true(tmpfile_write_file("driftnet-5.txt", object, 50));
+
+    tmpfiles_get_stats(&stats);
+    assert_int_equal(1, stats.evicted);
+    assert_int_equal(1, stats.refused);
+    assert_int_equal(1, stats.types[2].files);   /* png */
+    assert_int_equal(100, stats.types[2].bytes);
+    assert_int_equal(0, stats.types[3].files);   /* webp */
+    assert_int_equal(1, stats.types[6].files);   /* txt */
+
+    /* unique names, spread over two levels of subdirectories */
+    tmpdir_set_fanout(2);
+    generate_new_tmp_filename("png", name1);
+    generate_new_tmp_filename("png", name2);
+    assert_int_not_equal(0, strcmp(name1, name2));
+    assert_true(name1[2] == '/' && name1[5] == '/');
+    assert_true(tmpfile_write_file(name1, object, 10));
+
+    /* an app owned directory goes away with our files */
+    clean_tmpdir();
+    assert_int_equal(-1, access(dir, F_OK));
+
+    /* without quotas the files are still accounted, and none is evicted */
+    strcpy(dir, "/tmp/driftnet-test-XXXXXX");
+    assert_non_null(mkdtemp(dir));
+    set_tmpdir(xstrdup(dir), TMPDIR_APP_OWNED, 0, 0, 0);
+    tmpdir_set_fanout(0);
+
+    assert_true(tmpfile_write_file("driftnet-1.png", object, 100));
+    assert_true(tmpfile_write_file("driftnet-2.png", object, 100));
+    assert_true(tmpfile_write_file("driftnet-3.png", object, 100));
+    assert_true(tmpfile_write_file("driftnet-4.png", object, 100));
+
+    tmpfiles_get_stats(&stats);
+    assert_int_equal(1, stats.evicted);
+    assert_int_equal(4, stats.types[2].files);
+    assert_int_equal(400, stats.types[2].bytes);
+
+    path = compose_path(dir, "driftnet-1.png");
+    assert_int_equal(0, access(path, F_OK));
+    xfree(path);
+
+    clean_tmpdir();
+    assert_int_equal(-1, access(dir, F_OK));
+}
+
+void test_tmpdir_memory_only_names()
+{
+    char name1[TMPNAMELEN], name2[TMPNAMELEN];
+
+    /* no directory, as in memory only mode: the names are flat */
+    tmpdir_set_fanout(2);
+    generate_new_tmp_filename("jpeg", name1);
+    generate_new_tmp_filename("jpeg", name2);
+    tmpdir_set_fanout(0);
+
+    assert_int_not_equal(0, strcmp(name1, name2));
+    assert_null(strchr(name1, '/'));
+    assert_int_equal(0, strncmp(name1, "driftnet-", 9));
+}
+
+void test_segment_archive_roundtrip()
+{
+    char dir[] = "/tmp/driftnet-test-XXXXXX";
+    unsigned char object[100], data[100];
+    mediameta_t meta = { 0 };
+    struct sockaddr_in *src = (struct sockaddr_in*)&meta.src;
+    char segment[128], addr[64];
+    glob_t segments;
+    segrec_t rec;
+    FILE *seg, *idx;
+
+    assert_non_null(mkdtemp(dir));
+
+    src->sin_family = AF_INET;
+    src->sin_port = htons(80);
+    src->sin_addr.s_addr = htonl(0x0a000001);
+    meta.dst.ss_family = AF_INET;
+    meta.ts.tv_sec = 1700000000;
+
+    /* two records fit in a segment, the third one goes to the next */
+    assert_true(segarchive_open(dir, SEGARCHIVE_FILE_HDR_LEN + 2 * (SEGREC_LEN + sizeof object)));
+
+    for (int i = 0; i < 3; i++) {
+        memset(object, i, sizeof object);
+        segrec_init(&rec, "png", sizeof object, &meta);
+        rec.hash = i;
+        assert_true(segarchive_append(&rec, object));
+    }
+
+    segarchive_close();
+
+    snprintf(segment, sizeof segment, "%s/driftnet-*" SEGARCHIVE_SEGMENT_EXT, dir);
+    assert_int_equal(0, glob(segment, 0, NULL, &segments));
+    assert_int_equal(2, segments.gl_pathc);
+
+    /* the index of the first one points to the data in it */
+    snprintf(segment, sizeof segment, "%s", segments.gl_pathv[0]);
+    globfree(&segments);
+
+    assert_non_null(seg = segarchive_open_file(segment, 0));
+    strcat(segment, SEGARCHIVE_INDEX_EXT);
+    assert_non_null(idx = segarchive_open_file(segment, 1));
+
+    for (int i = 0; i < 2; i++) {
+        assert_int_equal(1, segrec_read(idx, &rec));
+        assert_int_equal(i, rec.hash);
+        assert_string_equal("png", rec.type);
+        assert_int_equal(1700000000, rec.ts_sec);
+        assert_string_equal("10.0.0.1:80", segrec_addr(&rec, 0, addr, sizeof addr));
+
+        assert_int_equal(0, fseeko(seg, rec.offset, SEEK_SET));
+        assert_int_equal(sizeof data, fread(data, 1, sizeof data, seg));
+        assert_int_equal(i, data[0]);
+    }
+    assert_int_equal(0, segrec_read(idx, &rec));
+
+    fclose(idx);
+    fclose(seg);
+
+    snprintf(segment, sizeof segment, "rm -r %s", dir);
+    assert_int_equal(0, system(segment));
+}
+
+#define MPSCQ_PRODUCERS  4
+#define MPSCQ_ITEMS      20000
+
+typedef struct {
+    mpscq_node_t node;
+    int producer, seq;
+} qitem_t;
+
+static mpscq_t test_queue;
+
+static void *mpscq_producer(void *arg)
+{
+    int producer = (int)(intptr_t)arg;
+
+    for (int i = 0; i < MPSCQ_ITEMS; ++i) {
+        qitem_t *item = malloc(sizeof *item);
+
+        item->producer = producer;
+        item->seq = i;
+        mpscq_push(&test_queue, &item->node);
+    }
+
+    return NULL;
+}
+
+void test_mpscq_producers()
+{
+    pthread_t threads[MPSCQ_PRODUCERS];
+    int next[MPSCQ_PRODUCERS] = { 0 }, total = 0;
+    mpscq_node_t *node;
+
+    mpscq_init(&test_queue);
+    assert_null(mpscq_pop(&test_queue));
+
+    for (int i = 0; i < MPSCQ_PRODUCERS; ++i)
+        assert_int_equal(0, pthread_create(&threads[i], NULL, mpscq_producer, (void*)(intptr_t)i));
+
+    /* popped while being pushed, each producer in its own order */
+    while (total < MPSCQ_PRODUCERS * MPSCQ_ITEMS) {
+        qitem_t *item;
+
+        if (!(node = mpscq_pop(&test_queue))) {
+            sched_yield();
+            continue;
+        }
+
+        item = (qitem_t*)node;
+        assert_int_equal(next[item->producer]++, item->seq);
+        free(item);
+        ++total;
+    }
+
+    for (int i = 0; i < MPSCQ_PRODUCERS; ++i)
+        pthread_join(threads[i], NULL);
+
+    assert_null(mpscq_pop(&test_queue));
+}
+
+#define METRICS_THREADS  4
+#define METRICS_COUNTS   10000
+
+static void *metrics_counter(void *arg)
+{
+    for (int i = 0; i < METRICS_COUNTS; ++i) {
+        metrics_add(METRIC_PACKETS, 1);
+        metrics_add(METRIC_CONNECTIONS, i % 2 ? -1 : 1);
+        metrics_driver_add(1, METRIC_DRIVER_BYTES, 3);
+    }
+
+    return NULL;
+}
+
+static void test_collector(FILE *fp)
+{
+    metrics_write_value(fp, "test_gauge", "gauge", "A test gauge.", 42);
+}
+
+void test_metrics_threads()
+{
+    pthread_t threads[METRICS_THREADS];
+    int64_t packets = metrics_get(METRIC_PACKETS);
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *fp;
+
+    for (int i = 0; i < METRICS_THREADS; ++i)
+        assert_int_equal(0, pthread_create(&threads[i], NULL, metrics_counter, NULL));
+    for (int i = 0; i < METRICS_THREADS; ++i)
+        pthread_join(threads[i], NULL);
+
+    /* what the threads counted is kept once they are gone */
+    assert_int_equal(packets + METRICS_THREADS * METRICS_COUNTS, metrics_get(METRIC_PACKETS));
+    assert_int_equal(0, metrics_get(METRIC_CONNECTIONS));
+    assert_int_equal(METRICS_THREADS * METRICS_COUNTS * 3, metrics_driver_get(1, METRIC_DRIVER_BYTES));
+
+    metrics_set_driver_name(1, "jpeg");
+    metrics_add_collector(test_collector);
+
+    fp = open_memstream(&buf, &len);
+    metrics_write(fp);
+    fclose(fp);
+
+    assert_non_null(strstr(buf, "# TYPE driftnet_packets_total counter\n"));
+    assert_non_null(strstr(buf, "driftnet_driver_bytes_total{driver=\"jpeg\"} 120000\n"));
+    assert_null(strstr(buf, "{driver=\"(null)\"}"));
+    assert_non_null(strstr(buf, "# TYPE test_gauge gauge\ntest_gauge 42\n"));
+    free(buf);
+}
+
+void test_shmring_wrap_and_full()
+{
+    unsigned char data[100];
+    mediameta_t meta;
+    shmrec_t rec;
+    shmring_t *ring;
+    int i, n;
+
+    assert_non_null(ring = shmring_new(4096));
+    assert_false(shmring_peek(ring, &rec));
+    memset(&meta, 0, sizeof meta);
+
+    /* fill it up: the one which doesn't fit is dropped */
+    for (n = 0; ; ++n) {
+        memset(data, n, sizeof data);
+        meta.ts.tv_sec = n;
+        if (!shmring_put(ring, n % 2 ? "png" : "jpeg", data, sizeof data, &meta))
+            break;
+    }
+    assert_true(n > 2);
+
+    assert_true(shmring_peek(ring, &rec));
+    assert_string_equal("jpeg", rec.type);
+    assert_int_equal(sizeof data, rec.len);
+    assert_int_equal(0, rec.data[0]);
+    assert_true(rec.has_meta);
+    assert_int_equal(0, rec.meta.ts.tv_sec);
+    shmring_consume(ring, &rec);
+
+    /* the room of the first one is taken again at the start */
+    memset(data, n, sizeof data);
+    assert_true(shmring_put(ring, "gif", data, sizeof data, NULL));
+    assert_false(shmring_put(ring, "gif", data, sizeof data, NULL));
+
+    /* in order, across the end of the ring */
+    for (i = 1; i <= n; ++i) {
+        assert_true(shmring_peek(ring, &rec));
+        assert_int_equal(i, rec.data[0]);
+        assert_int_equal(i, rec.data[sizeof data - 1]);
+        if (i < n) {
+            assert_string_equal(i % 2 ? "png" : "jpeg", rec.type);
+            assert_int_equal(i, rec.meta.ts.tv_sec);
+        } else {
+            assert_string_equal("gif", rec.type);
+            assert_false(rec.has_meta);
+        }
+        shmring_consume(ring, &rec);
+    }
+    assert_false(shmring_peek(ring, &rec));
+
+    /* too big for the whole ring */
+    assert_false(shmring_put(ring, "gif", data, 4096, NULL));
+}
+
+static void history_add_n(int from, int to)
+{
+    msginfo_t info;
+    char json[16];
+
+    memset(&info, 0, sizeof info);
+    for (int i = from; i <= to; ++i) {
+        snprintf(info.mname, sizeof info.mname, "%s", i % 2 ? "gif" : "jpeg");
+        info.len = 10;
+        snprintf(json, sizeof json, "{\"n\":%d}", i);
+        assert_int_equal(i, history_next());
+        history_add(history_next(), &info, json, strlen(json));
+    }
+}
+
+static void assert_history_page(uint64_t cursor, unsigned int limit, const subfilter_t *filter,
+        const char *expected)
+{
+    unsigned char *page;
+    size_t len;
+
+    assert_non_null(page = history_page(cursor, limit, filter, 4, &len));
+    assert_int_equal(strlen(expected), len);
+    assert_memory_equal(expected, page + 4, len);
+    free(page);
+}
+
+void test_history_paging()
+{
+    subfilter_t filter;
+
+    memset(&filter, 0, sizeof filter);
+    history_init(4);
+    assert_history_page(0, 10, &filter, "{\"first\":1,\"last\":0,\"items\":[],\"next\":0}");
+
+    /* the oldest two are dropped; a cursor before them starts at the oldest */
+    history_add_n(1, 6);
+    assert_history_page(0, 10, &filter,
+            "{\"first\":3,\"last\":6,\"items\":[{\"n\":3},{\"n\":4},{\"n\":5},{\"n\":6}],\"next\":6}");
+    assert_history_page(1, 2, &filter,
+            "{\"first\":3,\"last\":6,\"items\":[{\"n\":3},{\"n\":4}],\"next\":4}");
+
+    /* more come in between the pages, and the next one is gone meanwhile */
+    history_add_n(7, 9);
+    assert_history_page(4, 10, &filter,
+            "{\"first\":6,\"last\":9,\"items\":[{\"n\":6},{\"n\":7},{\"n\":8},{\"n\":9}],\"next\":9}");
+    assert_history_page(9, 10, &filter, "{\"first\":6,\"last\":9,\"items\":[],\"next\":9}");
+
+    /* a page of the messages matching, up to the last one looked at */
+    assert_true(subfilter_set(&filter, "type", "jpeg"));
+    assert_history_page(0, 1, &filter, "{\"first\":6,\"last\":9,\"items\":[{\"n\":6}],\"next\":6}");
+    assert_history_page(6, 10, &filter, "{\"first\":6,\"last\":9,\"items\":[{\"n\":8}],\"next\":9}");
+
+    history_free();
+}
+
+void test_memstore_lru()
+{
+    unsigned char data[300];
+    memstore_stats_t stats;
+    memobj_t *a, *b;
+
+    memset(data, 'x', sizeof data);
+    memstore_init(250);
+
+    assert_int_equal(1, memstore_put("a", data, 100));
+    assert_int_equal(1, memstore_put("b", data, 100));
+    assert_int_equal(0, memstore_put("huge", data, 251));
+
+    /* "a" becomes the most recently used, so "b" goes first */
+    assert_non_null(a = memstore_get("a"));
+    assert_int_equal(1, memstore_put("c", data, 100));
+    assert_null(memstore_get("b"));
+
+    /* an evicted object stays usable while referenced */
+    assert_int_equal(1, memstore_put("d", data, 100));
+    assert_int_equal(1, memstore_put("e", data, 100));
+    assert_null(b = memstore_get("a"));
+    assert_int_equal(100, a->len);
+    assert_int_equal('x', a->data[99]);
+    assert_true(a->hash == hash64(data, 100));
+    memstore_release(a);
+
+    memstore_get_stats(&stats);
+    assert_int_equal(2, stats.objects);
+    assert_int_equal(200, stats.bytes);
+    assert_int_equal(3, stats.evicted);
+
+    memstore_close();
+}
+
+/* accept_frames PATH FORMAT INLINE FLUSH_MS
+ * Has adjout connect to a socket at PATH, and returns the accepted end. */
+static int accept_frames(const char *path, adjout_format_t format, int inline_data, unsigned int flush_ms)
+{
+    struct sockaddr_un sa;
+    int lfd, fd;
+
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    unlink(path);
+
+    assert_int_not_equal(-1, lfd = socket(AF_UNIX, SOCK_STREAM, 0));
+    assert_int_equal(0, bind(lfd, (struct sockaddr*)&sa, sizeof sa));
+    assert_int_equal(0, listen(lfd, 1));
+
+    assert_int_equal(1, adjout_open(format, path, inline_data, flush_ms));
+    assert_int_not_equal(-1, fd = accept(lfd, NULL, NULL));
+
+    close(lfd);
+    unlink(path);
+
+    return fd;
+}
+
+void test_adjunct_frames()
+{
+    char path[64], buf[1024];
+    unsigned char hdr[ADJOUT_STREAM_HDR_LEN], len[4];
+    const unsigned char data[] = "hello";
+    struct sockaddr_in *sin;
+    mediameta_t meta;
+    segrec_t rec, got;
+    FILE *f;
+    int fd;
+
+    memset(&meta, 0, sizeof meta);
+    sin = (struct sockaddr_in*)&meta.src;
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0x0a000001);
+    sin->sin_port = htons(80);
+    sin = (struct sockaddr_in*)&meta.dst;
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0x0a000002);
+    sin->sin_port = htons(5000);
+    meta.ts.tv_sec = 1700000000;
+    meta.ts.tv_usec = 42;
+
+    segrec_init(&rec, "jpeg", 5, &meta);
+    rec.hash = 0x1234;
+    rec.width = 2;
+    rec.height = 3;
+
+    snprintf(path, sizeof path, "/tmp/driftnet-test-%d.sock", (int)getpid());
+
+    /* binary, inline, written right away */
+    fd = accept_frames(path, ADJOUT_BINARY, 1, 0);
+    adjout_emit(&rec, data, NULL);
+    adjout_close();
+
+    assert_non_null(f = fdopen(fd, "rb"));
+    assert_int_equal(1, fread(hdr, sizeof hdr, 1, f));
+    assert_memory_equal("DRIFTOUT", hdr, 8);
+    assert_int_equal(ADJOUT_FLAG_INLINE, hdr[12]);
+    assert_int_equal(1, fread(len, 4, 1, f));
+    assert_int_equal(SEGREC_LEN + 5, len[0] | len[1] << 8);
+    assert_int_equal(1, segrec_read(f, &got));
+    assert_string_equal("jpeg", got.type);
+    assert_int_equal(5, got.len);
+    assert_int_equal(1700000000, got.ts_sec);
+    assert_int_equal(80, got.sport);
+    assert_int_equal(3, got.height);
+    assert_int_equal(5, fread(buf, 1, sizeof buf, f));
+    assert_memory_equal(data, buf, 5);
+    fclose(f);
+
+    /* JSON lines, batched */
+    fd = accept_frames(path, ADJOUT_JSONL, 1, 50);
+    adjout_emit(&rec, data, NULL);
+    adjout_emit(&rec, NULL, "/tmp/x\"y.jpeg");
+    adjout_close();
+
+    assert_non_null(f = fdopen(fd, "rb"));
+    assert_non_null(fgets(buf, sizeof buf, f));
+    assert_string_equal("{\"type\":\"jpeg\",\"len\":5,\"ts\":1700000000.000042,\"src\":\"10.0.0.1:80\","
+            "\"dst\":\"10.0.0.2:5000\",\"hash\":\"0000000000001234\",\"width\":2,\"height\":3,\"data\":\"aGVsbG8=\"}\n", buf);
+    assert_non_null(fgets(buf, sizeof buf, f));
+    assert_non_null(strstr(buf, ",\"path\":\"/tmp/x\\\"y.jpeg\"}\n"));
+    assert_null(fgets(buf, sizeof buf, f));
+    fclose(f);
+}
+
+void test_feed_server()
+{
+    char path[64], buf[1024];
+    const unsigned char data[] = "hello";
+    struct sockaddr_in *sin;
+    struct sockaddr_un sa;
+    struct timeval tv = { 5, 0 };
+    feedsrv_stats_t stats;
+    mediameta_t meta;
+    subfilter_t filter;
+    FILE *f;
+    int fd, i;
+
+    memset(&meta, 0, sizeof meta);
+    sin = (struct sockaddr_in*)&meta.src;
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0x0a000001);
+
+    /* filters */
+    memset(&filter, 0, sizeof filter);
+    assert_true(subfilter_match(&filter, "gif", 1, 0, 0, NULL));
+    assert_true(subfilter_set(&filter, "type", "jpeg,audio"));
+    assert_true(subfilter_set(&filter, "min-size", "4"));
+    assert_false(subfilter_set(&filter, "type", "jpeg,tiff"));
+    assert_false(subfilter_set(&filter, "colour", "red"));
+    assert_true(subfilter_match(&filter, "jpeg", 4, 0, 0, &meta));
+    assert_true(subfilter_match(&filter, "mpeg", 4, 0, 0, &meta));
+    assert_false(subfilter_match(&filter, "gif", 4, 0, 0, &meta));
+    assert_false(subfilter_match(&filter, "jpeg", 3, 0, 0, &meta));
+    assert_true(subfilter_set(&filter, "host", "10.0.0.1"));
+    assert_true(subfilter_match(&filter, "jpeg", 4, 0, 0, &meta));
+    assert_false(subfilter_match(&filter, "jpeg", 4, 0, 0, NULL));
+    assert_true(subfilter_set(&filter, "host", "::1"));
+    assert_false(subfilter_match(&filter, "jpeg", 4, 0, 0, &meta));
+
+    /* subscriptions of the browsers */
+    assert_true(subfilter_parse_json(&filter, "{ \"type\": [\"image\", \"mpeg\"], \"min-dim\": 100, "
+            "\"host\": \"10.0.0.0/8\", \"sample\": 2 }", 80));
+    assert_false(subfilter_match(&filter, "HTTP", 4, 0, 0, &meta));
+    assert_false(subfilter_match(&filter, "png", 4, 99, 200, &meta));
+    assert_true(subfilter_match(&filter, "png", 4, 100, 200, &meta));
+    assert_true(subfilter_set(&filter, "host", "10.0.0.2/31"));
+    assert_false(subfilter_match(&filter, "png", 4, 100, 200, &meta));
+    assert_true(subfilter_sample(&filter));
+    assert_false(subfilter_sample(&filter));
+    assert_true(subfilter_sample(&filter));
+    assert_false(subfilter_parse_json(&filter, "{\"type\": \"tiff\"}", 16));
+    assert_false(subfilter_parse_json(&filter, "{\"type\": \"gif\"", 14));
+    assert_int_equal(2, filter.sample);
+    assert_true(subfilter_parse_json(&filter, " {} ", 4));
+    assert_true(subfilter_match(&filter, "HTTP", 1, 0, 0, NULL));
+
+    /* a subscriber only gets what it asked for */
+    snprintf(path, sizeof path, "/tmp/driftnet-test-%d-feed.sock", (int)getpid());
+    assert_true(feedsrv_start(path, FEEDSRV_DEFAULT_CLIENT_MAX, OUTQUEUE_DROP_OLDEST));
+
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    assert_true((fd = socket(AF_UNIX, SOCK_STREAM, 0)) != -1);
+    /* a server which never answers fails the reads, rather than hanging */
+    assert_int_equal(0, setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv));
+    assert_int_equal(0, connect(fd, (struct sockaddr*)&sa, sizeof sa));
+    assert_non_null(f = fdopen(fd, "r+b"));
+    fputs("format=jsonl type=jpeg min-size=4\n", f);
+    fflush(f);
+
+    for (i = 0; i < 500; ++i) {
+        feedsrv_get_stats(&stats);
+        if (stats.clients == 1)
+            break;
+        usleep(2000);
+    }
+    assert_int_equal(1, stats.clients);
+
+    feedsrv_publish("gif", data, 5, &meta);
+    feedsrv_publish("jpeg", data, 3, &meta);
+    feedsrv_publish("jpeg", data, 5, &meta);
+
+    assert_non_null(fgets(buf, sizeof buf, f));
+    assert_non_null(strstr(buf, "{\"type\":\"jpeg\",\"len\":5,"));
+    assert_non_null(strstr(buf, "\"data\":\"aGVsbG8=\"}\n"));
+
+    feedsrv_stop();
+    assert_null(fgets(buf, sizeof buf, f));
+    assert_true(feof(f));
+    fclose(f);
+
+    feedsrv_get_stats(&stats);
+    assert_int_equal(1, stats.frames);
+    assert_int_equal(0, stats.dropped);
+    assert_int_equal(-1, access(path, F_OK));
+}
+
+void test_parse_http_response_header()
+{
+    const char *hdr = "HTTP/1.1 200 OK\r\n"
+                      "Content-Type: image/PNG; charset=binary\r\n"
+                      "Content-Encoding: gzip\r\n"
+                      "Transfer-Encoding: chunked\r\n"
+                      "\r\n";
+    http_response_t resp;
+
+    assert_int_equal(0, http_parse_response((unsigned char*)hdr, strlen(hdr) - 2, &resp));
+    assert_int_equal(1, http_parse_response((unsigned char*)hdr, strlen(hdr), &resp));
+
+    assert_int_equal(200, resp.status);
+    assert_int_equal(strlen(hdr), resp.header_len);
+    assert_true(resp.chunked);
+    assert_int_equal(HTTP_ENCODING_GZIP, resp.encoding);
+    assert_string_equal("image/png", resp.content_type);
+    assert_true(http_response_has_body(&resp));
+
+    assert_int_equal(-1, http_parse_response((unsigned char*)"HTTP/1.1 abc\r\n\r\n", 16, &resp));
+}
+
+void test_decode_gzip_chunked_body()
+{
+    unsigned char *image, *gz, *stream, *media = NULL;
+    size_t mlen = 0, gzlen, slen = 0, off = 0;
+    int fd, image_len;
+    z_stream z = { 0 };
+    http_decoder_t *d;
+
+    fd = open(png_image_list[0], O_RDONLY, 0666);
+    if (fd == -1)
+        fail();
+
+    image_len = lseek(fd, 0, SEEK_END);
+    lseek(fd, 0, SEEK_SET);
+    image = malloc(image_len);
+    if (read(fd, image, image_len) != image_len)
+        fail();
+    close(fd);
+
+    /* gzip the image... */
+    gzlen = compressBound(image_len) + 32;
+    gz = malloc(gzlen);
+    assert_int_equal(Z_OK, deflateInit2(&z, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY));
+    z.next_in = image;
+    z.avail_in = image_len;
+    z.next_out = gz;
+    z.avail_out = gzlen;
+    assert_int_equal(Z_STREAM_END, deflate(&z, Z_FINISH));
+    gzlen = z.total_out;
+    deflateEnd(&z);
+
+    /* ... and send it in two chunks */
+    stream = malloc(gzlen + 256);
+    slen += sprintf((char*)stream, "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n"
+                    "Transfer-Encoding: chunked\r\n\r\n%zx\r\n", gzlen / 2);
+    memcpy(stream + slen, gz, gzlen / 2);
+    slen += gzlen / 2;
+    slen += sprintf((char*)stream + slen, "\r\n%zx\r\n", gzlen - gzlen / 2);
+    memcpy(stream + slen, gz + gzlen / 2, gzlen - gzlen / 2);
+    slen += gzlen - gzlen / 2;
+    slen += sprintf((char*)stream + slen, "\r\n0\r\n\r\n");
+
+    d = http_decoder_new();
+
+    /* feed it in small pieces, as if it came from the network */
+    while (off < slen && !d->msg_done) {
+        size_t piece = slen - off < 100 ? slen - off : 100;
+        off += http_decoder_feed(d, stream + off, piece);
+    }
+
+    assert_true(d->msg_done);
+    assert_int_equal(slen, d->off);
+    assert_int_equal(image_len, d->outlen);
+    assert_memory_equal(image, d->out, image_len);
+
+    find_png_image(d->out, d->outlen, &media, &mlen);
+    assert_non_null(media);
+
+    http_decoder_next_message(d);
+    assert_int_equal(0, d->outlen);
+
+    http_decoder_delete(d);
+    free(stream);
+    free(gz);
+    free(image);
+}
+
+void test_decode_budget_then_close()
+{
+    const size_t zeros_len = 16 * 1024 * 1024;
+    unsigned char *zeros, *gz, *stream;
+    size_t gzlen, slen = 0, off = 0, n = 1;
+    z_stream z = { 0 };
+    http_decoder_t *d;
+    int i;
+
+    /* gzipped zeros, quick to send but slow to decode */
+    zeros = calloc(1, zeros_len);
+    gzlen = compressBound(zeros_len) + 32;
+    gz = malloc(gzlen);
+    assert_int_equal(Z_OK, deflateInit2(&z, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY));
+    z.next_in = zeros;
+    z.avail_in = zeros_len;
+    z.next_out = gz;
+    z.avail_out = gzlen;
+    assert_int_equal(Z_STREAM_END, deflate(&z, Z_FINISH));
+    gzlen = z.total_out;
+    deflateEnd(&z);
+
+    stream = malloc(4 * (gzlen + 128));
+    for (i = 0; i < 4; ++i) {
+        slen += sprintf((char*)stream + slen, "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n"
+                        "Content-Length: %zu\r\n\r\n", gzlen);
+        memcpy(stream + slen, gz, gzlen);
+        slen += gzlen;
+    }
+
+    /* a millisecond a second is spent on the first body */
+    http_decoder_set_limits(256 * 1024 * 1024, 256 * 1024 * 1024, 1);
+    d = http_decoder_new();
+
+    while (off < slen && n > 0) {
+        n = http_decoder_feed(d, stream + off, slen - off);
+        off += n;
+        if (d->msg_done) {
+            assert_int_equal(zeros_len, d->outlen);
+            http_decoder_next_message(d);
+        }
+    }
+    assert_true(off < slen);
+
+    /* the stream is over: the rest is decoded all the same */
+    d->closing = 1;
+    while (off < slen) {
+        n = http_decoder_feed(d, stream + off, slen - off);
+        assert_true(n > 0);
+        off += n;
+        if (d->msg_done) {
+            assert_int_equal(zeros_len, d->outlen);
+            http_decoder_next_message(d);
+        }
+    }
+    assert_int_equal(slen, d->off);
+
+    http_decoder_delete(d);
+    http_decoder_set_limits(HTTP_DECODER_DEFAULT_FLOW_MAX, HTTP_DECODER_DEFAULT_MEM_MAX,
+            HTTP_DECODER_DEFAULT_CPU_MAX);
+    free(stream);
+    free(gz);
+    free(zeros);
+}
+
 int main(void)
 {
     const struct CMUnitTest image_tests[] = {
@@ -293,7 +1265,25 @@ int main(void)
     ret += cmocka_run_group_tests_name("avif media tests", image_tests, avif_media_test_group_setup, NULL);
 
     const struct CMUnitTest media_tests[] = {
-            cmocka_unit_test(test_correct_media_drivers_for_mediatype_count)
+            cmocka_unit_test(test_correct_media_drivers_for_mediatype_count),
+            cmocka_unit_test(test_probe_image_dimensions),
+            cmocka_unit_test(test_drivers_mask_for_content_type),
+            cmocka_unit_test(test_media_claims),
+            cmocka_unit_test(test_dedup_window),
+            cmocka_unit_test(test_outqueue_overflow_policies),
+            cmocka_unit_test(test_tmpdir_quota_and_layout),
+            cmocka_unit_test(test_tmpdir_memory_only_names),
+            cmocka_unit_test(test_segment_archive_roundtrip),
+            cmocka_unit_test(test_shmring_wrap_and_full),
+            cmocka_unit_test(test_history_paging),
+            cmocka_unit_test(test_memstore_lru),
+            cmocka_unit_test(test_mpscq_producers),
+            cmocka_unit_test(test_metrics_threads),
+            cmocka_unit_test(test_adjunct_frames),
+            cmocka_unit_test(test_feed_server),
+            cmocka_unit_test(test_parse_http_response_header),
+            cmocka_unit_test(test_decode_gzip_chunked_body),
+            cmocka_unit_test(test_decode_budget_then_close)
     };
 
     ret += cmocka_run_group_tests(media_tests, NULL, NULL);
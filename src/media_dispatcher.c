@@ -7,6 +7,8 @@
  *
  */
 
+#include "compat/compat.h"
+
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,52 +17,254 @@
 #include "common/tmpdir.h"
 #include "common/util.h"
 #include "common/log.h"
+#include "common/hash.h"
+#include "common/memstore.h"
 #include "playaudio.h"
 #include "media.h"
+#include "image.h"
+#include "dedup.h"
+#include "segarchive.h"
+#include "adjout.h"
+#include "feedsrv.h"
 #ifndef NO_DISPLAY_WINDOW
     #include "display.h"
 #endif
 #ifndef NO_HTTP_DISPLAY
     #include "httpd.h"
+    #include "thumb.h"
 #endif
 
 #include "media_dispatcher.h"
 
 static char *parse_http_req(const unsigned char *data, size_t len);
 
-const char* tmpfile_write_mediaffile(const char* mname, const unsigned char *data, const size_t len)
+/* Limits of the images we want; 0 means no limit. */
+static size_t img_min_size = DISPATCH_DEFAULT_IMG_MIN_SIZE;
+static size_t img_max_size = 0;
+static int img_min_dim = DISPATCH_DEFAULT_IMG_MIN_DIM;
+static int img_max_dim = 0;
+
+/* Announce the duplicates we drop ? */
+static int dedup_events = FALSE;
+
+/* Push the images to the browsers in the websocket messages ? */
+static int ws_binary = FALSE;
+
+/* Size of the thumbnails for the browsers; 0 means no thumbnails. */
+static unsigned int thumb_size = 0;
+
+void dispatch_set_dedup_events(int enable)
+{
+    dedup_events = enable;
+}
+
+void dispatch_set_ws_binary(int enable)
+{
+    ws_binary = enable;
+}
+
+void dispatch_set_thumbnails(unsigned int size)
+{
+    thumb_size = size;
+}
+
+void dispatch_set_image_filter(size_t min_size, size_t max_size, int min_dim, int max_dim)
+{
+    img_min_size = min_size;
+    img_max_size = max_size;
+    img_min_dim = min_dim;
+    img_max_dim = max_dim;
+}
+
+/*
+ * is_duplicate:
+ * Check if we recently dispatched the same object; its HASH is returned
+ * anyway. Only images are checked, once they passed the filters, so that
+ * the window is not spent on what we drop anyway.
+ */
+static int is_duplicate(const char *mname, const unsigned char *data, const size_t len, uint64_t *phash)
+{
+    uint64_t hash;
+    unsigned int times;
+    int duplicate = dedup_check(data, len, &hash, &times);
+
+    *phash = hash;
+
+    if (!duplicate)
+        return FALSE;
+
+    if (dedup_events)
+        log_msg(LOG_SIMPLY, "seen again: %s %016llx (%u times)", mname, (unsigned long long)hash, times);
+    else
+        log_msg(LOG_DEBUG, "%s image %016llx seen again (%u times)", mname, (unsigned long long)hash, times);
+
+    return TRUE;
+}
+
+/*
+ * image_wanted_info:
+ * Check the size and dimensions of an image, from its header, before we
+ * spend any I/O on it. Its dimensions and hash are returned too.
+ */
+static int image_wanted_info(const char *mname, const unsigned char *data, const size_t len,
+        int *pwidth, int *pheight, uint64_t *phash)
+{
+    int width, height;
+
+    if (len < img_min_size || (img_max_size && len > img_max_size)) {
+        log_msg(LOG_DEBUG, "%s image of %zu bytes filtered out", mname, len);
+        return FALSE;
+    }
+
+    if (!image_probe(data, len, &width, &height)) {
+        log_msg(LOG_DEBUG, "%s image of %zu bytes: bogus header", mname, len);
+        return FALSE;
+    }
+
+    if (width < img_min_dim || height < img_min_dim
+            || (img_max_dim && (width > img_max_dim || height > img_max_dim))) {
+        log_msg(LOG_DEBUG, "%s image of %d x %d filtered out", mname, width, height);
+        return FALSE;
+    }
+
+    *pwidth = width;
+    *pheight = height;
+
+    if (is_duplicate(mname, data, len, phash))
+        return FALSE;
+
+    return TRUE;
+}
+
+static int image_wanted(const char *mname, const unsigned char *data, const size_t len)
+{
+    int width, height;
+    uint64_t hash;
+
+    return image_wanted_info(mname, data, len, &width, &height, &hash);
+}
+
+/*
+ * tmpfile_write_mediaffile:
+ * Write a media file to the temporary directory, calling WRITTEN with its
+ * name once done (right away, unless the writes are being batched).
+ */
+static void tmpfile_write_mediaffile(const char* mname, const unsigned char *data, const size_t len,
+        tmpfile_written_cb written)
+{
+    char name[TMPNAMELEN];
+
+    tmpfile_write_file_cb(generate_new_tmp_filename(mname, name), data, len, written, NULL);
+}
+
+static void image_written_to_stdout(const char *name, int ok, void *arg)
+{
+    if (ok)
+        log_msg(LOG_SIMPLY, "%s/%s", get_tmpdir(), name);
+}
+
+void dispatch_image_to_stdout(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    if (!image_wanted(mname, data, len))
+        return;
+
+    tmpfile_write_mediaffile(mname, data, len, image_written_to_stdout);
+}
+
+/*
+ * dispatch_image_to_adjout:
+ * Announce an image with a frame of the adjunct output, carrying the image
+ * itself or the path of the file it is written to.
+ */
+static void image_written_to_adjout(const char *name, int ok, void *arg)
 {
-    const char* name = generate_new_tmp_filename(mname);
+    segrec_t *rec = arg;
+
+    if (ok) {
+        char *path = compose_path(get_tmpdir(), name);
 
-    tmpfile_write_file(name, data, len);
+        adjout_emit(rec, NULL, path);
+        xfree(path);
+    }
 
-    return name;
+    xfree(rec);
 }
 
-void dispatch_image_to_stdout(const char *mname, const unsigned char *data, const size_t len)
+void dispatch_image_to_adjout(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
 {
-    const char *name = tmpfile_write_mediaffile(mname, data, len);
+    segrec_t rec, *pending;
+    char name[TMPNAMELEN];
+    int width, height;
+
+    segrec_init(&rec, mname, len, meta);
 
-    if (name == NULL)
+    if (!image_wanted_info(mname, data, len, &width, &height, &rec.hash))
         return;
 
-    log_msg(LOG_SIMPLY, "%s/%s", get_tmpdir(), name);
+    rec.width = width;
+    rec.height = height;
+
+    if (adjout_inline()) {
+        adjout_emit(&rec, data, NULL);
+        return;
+    }
+
+    pending = xmalloc(sizeof *pending);
+    *pending = rec;
+    tmpfile_write_file_cb(generate_new_tmp_filename(mname, name), data, len, image_written_to_adjout, pending);
+}
+
+/*
+ * dispatch_image_to_archive:
+ * Append an image to the segment archive.
+ */
+void dispatch_image_to_archive(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    segrec_t rec;
+    int width, height;
+
+    segrec_init(&rec, mname, len, meta);
+
+    if (!image_wanted_info(mname, data, len, &width, &height, &rec.hash))
+        return;
+
+    rec.width = width;
+    rec.height = height;
+
+    segarchive_append(&rec, data);
+}
+
+/*
+ * dispatch_media_to_archive:
+ * Append any other media to the segment archive.
+ */
+void dispatch_media_to_archive(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    segrec_t rec;
+
+    segrec_init(&rec, mname, len, meta);
+    rec.hash = hash64(data, len);
+
+    segarchive_append(&rec, data);
 }
 
 /*
  * dispatch_image:
- * Throw some image data at the display process.
+ * Throw some image data at the display process, through shared memory.
  */
 #ifndef NO_DISPLAY_WINDOW
-void dispatch_image_to_display(const char *mname, const unsigned char *data, const size_t len)
+void dispatch_image_to_display(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
 {
-    const char *name;
-
-    name = tmpfile_write_mediaffile(mname, data, len);
-    if (name == NULL)
+    if (!image_wanted(mname, data, len))
         return;
 
-    display_send_img(name, TMPNAMELEN);
+    if (!display_send_img(mname, data, len, meta))
+        log_msg(LOG_DEBUG, "display busy, %s image of %zu bytes dropped", mname, len);
 }
 #endif /* !NO_DISPLAY_WINDOW */
 
@@ -69,16 +273,142 @@ void dispatch_image_to_display(const char *mname, const unsigned char *data, con
  * Throw some image data at the http display process.
  */
 #ifndef NO_HTTP_DISPLAY
-void dispatch_image_to_httpdisplay(const char *mname, const unsigned char *data, const size_t len)
+
+/* Name of the thumbnail of an image, next to it. */
+#define THUMB_SUFFIX    ".t.jpeg"
+
+/* What the browsers are told about an image, once written. */
+typedef struct {
+    int thumb;
+    char mname[8];
+    int width, height;
+    size_t len;
+    int has_meta;
+    mediameta_t meta;
+} httpdisplay_image_t;
+
+/* announce_image IMAGE NAME
+ * Tell the browsers about the image NAME. */
+static void announce_image(const httpdisplay_image_t *image, const char *name)
+{
+    char thumb[TMPNAMELEN + sizeof THUMB_SUFFIX];
+    ws_mediainfo_t info = {
+        image->mname, image->len, image->width, image->height, image->has_meta ? &image->meta : NULL
+    };
+
+    if (image->thumb) {
+        snprintf(thumb, sizeof thumb, "%s%s", name, THUMB_SUFFIX);
+        ws_send_thumb(name, thumb, &info);
+
+    } else {
+        ws_send_media(name, MEDIATYPE_IMAGE, &info);
+    }
+}
+
+static void image_written_to_httpdisplay(const char *name, int ok, void *arg)
+{
+    if (ok)
+        announce_image(arg, name);
+
+    xfree(arg);
+}
+
+/*
+ * send_image_to_httpdisplay:
+ * Hand an image NAME, and its thumbnail if worth it, to the http display;
+ * with TO_DISK they are also written to the temporary directory, where the
+ * http display finds them once evicted from memory.
+ */
+static void send_image_to_httpdisplay(const char *mname, const char *name, const unsigned char *data,
+        const size_t len, int width, int height, const mediameta_t *meta, int to_disk)
 {
-    const char *name;
+    char thumb_name[TMPNAMELEN + sizeof THUMB_SUFFIX];
+    unsigned char *thumb = NULL;
+    size_t thumb_len = 0;
+    httpdisplay_image_t *image;
 
-    name = tmpfile_write_mediaffile(mname, data, len);
-    if (name == NULL)
+    /* this runs on the writer threads, so the decoding doesn't hold the capture */
+    if (thumb_size && thumb_make(mname, data, len, thumb_size, &thumb, &thumb_len)) {
+        snprintf(thumb_name, sizeof thumb_name, "%s%s", name, THUMB_SUFFIX);
+
+        if (!ws_binary)
+            memstore_put(thumb_name, thumb, thumb_len);
+
+        /* not batched: the thumbnail is gone once back */
+        if (to_disk)
+            tmpfile_write_file(thumb_name, thumb, thumb_len);
+    }
+
+    alloc_struct(httpdisplay_image_t, image);
+    image->thumb = thumb != NULL;
+    snprintf(image->mname, sizeof image->mname, "%s", mname);
+    image->width = width;
+    image->height = height;
+    image->len = len;
+    if ((image->has_meta = meta != NULL))
+        image->meta = *meta;
+
+    if (ws_binary) {
+        ws_mediainfo_t info = { mname, len, width, height, meta };
+
+        /* the browsers get the image (or its thumbnail) right away; it is
+         * kept too, for those loading it from the history later */
+        memstore_put(name, data, len);
+        if (thumb)
+            ws_send_image(name, thumb, thumb_len, TRUE, &info);
+        else
+            ws_send_image(name, data, len, FALSE, &info);
+
+        if (to_disk)
+            tmpfile_write_file_cb(name, data, len, NULL, NULL);
+        xfree(image);
+
+    } else if (to_disk) {
+        /* the browsers are about to fetch it: serve it from memory, not from disk */
+        memstore_put(name, data, len);
+        tmpfile_write_file_cb(name, data, len, image_written_to_httpdisplay, image);
+
+    } else if (!memstore_put(name, data, len)) {
+        log_msg(LOG_DEBUG, "%s image of %zu bytes doesn't fit in memory", mname, len);
+        xfree(image);
+
+    } else {
+        image_written_to_httpdisplay(name, TRUE, image);
+    }
+
+    free(thumb);
+}
+
+void dispatch_image_to_httpdisplay(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    char name[TMPNAMELEN];
+    int width, height;
+    uint64_t hash;
+
+    if (!image_wanted_info(mname, data, len, &width, &height, &hash))
         return;
 
+    send_image_to_httpdisplay(mname, generate_new_tmp_filename(mname, name), data, len, width, height,
+            meta, TRUE);
+}
+
+/*
+ * dispatch_image_to_httpdisplay_memory:
+ * Keep the image in the memory store, for the http display to serve it.
+ */
+void dispatch_image_to_httpdisplay_memory(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    char name[TMPNAMELEN];
+    int width, height;
+    uint64_t hash;
+
+    if (!image_wanted_info(mname, data, len, &width, &height, &hash))
+        return;
 
-    ws_send_media(name, MEDIATYPE_IMAGE);
+    send_image_to_httpdisplay(mname, generate_new_tmp_filename(mname, name), data, len, width, height,
+            meta, FALSE);
 }
 #endif /* !NO_HTTP_DISPLAY */
 
@@ -87,11 +417,13 @@ void dispatch_image_to_httpdisplay(const char *mname, const unsigned char *data,
  * Throw some MPEG audio into the player process or temporary directory as
  * appropriate.
  */
-void dispatch_mpeg_audio(const char *mname, const unsigned char *data, const size_t len) {
+void dispatch_mpeg_audio(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta) {
     mpeg_submit_chunk(data, len);
 }
 
-void dispatch_text_to_stdout(const char *mname, const unsigned char *data, const size_t len)
+void dispatch_text_to_stdout(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
 {
     char* text = parse_http_req(data, len);
 
@@ -101,18 +433,79 @@ void dispatch_text_to_stdout(const char *mname, const unsigned char *data, const
     }
 }
 
+/*
+ * dispatch_text_to_adjout:
+ * Announce an HTTP request with a frame of the adjunct output; the text is
+ * always carried in the frame.
+ */
+void dispatch_text_to_adjout(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    char* text = parse_http_req(data, len);
+    segrec_t rec;
+
+    if (text == NULL)
+        return;
+
+    segrec_init(&rec, mname, strlen(text), meta);
+    rec.hash = hash64(text, rec.len);
+    adjout_emit(&rec, (unsigned char*)text, NULL);
+
+    free(text);
+}
+
 #ifndef NO_HTTP_DISPLAY
-void dispatch_text_to_httpdisplay(const char *mname, const unsigned char *data, const size_t len)
+void dispatch_text_to_httpdisplay(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
 {
     char* text = parse_http_req(data, len);
+    ws_mediainfo_t info = { mname, len, 0, 0, meta };
 
     if (text != NULL) {
-        ws_send_media(text, MEDIATYPE_TEXT);
+        ws_send_media(text, MEDIATYPE_TEXT, &info);
         free(text);
     }
 }
 #endif /* !NO_HTTP_DISPLAY */
 
+/*
+ * dispatch_to_feed:
+ * Publish an object to the local feed, then hand it to the dispatch function
+ * its driver had before.
+ */
+static struct {
+    const char *mname;
+    void (*next)(const char *mname, const unsigned char *data, const size_t len, const mediameta_t *meta);
+} feed_chain[NMEDIATYPES];
+
+static int feed_nchain = 0;
+
+static void dispatch_to_feed(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta)
+{
+    int i;
+
+    feedsrv_publish(mname, data, len, meta);
+
+    for (i = 0; i < feed_nchain; ++i) {
+        if (strcmp(feed_chain[i].mname, mname) == 0) {
+            if (feed_chain[i].next)
+                feed_chain[i].next(mname, data, len, meta);
+            break;
+        }
+    }
+}
+
+void dispatch_add_feed(mediadrv_t *driver)
+{
+    if (feed_nchain == NMEDIATYPES || driver->dispatch_data == dispatch_to_feed)
+        return;
+
+    feed_chain[feed_nchain].mname = driver->name;
+    feed_chain[feed_nchain++].next = driver->dispatch_data;
+    driver->dispatch_data = dispatch_to_feed;
+}
+
 #define HTTP_URL_PREFIX_FORMAT "HTTP Request Captured: %s"
 size_t http_url_prefix_format_len = strlen(HTTP_URL_PREFIX_FORMAT) - 1;
 
@@ -9,23 +9,76 @@
 
 #include <stddef.h>
 
+#include "media.h" /* for mediameta_t */
+
 #ifndef MEDIA_DISPATCHER_H
 #define MEDIA_DISPATCHER_H
 
-void dispatch_image_to_stdout(const char *mname, const unsigned char *data, const size_t len);
+/* Images this small (in bytes or pixels) are most likely tracking pixels or
+ * bogus data. */
+#define DISPATCH_DEFAULT_IMG_MIN_SIZE   101
+#define DISPATCH_DEFAULT_IMG_MIN_DIM    9
+
+/*
+ * Set the limits of the images we dispatch (0 means no limit), checked
+ * before they are written anywhere.
+ */
+void dispatch_set_image_filter(size_t min_size, size_t max_size, int min_dim, int max_dim);
+
+/*
+ * Print a "seen again" line on standard output for each duplicate dropped.
+ */
+void dispatch_set_dedup_events(int enable);
+
+/*
+ * Send the images to the http display in binary websocket frames, instead of
+ * their names for the browsers to fetch them.
+ */
+void dispatch_set_ws_binary(int enable);
+
+/*
+ * Show the images in the http display as JPEG thumbnails of SIZE pixels (0
+ * for none), the full images being opened on click.
+ */
+void dispatch_set_thumbnails(unsigned int size);
+
+/*
+ * Publish the objects of DRIVER to the local feed (see feedsrv.h) before
+ * dispatching them as set up.
+ */
+void dispatch_add_feed(mediadrv_t *driver);
+
+void dispatch_image_to_archive(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
+void dispatch_media_to_archive(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
+
+void dispatch_image_to_stdout(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
+void dispatch_image_to_adjout(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
 #ifndef NO_DISPLAY_WINDOW
-void dispatch_image_to_display(const char *mname, const unsigned char *data, const size_t len);
+void dispatch_image_to_display(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
 #endif /* !NO_DISPLAY_WINDOW */
 
 #ifndef NO_HTTP_DISPLAY
-void dispatch_image_to_httpdisplay(const char *mname, const unsigned char *data, const size_t len);
+void dispatch_image_to_httpdisplay(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
+void dispatch_image_to_httpdisplay_memory(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
 #endif /* !NO_HTTP_DISPLAY */
 
-void dispatch_mpeg_audio(const char *mname, const unsigned char *data, const size_t len);
+void dispatch_mpeg_audio(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
 
-void dispatch_text_to_stdout(const char *mname, const unsigned char *data, const size_t len);
+void dispatch_text_to_stdout(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
+void dispatch_text_to_adjout(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
 #ifndef NO_HTTP_DISPLAY
-void dispatch_text_to_httpdisplay(const char *mname, const unsigned char *data, const size_t len);
+void dispatch_text_to_httpdisplay(const char *mname, const unsigned char *data, const size_t len,
+        const mediameta_t *meta);
 #endif /* !NO_HTTP_DISPLAY */
 
 #endif //MEDIA_DISPATCHER_H
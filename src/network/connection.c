@@ -23,6 +23,7 @@
 #include <time.h>
 
 #include "common/util.h"
+#include "common/metrics.h"
 #include "media/media.h"
 
 #include "pcap_engine.h"
@@ -177,6 +178,9 @@ void sweep_connections(void)
 			if ((now - c->last) > TIMEOUT
 					|| (c->fin && (!c->blocks || !c->blocks->next))
 					|| c->len > MAXCONNECTIONDATA) {
+				/* last chance to decode what is held back for lack of time */
+				if (c->http)
+					c->http->closing = TRUE;
 				extract_media(c);
 				connection_delete(c);
 				*C = NULL;
@@ -203,6 +207,9 @@ connection connection_new(const struct sockaddr *src,
 	c->last = time(NULL );
 	c->blocks = NULL;
 
+	metrics_add(METRIC_CONNECTIONS, 1);
+	metrics_add(METRIC_REASSEMBLY_BYTES, c->alloc);
+
 	return c;
 }
 
@@ -219,6 +226,12 @@ void connection_delete(connection c)
 		b = b2;
 	}
 
+	http_decoder_delete(c->http);
+	media_free_claims(&c->claims);
+
+	metrics_add(METRIC_CONNECTIONS, -1);
+	metrics_add(METRIC_REASSEMBLY_BYTES, -(int64_t)c->alloc);
+
 	free(c->data);
 	free(c);
 }
@@ -235,9 +248,11 @@ void connection_push(connection c, const unsigned char *data, unsigned int off,
 
 	if (off + len > c->alloc) {
 		/* Allocate more memory. */
+		metrics_add(METRIC_REASSEMBLY_BYTES, -(int64_t)c->alloc);
 		do
 			c->alloc *= 2;
 		while (off + len > c->alloc);
+		metrics_add(METRIC_REASSEMBLY_BYTES, c->alloc);
 		c->data = (unsigned char*) xrealloc(c->data, c->alloc);
 	}
 
@@ -34,6 +34,7 @@
 #include <netinet/tcp.h>
 
 #include "media/media.h" /* NMEDIATYPES */
+#include "media/http_decoder.h"
 
 /*
  * Object representing one half of a TCP stream connection. Each connection
@@ -58,11 +59,21 @@ typedef struct _connection {
      * so that it is undergoing a shutdown. */
     int fin;
 
-    /* The time at which we last received any data on this stream. */
+    /* The time at which we last received any data on this stream, and the
+     * capture time of that segment. */
     time_t last;
+    struct timeval ts;
 
     /* A list of the extents in the buffer which contain valid data. */
     struct datablock *blocks;
+
+    /* The extents of the buffer already carved by some media driver. */
+    mediaclaim_t *claims;
+
+    /* Decoder of the HTTP responses carried by this stream, if any, and a
+     * flag telling that the stream doesn't look like HTTP responses. */
+    http_decoder_t *http;
+    int nohttp;
 } *connection;
 
 void connection_alloc_slots(void);
@@ -17,9 +17,11 @@
 #include "compat/compat.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h> /* On many systems (Darwin...), stdio.h is a prerequisite. */
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <signal.h> /* sig_atomic */
 #include <sys/socket.h> /* On Darwin, stdlib.h is a prerequisite.  */
@@ -34,10 +36,12 @@
 
 #include <pcap.h>
 
-#include "common/tmpdir.h"
 #include "common/log.h"
 #include "common/util.h"
+#include "common/metrics.h"
 #include "media/media.h"
+#include "media/http_decoder.h"
+#include "media/outqueue.h"
 #include "connection.h"
 #include "layer3.h"
 #include "layer2.h"
@@ -46,6 +50,7 @@
 
 static void process_packet(u_char *user, const struct pcap_pkthdr *hdr, const u_char *pkt);
 static datalink_info_t get_datalink_info(pcap_t *pcap);
+static void sample_pcap_stats(int force);
 
 #define SNAPLEN 262144      /* largest chunk of data we accept from pcap */
 #define WRAPLEN 262144      /* out-of-order packet margin */
@@ -54,7 +59,7 @@ static datalink_info_t get_datalink_info(pcap_t *pcap);
 static pcap_t *pc = NULL;
 static datalink_info_t datalink_info;
 
-static int running = FALSE;
+static atomic_int running = FALSE;
 static pthread_t packetth;
 static int is_offline = FALSE;
 static int offline_delay = 0;
@@ -197,8 +202,10 @@ void network_close(void)
     pthread_cancel(packetth); /* make sure thread quits even if it's stuck in pcap_dispatch */
     pthread_join(packetth, NULL);
 
-	if (pc != NULL)
+	if (pc != NULL) {
+		sample_pcap_stats(TRUE);
 		pcap_close(pc);
+	}
 
     /* Easier for memory-leak debugging if we deallocate all this here.... */
     connection_free_slots();
@@ -221,10 +228,42 @@ char* network_get_default_interface(void)
     return interface;
 }
 
+/* sample_pcap_stats FORCE
+ * Adds what the counters of the capture kept by libpcap (and the kernel) went
+ * up since the last time, once a second or if FORCE. The handle isn't thread
+ * safe, so this runs on the capture thread, or once it is gone. */
+static void sample_pcap_stats(int force)
+{
+    static struct pcap_stat last;
+    static time_t last_time;
+    struct pcap_stat ps;
+    time_t now = time(NULL);
+
+    if (is_offline || (!force && now == last_time))
+        return;
+
+    last_time = now;
+
+    if (pcap_stats(pc, &ps) != 0)
+        return;
+
+    /* unsigned, so a counter wrapping around still adds up */
+    metrics_add(METRIC_PCAP_RECEIVED, (u_int)(ps.ps_recv - last.ps_recv));
+    metrics_add(METRIC_PCAP_DROPPED, (u_int)(ps.ps_drop - last.ps_drop));
+    metrics_add(METRIC_PCAP_IF_DROPPED, (u_int)(ps.ps_ifdrop - last.ps_ifdrop));
+
+    last = ps;
+}
+
 void network_start(drivers_t* drivers)
 {
+    int i;
+
     media_drivers = drivers;
 
+    for (i = 0; i < drivers->count; ++i)
+        metrics_set_driver_name(i, drivers->list[i]->name);
+
     connection_alloc_slots();
 
     running = TRUE;
@@ -275,6 +314,8 @@ void packetcapture_dispatch(int packet_count)
 {
     int ret = pcap_dispatch(pc, packet_count, process_packet, NULL);
 
+    sample_pcap_stats(FALSE);
+
     if (ret == -1) {
         char* pcap_err = pcap_geterr(pc);
 
@@ -302,6 +343,9 @@ void process_packet(u_char *user, const struct pcap_pkthdr *hdr, const u_char *p
     s = (struct sockaddr *)&src;
     d = (struct sockaddr *)&dst;
 
+    metrics_add(METRIC_PACKETS, 1);
+    metrics_add(METRIC_PACKET_BYTES, hdr->len);
+
     if (handle_link_layer(&datalink_info, pkt, hdr->caplen, &proto, &off))
     	return;
 	
@@ -373,6 +417,7 @@ void process_packet(u_char *user, const struct pcap_pkthdr *hdr, const u_char *p
             log_msg(LOG_INFO, "out of order packet: %s", connection_string(s, d));
         } else {
             connection_push(c, pkt + off, offset, len);
+            c->ts = hdr->ts;
             extract_media(c);
         }
     }
@@ -402,37 +447,150 @@ datalink_info_t get_datalink_info(pcap_t *pcap)
     return info;
 }
 
+/* scan_media DATA BASE LEN MOFF MASK CLAIMS META
+ * Run the media drivers selected by MASK over the LEN bytes at DATA,
+ * starting each one at its offset in MOFF, and update the offsets. Regions
+ * in CLAIMS (whose offsets are relative to DATA - BASE) were already carved
+ * and are skipped; what we carve is added to them and dispatched with
+ * META. */
+static void scan_media(unsigned char *data, size_t base, size_t len, int *moff,
+        unsigned int mask, mediaclaim_t **claims, const mediameta_t *meta)
+{
+    int i;
+
+    for (i = 0; i < media_drivers->count; ++i) {
+        unsigned char *ptr, *oldptr, *end, *media;
+        const mediaclaim_t *claim;
+        size_t mlen;
+        mediadrv_t* driver;
+
+        if (!(mask & (1U << i))) {
+            moff[i] = len;
+            continue;
+        }
+
+        driver = media_drivers->list[i];
+        ptr = data + moff[i];
+
+        while (ptr < data + len) {
+            /* look only up to the next carved region */
+            claim = media_next_claim(*claims, base + (ptr - data));
+            end = data + len;
+
+            if (claim && claim->off < base + len) {
+                if (claim->off <= base + (ptr - data)) {
+                    ptr = data + (claim->off + claim->len - base);
+                    continue;
+                }
+                end = data + (claim->off - base);
+            }
+
+            oldptr = NULL;
+            while (ptr != oldptr && ptr < end) {
+                oldptr = ptr;
+                ptr = driver->find_data(ptr, end - ptr, &media, &mlen);
+                metrics_driver_add(i, METRIC_DRIVER_CANDIDATES, 1);
+                if (media) {
+                    metrics_driver_add(i, METRIC_DRIVER_HITS, 1);
+                    metrics_driver_add(i, METRIC_DRIVER_BYTES, mlen);
+                    outqueue_dispatch(driver, media, mlen, meta);
+                    media_claim(claims, base + (media - data), mlen);
+                }
+            }
+
+            /* nothing can span over a carved region, so anything left
+             * pending before it is given up */
+            if (end == data + len)
+                break;
+
+            ptr = end;
+        }
+
+        if (ptr > data + len)
+            ptr = data + len;
+
+        moff[i] = ptr - data;
+    }
+}
+
+/* extract_http_bodies CONNECTION META
+ * Feed the contiguous head of the stream through the HTTP decoder and look
+ * for media in the decoded bodies, with the drivers selected by their
+ * content type. Streams not starting with a response are left alone. */
+static void extract_http_bodies(connection c, const mediameta_t *meta)
+{
+    struct datablock *b = c->blocks;
+    http_decoder_t *d;
+
+    if (c->nohttp || !b || b->off != 0)
+        return;
+
+    if (!c->http) {
+        if (b->len < 5)
+            return;
+
+        if (!http_decoder_enabled() || !http_is_response(c->data, b->len)) {
+            c->nohttp = TRUE;
+            return;
+        }
+
+        c->http = http_decoder_new();
+    }
+
+    d = c->http;
+
+    while (d->off < (size_t)b->len && d->state != HTTP_DECODER_FAILED) {
+        size_t n = http_decoder_feed(d, c->data + d->off, b->len - d->off);
+
+        if (d->outlen > 0)
+            scan_media(d->out, 0, d->outlen, d->moff,
+                    get_drivers_mask_for_content_type(media_drivers, d->resp.content_type), &d->claims,
+                    meta);
+
+        if (d->msg_done)
+            http_decoder_next_message(d);
+        else if (n == 0)
+            break;
+    }
+
+    if (d->state == HTTP_DECODER_FAILED) {
+        int i;
+
+        /* Scan the rest of the stream as raw data, from where we stopped. */
+        for (i = 0; i < media_drivers->count; ++i)
+            if (b->moff[i] < (int)d->off)
+                b->moff[i] = d->off;
+
+        b->dirty = 1;
+        c->nohttp = TRUE;
+
+        http_decoder_delete(c->http);
+        c->http = NULL;
+    }
+}
+
 /* connection_extract_media CONNECTION TYPE
  * Attempt to extract media data of the given TYPE from CONNECTION. */
 void extract_media(connection c)
 {
     struct datablock *b;
+    mediameta_t meta;
+
+    meta.src = c->src;
+    meta.dst = c->dst;
+    meta.ts = c->ts;
+
+    extract_http_bodies(c, &meta);
 
     /* Walk through the list of blocks and try to extract media data from
      * those which have changed. */
     for (b = c->blocks; b; b = b->next) {
-        if (b->len > 0 && b->dirty) {
-            int i;
-
-            for (i = 0; i < media_drivers->count; ++i) {
-                unsigned char *ptr, *oldptr, *media;
-                size_t mlen;
-                mediadrv_t* driver;
-
-                driver = media_drivers->list[i];
-                ptr = c->data + b->off + b->moff[i];
-                oldptr = NULL;
-
-                while (ptr != oldptr && ptr < c->data + b->off + b->len) {
-                    oldptr = ptr;
-                    ptr = driver->find_data(ptr, (b->off + b->len) - (ptr - c->data), &media, &mlen);
-                    if (media && !tmpfiles_limit_reached())
-                        driver->dispatch_data(driver->name, media, mlen);
-                }
-
-                b->moff[i] = ptr - c->data - b->off;
-            }
+        /* the head of a HTTP stream was already handled by the decoder */
+        if (b == c->blocks && c->http)
+            continue;
 
+        if (b->len > 0 && b->dirty) {
+            scan_media(c->data + b->off, b->off, b->len, b->moff, DRIVERS_MASK_ALL, &c->claims, &meta);
             b->dirty = 0;
         }
     }
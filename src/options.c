@@ -22,7 +22,18 @@
 #include <getopt.h>                     // for optarg, optind, optopt, etc
 
 #include "common/log.h"
+#include "common/util.h"
+#include "common/tmpdir.h"
+#include "common/memstore.h"
 #include "network/network.h"
+#include "media/http_decoder.h"
+#include "media/dedup.h"
+#include "media/outqueue.h"
+#include "media/segarchive.h"
+#include "media/adjout.h"
+#include "media/feedsrv.h"
+#include "img/thumb.h"
+#include "media_dispatcher.h"
 
 #include "options.h"
 
@@ -33,7 +44,90 @@ options_t options = {
     "driftnet-",
     FALSE,
 #endif
-    NULL, 0, 0, FALSE, 9090, 0
+    NULL, 0, 0, FALSE, 9090, 0,
+    TRUE, HTTP_DECODER_DEFAULT_FLOW_MAX, HTTP_DECODER_DEFAULT_MEM_MAX, HTTP_DECODER_DEFAULT_CPU_MAX,
+    DISPATCH_DEFAULT_IMG_MIN_SIZE, 0, DISPATCH_DEFAULT_IMG_MIN_DIM, 0,
+    TRUE, DEDUP_DEFAULT_WINDOW, DEDUP_DEFAULT_MEM_MAX, FALSE,
+    OUTQUEUE_DEFAULT_THREADS, OUTQUEUE_DEFAULT_MAX_BYTES, OUTQUEUE_DROP_OLDEST,
+    TRUE, FALSE,
+    0, 0,
+    NULL, SEGARCHIVE_DEFAULT_SEGMENT_MAX,
+    FALSE, MEMSTORE_DEFAULT_MAX_BYTES,
+    ADJOUT_LINES, NULL, FALSE, ADJOUT_DEFAULT_FLUSH_MS,
+    NULL, FEEDSRV_DEFAULT_CLIENT_MAX, OUTQUEUE_DROP_OLDEST,
+    FALSE, 0
+};
+
+/* Values returned by getopt_long for the options without a short form. */
+enum {
+    OPT_NO_DECODE = 256,
+    OPT_DECODE_FLOW_MAX,
+    OPT_DECODE_MEM_MAX,
+    OPT_DECODE_CPU_MAX,
+    OPT_MIN_SIZE,
+    OPT_MAX_SIZE,
+    OPT_MIN_DIM,
+    OPT_MAX_DIM,
+    OPT_NO_DEDUP,
+    OPT_DEDUP_WINDOW,
+    OPT_DEDUP_MEM_MAX,
+    OPT_DEDUP_EVENTS,
+    OPT_OUT_THREADS,
+    OPT_OUT_QUEUE,
+    OPT_OUT_POLICY,
+    OPT_NO_IO_URING,
+    OPT_DURABLE,
+    OPT_FANOUT,
+    OPT_ARCHIVE,
+    OPT_SEGMENT_SIZE,
+    OPT_MEMORY_ONLY,
+    OPT_MEM_MAX,
+    OPT_ADJUNCT_FORMAT,
+    OPT_ADJUNCT_SOCKET,
+    OPT_INLINE,
+    OPT_FLUSH_INTERVAL,
+    OPT_FEED_SOCKET,
+    OPT_FEED_BUFFER,
+    OPT_FEED_POLICY,
+    OPT_WS_BINARY,
+    OPT_THUMBNAILS,
+    OPT_THUMB_SIZE
+};
+
+static const struct option long_options[] = {
+    { "no-decode",       no_argument,       NULL, OPT_NO_DECODE },
+    { "decode-flow-max", required_argument, NULL, OPT_DECODE_FLOW_MAX },
+    { "decode-mem-max",  required_argument, NULL, OPT_DECODE_MEM_MAX },
+    { "decode-cpu-max",  required_argument, NULL, OPT_DECODE_CPU_MAX },
+    { "min-size",        required_argument, NULL, OPT_MIN_SIZE },
+    { "max-size",        required_argument, NULL, OPT_MAX_SIZE },
+    { "min-dim",         required_argument, NULL, OPT_MIN_DIM },
+    { "max-dim",         required_argument, NULL, OPT_MAX_DIM },
+    { "no-dedup",        no_argument,       NULL, OPT_NO_DEDUP },
+    { "dedup-window",    required_argument, NULL, OPT_DEDUP_WINDOW },
+    { "dedup-mem-max",   required_argument, NULL, OPT_DEDUP_MEM_MAX },
+    { "dedup-events",    no_argument,       NULL, OPT_DEDUP_EVENTS },
+    { "out-threads",     required_argument, NULL, OPT_OUT_THREADS },
+    { "out-queue",       required_argument, NULL, OPT_OUT_QUEUE },
+    { "out-policy",      required_argument, NULL, OPT_OUT_POLICY },
+    { "no-io-uring",     no_argument,       NULL, OPT_NO_IO_URING },
+    { "durable",         no_argument,       NULL, OPT_DURABLE },
+    { "fanout",          required_argument, NULL, OPT_FANOUT },
+    { "archive",         required_argument, NULL, OPT_ARCHIVE },
+    { "segment-size",    required_argument, NULL, OPT_SEGMENT_SIZE },
+    { "memory-only",     no_argument,       NULL, OPT_MEMORY_ONLY },
+    { "mem-max",         required_argument, NULL, OPT_MEM_MAX },
+    { "adjunct-format",  required_argument, NULL, OPT_ADJUNCT_FORMAT },
+    { "adjunct-socket",  required_argument, NULL, OPT_ADJUNCT_SOCKET },
+    { "inline",          no_argument,       NULL, OPT_INLINE },
+    { "flush-interval",  required_argument, NULL, OPT_FLUSH_INTERVAL },
+    { "feed-socket",     required_argument, NULL, OPT_FEED_SOCKET },
+    { "feed-buffer",     required_argument, NULL, OPT_FEED_BUFFER },
+    { "feed-policy",     required_argument, NULL, OPT_FEED_POLICY },
+    { "ws-binary",       no_argument,       NULL, OPT_WS_BINARY },
+    { "thumbnails",      no_argument,       NULL, OPT_THUMBNAILS },
+    { "thumb-size",      required_argument, NULL, OPT_THUMB_SIZE },
+    { NULL, 0, NULL, 0 }
 };
 
 static int validate_options(options_t* options);
@@ -49,7 +143,7 @@ options_t* parse_options(int argc, char *argv[])
     mediatype_t specific_media = 0;
 
     opterr = 0;
-    while ((c = getopt(argc, argv, optstring)) != -1) {
+    while ((c = getopt_long(argc, argv, optstring, long_options, NULL)) != -1) {
         switch(c) {
             case 'h':
                 usage(stdout);
@@ -117,13 +211,23 @@ options_t* parse_options(int argc, char *argv[])
                 options.adjunct = TRUE;
                 break;
 
-            case 'm':
-                options.max_tmpfiles = atoi(optarg);
-                if (options.max_tmpfiles <= 0) {
+            case 'm': {
+                int ok;
+
+                /* a plain number counts files, with a size suffix it's a quota of bytes */
+                if (optarg[strspn(optarg, "0123456789")] == '\0') {
+                    options.max_tmpfiles = atoi(optarg);
+                    ok = options.max_tmpfiles > 0;
+                } else {
+                    ok = parse_size(optarg, &options.max_tmpbytes) && options.max_tmpbytes > 0;
+                }
+
+                if (!ok) {
                     log_msg(LOG_ERROR, "`%s' does not make sense for -m", optarg);
                     return NULL;
                 }
                 break;
+            }
 
             case 'd':
                 options.tmpdir = strdup(optarg);
@@ -176,9 +280,223 @@ options_t* parse_options(int argc, char *argv[])
                 options.offline_delay = atoi(optarg);
                 break;
 
+            case OPT_NO_DECODE:
+                options.decode_http = FALSE;
+                break;
+
+            case OPT_DECODE_FLOW_MAX:
+                if (!parse_size(optarg, &options.decode_flow_max) || options.decode_flow_max == 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --decode-flow-max", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_DECODE_MEM_MAX:
+                if (!parse_size(optarg, &options.decode_mem_max) || options.decode_mem_max == 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --decode-mem-max", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_DECODE_CPU_MAX:
+                if (atoi(optarg) < 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --decode-cpu-max", optarg);
+                    return NULL;
+                }
+                options.decode_cpu_max = atoi(optarg);
+                break;
+
+            case OPT_MIN_SIZE:
+                if (!parse_size(optarg, &options.img_min_size)) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --min-size", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_MAX_SIZE:
+                if (!parse_size(optarg, &options.img_max_size)) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --max-size", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_MIN_DIM:
+                options.img_min_dim = atoi(optarg);
+                if (options.img_min_dim < 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --min-dim", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_MAX_DIM:
+                options.img_max_dim = atoi(optarg);
+                if (options.img_max_dim < 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --max-dim", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_NO_DEDUP:
+                options.dedup = FALSE;
+                break;
+
+            case OPT_DEDUP_WINDOW:
+                if (atoi(optarg) <= 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --dedup-window", optarg);
+                    return NULL;
+                }
+                options.dedup_window = atoi(optarg);
+                break;
+
+            case OPT_DEDUP_MEM_MAX:
+                if (!parse_size(optarg, &options.dedup_mem_max) || options.dedup_mem_max == 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --dedup-mem-max", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_DEDUP_EVENTS:
+                options.dedup_events = TRUE;
+                break;
+
+            case OPT_OUT_THREADS:
+                options.out_threads = atoi(optarg);
+                if (options.out_threads < 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --out-threads", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_OUT_QUEUE:
+                if (!parse_size(optarg, &options.out_queue_max) || options.out_queue_max == 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --out-queue", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_OUT_POLICY: {
+                outqueue_policy_t policy;
+
+                if (!outqueue_parse_policy(optarg, &policy)) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --out-policy", optarg);
+                    return NULL;
+                }
+                options.out_policy = policy;
+                break;
+            }
+
+            case OPT_NO_IO_URING:
+                options.io_uring = FALSE;
+                break;
+
+            case OPT_DURABLE:
+                options.durable = TRUE;
+                break;
+
+            case OPT_FANOUT:
+                options.fanout = atoi(optarg);
+                if (options.fanout < 0 || options.fanout > TMPDIR_FANOUT_MAX) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --fanout", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_ARCHIVE:
+                options.archive_dir = strdup(optarg);
+                break;
+
+            case OPT_SEGMENT_SIZE:
+                if (!parse_size(optarg, &options.segment_max) || options.segment_max == 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --segment-size", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_MEMORY_ONLY:
+                options.memory_only = TRUE;
+                break;
+
+            case OPT_MEM_MAX:
+                if (!parse_size(optarg, &options.mem_max) || options.mem_max == 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --mem-max", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_ADJUNCT_FORMAT: {
+                adjout_format_t format;
+
+                if (!adjout_parse_format(optarg, &format)) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --adjunct-format", optarg);
+                    return NULL;
+                }
+                options.adjunct_format = format;
+                break;
+            }
+
+            case OPT_ADJUNCT_SOCKET:
+                options.adjunct_socket = strdup(optarg);
+                break;
+
+            case OPT_INLINE:
+                options.adjunct_inline = TRUE;
+                break;
+
+            case OPT_FLUSH_INTERVAL:
+                options.flush_ms = atoi(optarg);
+                if (options.flush_ms > 60000) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --flush-interval", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_FEED_SOCKET:
+                options.feed_socket = strdup(optarg);
+                break;
+
+            case OPT_FEED_BUFFER:
+                if (!parse_size(optarg, &options.feed_buffer) || options.feed_buffer == 0) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --feed-buffer", optarg);
+                    return NULL;
+                }
+                break;
+
+            case OPT_FEED_POLICY: {
+                outqueue_policy_t policy;
+
+                /* a subscriber must never hold the capture back */
+                if (!outqueue_parse_policy(optarg, &policy) || policy == OUTQUEUE_BLOCK) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --feed-policy", optarg);
+                    return NULL;
+                }
+                options.feed_policy = policy;
+                break;
+            }
+
+            case OPT_WS_BINARY:
+                options.ws_binary = TRUE;
+                break;
+
+            case OPT_THUMBNAILS:
+                if (!options.thumb_size)
+                    options.thumb_size = THUMB_DEFAULT_SIZE;
+                break;
+
+            case OPT_THUMB_SIZE:
+                options.thumb_size = atoi(optarg);
+                if (options.thumb_size < 16 || options.thumb_size > 4096) {
+                    log_msg(LOG_ERROR, "`%s' does not make sense for --thumb-size", optarg);
+                    return NULL;
+                }
+                break;
+
             case '?':
             default:
-                if (strchr(optstring, optopt))
+                if (optopt >= OPT_NO_DECODE)
+                    log_msg(LOG_ERROR, "option %s requires an argument", argv[optind - 1]);
+                else if (optopt == 0)
+                    log_msg(LOG_ERROR, "unrecognised option %s", argv[optind - 1]);
+                else if (strchr(optstring, optopt))
                     log_msg(LOG_ERROR, "option -%c requires an argument", optopt);
                 else
                     log_msg(LOG_ERROR, "unrecognised option -%c", optopt);
@@ -248,9 +566,15 @@ int validate_options(options_t* options)
     }
 
     /* Let's not be too fascist about option checking.... */
-    if (options->max_tmpfiles && !options->adjunct) {
+    if ((options->max_tmpfiles || options->max_tmpbytes) && !options->adjunct) {
         log_msg(LOG_WARNING, "-m only makes sense with -a");
         options->max_tmpfiles = 0;
+        options->max_tmpbytes = 0;
+    }
+
+    if (options->archive_dir && !options->adjunct) {
+        log_msg(LOG_WARNING, "--archive only makes sense with -a");
+        options->archive_dir = NULL;
     }
 
     if (options->adjunct && options->newpfx)
@@ -265,6 +589,9 @@ int validate_options(options_t* options)
     if (options->max_tmpfiles && options->adjunct)
         log_msg(LOG_INFO, "a maximum of %d images will be buffered", options->max_tmpfiles);
 
+    if (options->max_tmpbytes && options->adjunct)
+        log_msg(LOG_INFO, "a maximum of %zu bytes of images will be buffered", options->max_tmpbytes);
+
     if (options->beep && options->adjunct)
         log_msg(LOG_WARNING, "can't beep in adjunct mode");
 
@@ -293,6 +620,62 @@ int validate_options(options_t* options)
 #endif
     }
 
+    if (options->adjunct_format != ADJOUT_LINES && !options->adjunct) {
+        log_msg(LOG_WARNING, "--adjunct-format only makes sense with -a");
+        options->adjunct_format = ADJOUT_LINES;
+    }
+
+    if (options->adjunct_format == ADJOUT_LINES && (options->adjunct_socket || options->adjunct_inline)) {
+        log_msg(LOG_ERROR, "--adjunct-socket and --inline need --adjunct-format jsonl or binary");
+        return FALSE;
+    }
+
+    if (options->adjunct_format != ADJOUT_LINES && options->archive_dir) {
+        log_msg(LOG_WARNING, "--adjunct-format ignored with --archive");
+        options->adjunct_format = ADJOUT_LINES;
+    }
+
+    /* the frames can't be mixed with other lines */
+    if (options->adjunct_format != ADJOUT_LINES && !options->adjunct_socket && options->dedup_events) {
+        log_msg(LOG_WARNING, "--dedup-events ignored when the frames go to standard output");
+        options->dedup_events = FALSE;
+    }
+
+    if (options->ws_binary && (options->adjunct || !options->enable_http_display)) {
+        log_msg(LOG_WARNING, "--ws-binary only makes sense with the http display");
+        options->ws_binary = FALSE;
+    }
+
+    if (options->thumb_size && (options->adjunct || !options->enable_http_display)) {
+        log_msg(LOG_WARNING, "--thumbnails only makes sense with the http display");
+        options->thumb_size = 0;
+    }
+
+    if (options->memory_only && options->adjunct) {
+        log_msg(LOG_ERROR, "--memory-only can't be used in adjunct mode");
+        return FALSE;
+    }
+
+    if (options->fanout && options->memory_only) {
+        log_msg(LOG_WARNING, "--fanout ignored when nothing is written to disk");
+        options->fanout = 0;
+    }
+
+    if (options->img_max_size && options->img_max_size < options->img_min_size) {
+        log_msg(LOG_ERROR, "--max-size can't be smaller than --min-size");
+        return FALSE;
+    }
+
+    if (options->img_max_dim && options->img_max_dim < options->img_min_dim) {
+        log_msg(LOG_ERROR, "--max-dim can't be smaller than --min-dim");
+        return FALSE;
+    }
+
+    if (options->dedup_events && !options->dedup) {
+        log_msg(LOG_WARNING, "--dedup-events ignored with --no-dedup");
+        options->dedup_events = FALSE;
+    }
+
     if (options->verbose && options->debug) {
         log_msg(LOG_WARNING, "verbose and debug are mutually exclusive: switching to debug mode anyway");
     }
@@ -325,8 +708,9 @@ void usage(FILE *fp)
 "  -a               Adjunct mode: do not display images on screen, but save\n"
 "                   them to a temporary directory and announce their names on\n"
 "                   standard output.\n"
-"  -m number        Maximum number of images to keep in temporary directory\n"
-"                   in adjunct mode.\n"
+"  -m number|size   Maximum number of images (or, with a k, M or G suffix, of\n"
+"                   bytes) to keep in temporary directory in adjunct mode; the\n"
+"                   oldest ones are deleted to make room. Can be given twice.\n"
 "  -d directory     Use the named temporary directory.\n"
 "  -x prefix        Prefix to use when saving images.\n"
 "  -s               Attempt to extract streamed audio data from the network,\n"
@@ -351,6 +735,82 @@ void usage(FILE *fp)
 "  -W               Port number for the HTTP server (implies -w). Default: 9090.\n"
 #endif
 "  -y miliseconds   In offline mode, use specified miliseconds delay between packets.\n"
+"  --no-decode      Do not undo the gzip, deflate or br encoding of HTTP\n"
+"                   response bodies before looking for media in them.\n"
+"  --decode-flow-max size\n"
+"                   Maximum decoded bytes per connection (k, M and G suffixes\n"
+"                   accepted). Default: 8M.\n"
+"  --decode-mem-max size\n"
+"                   Maximum memory used by all the HTTP decoders together.\n"
+"                   Default: 64M.\n"
+"  --decode-cpu-max miliseconds\n"
+"                   Maximum time spent decoding HTTP bodies each second\n"
+"                   (0 means no limit). Default: 250.\n"
+"  --min-size size  Drop images smaller than size bytes. Default: 101.\n"
+"  --max-size size  Drop images bigger than size bytes (0 means no limit).\n"
+"                   Default: 0.\n"
+"  --min-dim pixels Drop images whose width or height is smaller than\n"
+"                   pixels. Default: 9.\n"
+"  --max-dim pixels Drop images whose width or height is bigger than pixels\n"
+"                   (0 means no limit). Default: 0.\n"
+"  --no-dedup       Do not drop images identical to a recently seen one.\n"
+"  --dedup-window number\n"
+"                   Number of recently seen images remembered. Default: 16384.\n"
+"  --dedup-mem-max size\n"
+"                   Maximum memory used to remember them. Default: 1M.\n"
+"  --dedup-events   Print a `seen again' line on standard output for each\n"
+"                   duplicate dropped.\n"
+"  --out-threads number\n"
+"                   Number of threads writing out the images, off the capture\n"
+"                   thread (0 writes them from the capture thread). Default: 1.\n"
+"  --out-queue size Maximum bytes of images waiting to be written.\n"
+"                   Default: 32M.\n"
+"  --out-policy policy\n"
+"                   What to do when the queue is full: block (stalls the\n"
+"                   capture), drop-newest or drop-oldest. Default: drop-oldest.\n"
+"  --no-io-uring    Do not batch the writes of the writer threads with io_uring.\n"
+"  --durable        Sync each file to disk before announcing it.\n"
+"  --fanout levels  Spread the files over 1 or 2 levels of subdirectories of\n"
+"                   the temporary directory. Default: 0 (all in it).\n"
+"  --archive dir    In adjunct mode, append the media to segment files in dir,\n"
+"                   with an index each, instead of writing a file per object\n"
+"                   (see driftnet-extract).\n"
+"  --segment-size size\n"
+"                   Size of each segment of the archive. Default: 256M.\n"
+"  --memory-only    Keep the images in memory instead of writing them to disk;\n"
+"                   the http display serves them from there.\n"
+"  --mem-max size   Memory for the images the http display serves from\n"
+"                   memory; the least recently used ones are dropped.\n"
+"                   Default: 64M.\n"
+"  --adjunct-format format\n"
+"                   How to announce the objects in adjunct mode: lines (a\n"
+"                   path per line), jsonl (a JSON object per line, with the\n"
+"                   flow, time, hash and dimensions) or binary (length\n"
+"                   prefixed frames). Default: lines.\n"
+"  --adjunct-socket path\n"
+"                   Send the frames to the Unix socket at path instead of\n"
+"                   standard output.\n"
+"  --inline         Carry the objects in the frames instead of writing them\n"
+"                   to files.\n"
+"  --flush-interval miliseconds\n"
+"                   Time between writes of the batched frames (0 writes each\n"
+"                   frame right away). Default: 100.\n"
+"  --feed-socket path\n"
+"                   Also feed the media to the local programs subscribed on\n"
+"                   the Unix socket at path, each with its own filter.\n"
+"  --feed-buffer size\n"
+"                   Maximum bytes waiting to be sent to each subscriber.\n"
+"                   Default: 4M.\n"
+"  --feed-policy policy\n"
+"                   What to do when a subscriber is too slow: drop-newest or\n"
+"                   drop-oldest. Default: drop-oldest.\n"
+"  --ws-binary      Push the images to the browsers of the http display in\n"
+"                   the websocket messages, instead of having them fetched.\n"
+"  --thumbnails     Show JPEG thumbnails of the images in the http display,\n"
+"                   and the full images on click.\n"
+"  --thumb-size pixels\n"
+"                   Longest side of the thumbnails (implies --thumbnails).\n"
+"                   Default: 256.\n"
 "\n"
 "Filter code can be specified after any options in the manner of tcpdump(8).\n"
 "The filter code will be evaluated as `tcp and (user filter code)'\n"
@@ -14,6 +14,8 @@
     #include <config.h>
 #endif
 
+#include <stddef.h>
+
 #include "media/media.h" /* for enum mediatype */
 
 typedef struct {
@@ -43,6 +45,38 @@ typedef struct {
     int enable_http_display;
     int http_server_port;
     int offline_delay;
+    int decode_http;
+    size_t decode_flow_max;
+    size_t decode_mem_max;
+    unsigned int decode_cpu_max;
+    size_t img_min_size;
+    size_t img_max_size;
+    int img_min_dim;
+    int img_max_dim;
+    int dedup;
+    size_t dedup_window;
+    size_t dedup_mem_max;
+    int dedup_events;
+    int out_threads;
+    size_t out_queue_max;
+    int out_policy;
+    int io_uring;
+    int durable;
+    size_t max_tmpbytes;
+    int fanout;
+    char *archive_dir;
+    size_t segment_max;
+    int memory_only;
+    size_t mem_max;
+    int adjunct_format;
+    char *adjunct_socket;
+    int adjunct_inline;
+    unsigned int flush_ms;
+    char *feed_socket;
+    size_t feed_buffer;
+    int feed_policy;
+    int ws_binary;
+    unsigned int thumb_size;
 } options_t;
 
 options_t* parse_options(int argc, char *argv[]);